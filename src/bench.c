@@ -0,0 +1,120 @@
+/**
+ * @file bench.c
+ * @author Toesoe
+ * @brief seaboy throughput benchmark
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "hw/snd.h"
+#include "drv/render.h"
+
+#define CLOCK_HZ      4194304.0
+#define FRAME_CYCLES  70224.0
+
+atomic_uchar g_benchSection = BENCH_OTHER;
+
+static const char *g_sectionNames[BENCH_SECTION_COUNT] = { "cpu", "ppu", "apu", "other" };
+
+static pthread_t   g_sampler;
+static atomic_bool g_sampling = false;
+static uint64_t    g_samples[BENCH_SECTION_COUNT];
+static uint64_t    g_samplerCpuNs = 0;
+
+static uint64_t wallStartNs = 0;
+static uint64_t threadStartNs = 0;
+static uint64_t processStartNs = 0;
+
+static uint64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static void *sampler(void *pArg)
+{
+    (void)pArg;
+
+    struct timespec period = { 0, BENCH_SAMPLE_NS };
+
+    while (atomic_load_explicit(&g_sampling, memory_order_relaxed))
+    {
+        g_samples[atomic_load_explicit(&g_benchSection, memory_order_relaxed) % BENCH_SECTION_COUNT]++;
+        nanosleep(&period, NULL);
+    }
+
+    g_samplerCpuNs = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+bool benchStart(void)
+{
+    for (int i = 0; i < BENCH_SECTION_COUNT; i++)
+    {
+        g_samples[i] = 0;
+    }
+
+    atomic_store(&g_sampling, true);
+
+    if (pthread_create(&g_sampler, NULL, sampler, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start the benchmark sampler\n");
+        atomic_store(&g_sampling, false);
+        return false;
+    }
+
+    wallStartNs    = clockNs(CLOCK_MONOTONIC);
+    threadStartNs  = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    processStartNs = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+
+    return true;
+}
+
+void benchReport(const char *pRomPath, uint64_t cycles, uint64_t instructions)
+{
+    double wall = (double)(clockNs(CLOCK_MONOTONIC) - wallStartNs) / 1e9;
+    double thread = (double)(clockNs(CLOCK_THREAD_CPUTIME_ID) - threadStartNs) / 1e9;
+    double process = (double)(clockNs(CLOCK_PROCESS_CPUTIME_ID) - processStartNs) / 1e9;
+
+    atomic_store(&g_sampling, false);
+    pthread_join(g_sampler, NULL);
+
+    // the sampler's own time is not the workers'
+    double         workers = process - thread - ((double)g_samplerCpuNs / 1e9);
+    double         emulated = (double)cycles / CLOCK_HZ;
+    uint64_t       total = 0;
+    SRenderStats_t render;
+
+    renderGetStats(&render);
+
+    for (int i = 0; i < BENCH_SECTION_COUNT; i++)
+    {
+        total += g_samples[i];
+    }
+
+    printf("rom          %s\n", pRomPath);
+    printf("frames       %.0f (%.2f s emulated)\n", (double)cycles / FRAME_CYCLES, emulated);
+    printf("wall         %.3f s, emulation thread %.3f s CPU, workers %.3f s CPU\n", wall, thread, (workers > 0.0) ? workers : 0.0);
+    printf("fps          %.1f, %llu frames drawn\n", ((double)cycles / FRAME_CYCLES) / wall,
+           (unsigned long long)render.framesPublished);
+    printf("mips         %.2f\n", ((double)instructions / wall) / 1e6);
+    printf("speed        %.1f %%\n", 100.0 * emulated / wall);
+    printf("split       ");
+
+    for (int i = 0; i < BENCH_SECTION_COUNT; i++)
+    {
+        printf(" %s %.1f %%", g_sectionNames[i], total ? (100.0 * (double)g_samples[i] / (double)total) : 0.0);
+    }
+
+    printf("  (%llu samples)\n", (unsigned long long)total);
+    printf("config       synthesis %s, deferred sound %s\n", sndSynthesisEnabled() ? "on" : "off", sndDeferred() ? "on" : "off");
+}
@@ -0,0 +1,52 @@
+/**
+ * @file bench.h
+ * @author Toesoe
+ * @brief seaboy throughput benchmark
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the main loop marks which subsystem it is in; while a benchmark runs, a sampler thread
+ * reads the mark every BENCH_SAMPLE_NS. timing every call instead would cost more than some of
+ * the calls themselves.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define BENCH_SAMPLE_NS       20000
+#define BENCH_DEFAULT_FRAMES  3600 // a minute of emulated time
+
+typedef enum
+{
+    BENCH_CPU,   // interrupts, the instruction, timers
+    BENCH_PPU,
+    BENCH_APU,
+    BENCH_OTHER, // joypad, movie, pacing, the loop itself
+    BENCH_SECTION_COUNT
+} EBenchSection_t;
+
+extern atomic_uchar g_benchSection;
+
+static inline void benchEnter(EBenchSection_t section)
+{
+    atomic_store_explicit(&g_benchSection, (unsigned char)section, memory_order_relaxed);
+}
+
+/**
+ * @brief start the clocks and the sampler, from the emulation thread
+ */
+bool benchStart(void);
+
+/**
+ * @brief stop the sampler and print the report for the T-cycles and instructions run since
+ *        benchStart()
+ */
+void benchReport(const char *, uint64_t, uint64_t);
+
+#endif //!_BENCH_H_
@@ -4,9 +4,209 @@
  * @brief seaboy sound driver
  * @version 0.1
  * @date 2023-06-13
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
  */
 
-// TODO: implement SDL for audio playback
\ No newline at end of file
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "audio.h"
+
+#define RING_MASK (AUDIO_RING_FRAMES - 1)
+
+static const SAudioDriver_t *g_pDriver = NULL; // NULL: the build's default driver
+static bool     g_running = false;
+static uint8_t  g_channels = AUDIO_MAX_CHANNELS;
+static uint32_t g_sampleRate = 0;
+
+// single producer (the emulation thread), single consumer (the driver's audio thread).
+// positions count frames and only grow; each side only stores its own
+static int16_t g_ring[AUDIO_RING_FRAMES * AUDIO_MAX_CHANNELS];
+static _Alignas(64) atomic_uint g_writePos = 0;
+static _Alignas(64) atomic_uint g_readPos = 0;
+
+// producer only
+static double g_rateRatio = 1.0;
+
+// consumer only
+static int16_t g_lastFrame[AUDIO_MAX_CHANNELS];
+static bool    g_primed = false; // the ring reached its target fill once; until then, silence is no underrun
+
+static _Atomic uint64_t g_underruns;
+static _Atomic uint64_t g_underrunFrames;
+static _Atomic uint64_t g_overruns;
+static _Atomic uint64_t g_overrunFrames;
+
+static void resetRing(void)
+{
+    atomic_store(&g_writePos, 0);
+    atomic_store(&g_readPos, 0);
+    atomic_store(&g_underruns, 0);
+    atomic_store(&g_underrunFrames, 0);
+    atomic_store(&g_overruns, 0);
+    atomic_store(&g_overrunFrames, 0);
+    memset(g_lastFrame, 0, sizeof(g_lastFrame));
+    g_rateRatio = 1.0;
+    g_primed    = false;
+}
+
+static void pushRing(const int16_t *pSamples, size_t frames)
+{
+    unsigned int write = atomic_load_explicit(&g_writePos, memory_order_relaxed);
+    unsigned int fill = write - atomic_load_explicit(&g_readPos, memory_order_acquire);
+    size_t       space = AUDIO_RING_FRAMES - fill;
+
+    if (frames > space)
+    {
+        // drop the newest frames: the ones already queued are about to be played
+        atomic_fetch_add_explicit(&g_overruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_overrunFrames, frames - space, memory_order_relaxed);
+        frames = space;
+    }
+
+    size_t start = write & RING_MASK;
+    size_t first = ((start + frames) > AUDIO_RING_FRAMES) ? (AUDIO_RING_FRAMES - start) : frames;
+
+    memcpy(&g_ring[start * g_channels], pSamples, first * g_channels * sizeof(int16_t));
+    memcpy(g_ring, &pSamples[first * g_channels], (frames - first) * g_channels * sizeof(int16_t));
+
+    atomic_store_explicit(&g_writePos, write + (unsigned int)frames, memory_order_release);
+
+    // proportional control on the fill just before a push, the lowest it gets:
+    // a full ring slows production down, an empty one speeds it up
+    double error = ((double)AUDIO_TARGET_FRAMES - (double)fill) / AUDIO_TARGET_FRAMES;
+
+    error       = (error > 1.0) ? 1.0 : ((error < -1.0) ? -1.0 : error);
+    g_rateRatio = 1.0 + (AUDIO_MAX_RATE_DELTA * error);
+}
+
+void audioSetDriver(const SAudioDriver_t *pDriver)
+{
+    g_pDriver = pDriver;
+}
+
+bool audioStart(uint32_t sampleRate, uint8_t channels)
+{
+    if (!g_pDriver)
+    {
+#ifdef SEABOY_HEADLESS
+        g_pDriver = pGetNullAudioDriver();
+#else
+        g_pDriver = pGetSdlAudioDriver();
+#endif
+    }
+
+    g_channels   = (channels > AUDIO_MAX_CHANNELS) ? AUDIO_MAX_CHANNELS : channels;
+    g_sampleRate = sampleRate;
+    resetRing();
+
+    g_running = g_pDriver->pfnStart(sampleRate, g_channels);
+
+    if (!g_running && (g_pDriver != pGetNullAudioDriver()))
+    {
+        // no sound is no reason to stop emulating
+        fprintf(stderr, "cannot start %s audio driver, continuing without sound\n", g_pDriver->pName);
+        g_pDriver = pGetNullAudioDriver();
+        g_running = g_pDriver->pfnStart(sampleRate, g_channels);
+    }
+
+    if (!g_running)
+    {
+        fprintf(stderr, "cannot start %s audio driver\n", g_pDriver->pName);
+    }
+
+    return g_running;
+}
+
+void audioStop(void)
+{
+    if (g_running)
+    {
+        g_pDriver->pfnStop();
+        g_running = false;
+    }
+}
+
+void audioQueue(const int16_t *pSamples, size_t frames)
+{
+    if (!g_running)
+    {
+        return;
+    }
+
+    if (g_pDriver->pfnQueue)
+    {
+        g_pDriver->pfnQueue(pSamples, frames);
+    }
+    else
+    {
+        pushRing(pSamples, frames);
+    }
+}
+
+void audioRead(int16_t *pOut, size_t frames)
+{
+    unsigned int read = atomic_load_explicit(&g_readPos, memory_order_relaxed);
+    size_t       avail = atomic_load_explicit(&g_writePos, memory_order_acquire) - read;
+
+    if (!g_primed && (avail < AUDIO_TARGET_FRAMES))
+    {
+        memset(pOut, 0, frames * g_channels * sizeof(int16_t));
+        return;
+    }
+
+    g_primed = true;
+
+    size_t take = (avail < frames) ? avail : frames;
+    size_t start = read & RING_MASK;
+    size_t first = ((start + take) > AUDIO_RING_FRAMES) ? (AUDIO_RING_FRAMES - start) : take;
+
+    memcpy(pOut, &g_ring[start * g_channels], first * g_channels * sizeof(int16_t));
+    memcpy(&pOut[first * g_channels], g_ring, (take - first) * g_channels * sizeof(int16_t));
+
+    atomic_store_explicit(&g_readPos, read + (unsigned int)take, memory_order_release);
+
+    if (take > 0)
+    {
+        memcpy(g_lastFrame, &pOut[(take - 1) * g_channels], g_channels * sizeof(int16_t));
+    }
+
+    if (take < frames)
+    {
+        // hold the last frame rather than dropping to zero, which would click
+        atomic_fetch_add_explicit(&g_underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_underrunFrames, frames - take, memory_order_relaxed);
+
+        for (size_t i = take; i < frames; i++)
+        {
+            memcpy(&pOut[i * g_channels], g_lastFrame, g_channels * sizeof(int16_t));
+        }
+    }
+}
+
+double audioGetRateRatio(void)
+{
+    return g_rateRatio;
+}
+
+bool audioGetRingLevel(uint32_t *pFill, uint32_t *pRate)
+{
+    *pFill = atomic_load_explicit(&g_writePos, memory_order_relaxed) - atomic_load_explicit(&g_readPos, memory_order_acquire);
+    *pRate = g_sampleRate;
+
+    return g_running && !g_pDriver->pfnQueue && (g_sampleRate > 0);
+}
+
+void audioGetStats(SAudioStats_t *pStats)
+{
+    pStats->underruns      = atomic_load_explicit(&g_underruns, memory_order_relaxed);
+    pStats->underrunFrames = atomic_load_explicit(&g_underrunFrames, memory_order_relaxed);
+    pStats->overruns       = atomic_load_explicit(&g_overruns, memory_order_relaxed);
+    pStats->overrunFrames  = atomic_load_explicit(&g_overrunFrames, memory_order_relaxed);
+    pStats->fill           = atomic_load_explicit(&g_writePos, memory_order_relaxed) -
+                             atomic_load_explicit(&g_readPos, memory_order_relaxed);
+    pStats->rateRatio      = g_rateRatio;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file audio.h
+ * @author Toesoe
+ * @brief seaboy sound driver
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+
+#define AUDIO_RING_FRAMES     8192  // power of two
+#define AUDIO_TARGET_FRAMES   2048  // fill the rate control steers towards, ~43 ms at 48 kHz
+#define AUDIO_MAX_RATE_DELTA  0.005 // rate control stays within +-0.5% of the nominal rate
+#define AUDIO_MAX_CHANNELS    2
+
+typedef struct
+{
+    uint64_t underruns;     // reads the ring could not satisfy
+    uint64_t underrunFrames;
+    uint64_t overruns;      // queues that did not fit
+    uint64_t overrunFrames; // frames dropped
+    uint32_t fill;          // frames in the ring
+    double   rateRatio;     // last ratio handed to the producer
+} SAudioStats_t;
+
+void audioSetDriver(const SAudioDriver_t *);
+bool audioStart(uint32_t, uint8_t);
+void audioStop(void);
+
+/**
+ * @brief hand interleaved sample frames to the driver, or to the ring for drivers that pull.
+ *        only from the thread that synthesizes: the emulation thread, or the APU's worker
+ *        with deferred synthesis
+ */
+void audioQueue(const int16_t *, size_t);
+
+/**
+ * @brief take up to frames sample frames from the ring; what is missing is filled with the last
+ *        frame read and counted as an underrun. the pulling driver's audio thread only
+ */
+void audioRead(int16_t *, size_t);
+
+/**
+ * @brief how much faster than nominal to produce samples, 1 +- AUDIO_MAX_RATE_DELTA, steering
+ *        the ring towards AUDIO_TARGET_FRAMES. always 1 for drivers that do not pull
+ */
+double audioGetRateRatio(void);
+
+/**
+ * @brief frames in the ring and the rate the driver drains it at, to pace on the audio clock
+ * @return false if the driver does not pull from the ring
+ */
+bool audioGetRingLevel(uint32_t *, uint32_t *);
+
+/**
+ * @brief counters and ring fill. from the thread that synthesizes, which owns the rate ratio,
+ *        or after sndFlush
+ */
+void audioGetStats(SAudioStats_t *);
+
+#endif //!_AUDIO_H_
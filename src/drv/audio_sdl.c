@@ -0,0 +1,83 @@
+/**
+ * @file audio_sdl.c
+ * @author Toesoe
+ * @brief seaboy SDL audio driver
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+
+#include "SDL2/SDL.h"
+
+#include "audio.h"
+#include "driver.h"
+
+#define DEVICE_FRAMES 512 // frames per callback, ~11 ms at 48 kHz
+
+static SDL_AudioDeviceID g_device = 0;
+static uint8_t           g_channels = 0;
+
+/**
+ * @brief runs on SDL's audio thread. only touches the ring, never a lock shared with emulation
+ */
+static void audioCallback(void *pUser, Uint8 *pStream, int len)
+{
+    (void)pUser;
+    audioRead((int16_t *)pStream, (size_t)len / (g_channels * sizeof(int16_t)));
+}
+
+static bool sdlAudioStart(uint32_t sampleRate, uint8_t channels)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+    {
+        fprintf(stderr, "SDL audio init failed: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // no allowed changes: SDL converts whatever the device wants, so the ring format never moves
+    SDL_AudioSpec want = { 0 };
+    SDL_AudioSpec have;
+
+    want.freq     = (int)sampleRate;
+    want.format   = AUDIO_S16SYS;
+    want.channels = channels;
+    want.samples  = DEVICE_FRAMES;
+    want.callback = audioCallback;
+    g_channels    = channels;
+
+    g_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+
+    if (g_device == 0)
+    {
+        fprintf(stderr, "cannot open audio device: %s\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+
+    SDL_PauseAudioDevice(g_device, 0);
+
+    return true;
+}
+
+static void sdlAudioStop(void)
+{
+    if (g_device != 0)
+    {
+        SDL_CloseAudioDevice(g_device);
+        g_device = 0;
+    }
+
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+// no pfnQueue: the callback pulls from the ring in audio.c
+static const SAudioDriver_t g_sdlAudioDriver = { "sdl", sdlAudioStart, sdlAudioStop, NULL };
+
+const SAudioDriver_t *pGetSdlAudioDriver(void)
+{
+    return &g_sdlAudioDriver;
+}
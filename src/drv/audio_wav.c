@@ -0,0 +1,281 @@
+/**
+ * @file audio_wav.c
+ * @author Toesoe
+ * @brief seaboy audio capture driver: WAV or raw PCM to a file or stdout
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the producer only copies into a ring; a writer thread does all the file I/O, so a slow disk or
+ * a stalled pipe costs dropped frames, never emulation time. samples go out in host byte order,
+ * which is the s16le the format asks for on every host seaboy runs on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+#include "audio_wav.h"
+#include "audio.h"
+
+#define RING_MASK (WAV_RING_FRAMES - 1)
+
+#define WAV_HEADER_BYTES   44
+#define WAV_UNKNOWN_SIZE   0xFFFFFFFFu
+#define WRITE_BUFFER_BYTES (1 << 20)
+
+static const char  *g_pPath = NULL;
+static EWavFormat_t g_format = WAV_RIFF;
+static FILE        *g_pFile = NULL;
+static char        *g_pWriteBuffer = NULL;
+static uint32_t     g_sampleRate = 0;
+static uint8_t      g_channels = 0;
+static bool         g_active = false;
+
+// single producer (whichever thread synthesizes), single consumer (the writer thread).
+// positions count frames and only grow; each side only stores its own
+static int16_t     g_ring[WAV_RING_FRAMES * AUDIO_MAX_CHANNELS];
+static atomic_uint g_head = 0;
+static atomic_uint g_tail = 0;
+static sem_t       g_filled;
+static pthread_t   g_writer;
+static atomic_bool g_stopping = false;
+static bool        g_failed = false; // writer thread only: the output went away, keep draining quietly
+
+static _Atomic uint64_t g_framesQueued;
+static _Atomic uint64_t g_framesWritten;
+static _Atomic uint64_t g_framesDropped;
+static _Atomic uint64_t g_bytesWritten;
+
+static inline void putU16(uint8_t *pDst, uint16_t val)
+{
+    pDst[0] = (uint8_t)val;
+    pDst[1] = (uint8_t)(val >> 8);
+}
+
+static inline void putU32(uint8_t *pDst, uint32_t val)
+{
+    putU16(pDst, (uint16_t)val);
+    putU16(&pDst[2], (uint16_t)(val >> 16));
+}
+
+static bool writeHeader(uint32_t dataBytes)
+{
+    uint8_t  header[WAV_HEADER_BYTES];
+    uint16_t frameBytes = (uint16_t)(g_channels * sizeof(int16_t));
+
+    memcpy(header, "RIFF", 4);
+    putU32(&header[4], (dataBytes == WAV_UNKNOWN_SIZE) ? WAV_UNKNOWN_SIZE : (dataBytes + WAV_HEADER_BYTES - 8));
+    memcpy(&header[8], "WAVEfmt ", 8);
+    putU32(&header[16], 16);        // fmt chunk size
+    putU16(&header[20], 1);         // PCM
+    putU16(&header[22], g_channels);
+    putU32(&header[24], g_sampleRate);
+    putU32(&header[28], g_sampleRate * frameBytes);
+    putU16(&header[32], frameBytes);
+    putU16(&header[34], 16);        // bits per sample
+    memcpy(&header[36], "data", 4);
+    putU32(&header[40], dataBytes);
+
+    return fwrite(header, sizeof(header), 1, g_pFile) == 1;
+}
+
+static void *wavWriter(void *pArg)
+{
+    (void)pArg;
+
+    for (;;)
+    {
+        while ((sem_wait(&g_filled) == -1) && (errno == EINTR));
+
+        unsigned int tail = atomic_load_explicit(&g_tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&g_head, memory_order_acquire);
+
+        while (tail != head)
+        {
+            size_t start = tail & RING_MASK;
+            size_t count = head - tail;
+
+            if ((start + count) > WAV_RING_FRAMES)
+            {
+                count = WAV_RING_FRAMES - start;
+            }
+
+            if (!g_failed && (fwrite(&g_ring[start * g_channels], g_channels * sizeof(int16_t), count, g_pFile) != count))
+            {
+                fprintf(stderr, "audio capture: write failed: %s\n", strerror(errno));
+                g_failed = true;
+            }
+
+            tail += (unsigned int)count;
+            atomic_store_explicit(&g_tail, tail, memory_order_release);
+
+            if (!g_failed)
+            {
+                atomic_fetch_add_explicit(&g_framesWritten, count, memory_order_relaxed);
+                atomic_fetch_add_explicit(&g_bytesWritten, count * g_channels * sizeof(int16_t), memory_order_relaxed);
+            }
+
+            head = atomic_load_explicit(&g_head, memory_order_acquire);
+        }
+
+        if (atomic_load(&g_stopping))
+        {
+            return NULL;
+        }
+    }
+}
+
+static void closeOutput(void)
+{
+    if (g_pFile == stdout)
+    {
+        fflush(stdout);
+    }
+    else
+    {
+        fclose(g_pFile);
+    }
+
+    free(g_pWriteBuffer);
+    g_pFile        = NULL;
+    g_pWriteBuffer = NULL;
+}
+
+static bool wavStart(uint32_t sampleRate, uint8_t channels)
+{
+    if (!g_pPath)
+    {
+        fprintf(stderr, "audio capture: no output given\n");
+        return false;
+    }
+
+    if (strcmp(g_pPath, "-") == 0)
+    {
+        g_pFile = stdout;
+    }
+    else
+    {
+        g_pFile = fopen(g_pPath, "wb");
+
+        if (!g_pFile)
+        {
+            fprintf(stderr, "cannot open %s for audio capture: %s\n", g_pPath, strerror(errno));
+            return false;
+        }
+
+        g_pWriteBuffer = malloc(WRITE_BUFFER_BYTES);
+
+        if (g_pWriteBuffer)
+        {
+            setvbuf(g_pFile, g_pWriteBuffer, _IOFBF, WRITE_BUFFER_BYTES);
+        }
+    }
+
+    g_sampleRate = sampleRate;
+    g_channels   = channels;
+    g_failed     = false;
+
+    // sizes are patched in on stop where the output can seek
+    if ((g_format == WAV_RIFF) && !writeHeader(WAV_UNKNOWN_SIZE))
+    {
+        fprintf(stderr, "cannot write WAV header to %s\n", g_pPath);
+        closeOutput();
+        return false;
+    }
+
+    atomic_store(&g_head, 0);
+    atomic_store(&g_tail, 0);
+    atomic_store(&g_stopping, false);
+    atomic_store(&g_framesQueued, 0);
+    atomic_store(&g_framesWritten, 0);
+    atomic_store(&g_framesDropped, 0);
+    atomic_store(&g_bytesWritten, (g_format == WAV_RIFF) ? WAV_HEADER_BYTES : 0);
+
+    sem_init(&g_filled, 0, 0);
+
+    if (pthread_create(&g_writer, NULL, wavWriter, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start audio capture thread\n");
+        sem_destroy(&g_filled);
+        closeOutput();
+        return false;
+    }
+
+    g_active = true;
+
+    return true;
+}
+
+static void wavStop(void)
+{
+    if (!g_active)
+    {
+        return;
+    }
+
+    atomic_store(&g_stopping, true);
+    sem_post(&g_filled);
+    pthread_join(g_writer, NULL);
+    sem_destroy(&g_filled);
+
+    if ((g_format == WAV_RIFF) && !g_failed && (fseek(g_pFile, 0, SEEK_SET) == 0))
+    {
+        uint64_t dataBytes = atomic_load(&g_bytesWritten) - WAV_HEADER_BYTES;
+
+        // past 4 GiB the sizes cannot be told; leave them open-ended as for a pipe
+        writeHeader((dataBytes > (WAV_UNKNOWN_SIZE - WAV_HEADER_BYTES)) ? WAV_UNKNOWN_SIZE : (uint32_t)dataBytes);
+    }
+
+    closeOutput();
+    g_active = false;
+}
+
+/**
+ * @brief never waits: what does not fit in the ring is dropped and counted
+ */
+static void wavQueue(const int16_t *pSamples, size_t frames)
+{
+    unsigned int head = atomic_load_explicit(&g_head, memory_order_relaxed);
+    size_t       space = WAV_RING_FRAMES - (head - atomic_load_explicit(&g_tail, memory_order_acquire));
+
+    atomic_fetch_add_explicit(&g_framesQueued, frames, memory_order_relaxed);
+
+    if (frames > space)
+    {
+        atomic_fetch_add_explicit(&g_framesDropped, frames - space, memory_order_relaxed);
+        frames = space;
+    }
+
+    size_t start = head & RING_MASK;
+    size_t first = ((start + frames) > WAV_RING_FRAMES) ? (WAV_RING_FRAMES - start) : frames;
+
+    memcpy(&g_ring[start * g_channels], pSamples, first * g_channels * sizeof(int16_t));
+    memcpy(g_ring, &pSamples[first * g_channels], (frames - first) * g_channels * sizeof(int16_t));
+
+    atomic_store_explicit(&g_head, head + (unsigned int)frames, memory_order_release);
+    sem_post(&g_filled);
+}
+
+static const SAudioDriver_t g_wavAudioDriver = { "wav", wavStart, wavStop, wavQueue };
+
+const SAudioDriver_t *pGetWavAudioDriver(const char *pPath, EWavFormat_t format)
+{
+    g_pPath  = pPath;
+    g_format = format;
+
+    return &g_wavAudioDriver;
+}
+
+void wavGetStats(SWavStats_t *pStats)
+{
+    pStats->framesQueued  = atomic_load_explicit(&g_framesQueued, memory_order_relaxed);
+    pStats->framesWritten = atomic_load_explicit(&g_framesWritten, memory_order_relaxed);
+    pStats->framesDropped = atomic_load_explicit(&g_framesDropped, memory_order_relaxed);
+    pStats->bytesWritten  = atomic_load_explicit(&g_bytesWritten, memory_order_relaxed);
+}
@@ -0,0 +1,48 @@
+/**
+ * @file audio_wav.h
+ * @author Toesoe
+ * @brief seaboy audio capture driver: WAV or raw PCM to a file or stdout
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * WAV is a 44-byte RIFF header, 16-bit PCM, then the samples. when the output cannot seek, a pipe
+ * for instance, the RIFF and data sizes stay 0xFFFFFFFF, which readers take as "until the end".
+ * raw PCM is the samples alone: s16le, interleaved, at the rate given to audioStart().
+ */
+
+#ifndef _AUDIO_WAV_H_
+#define _AUDIO_WAV_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+
+#define WAV_RING_FRAMES (1 << 18) // power of two, ~5 s at 48 kHz
+
+typedef enum
+{
+    WAV_RIFF, // RIFF WAVE, 16-bit PCM
+    WAV_RAW   // headerless s16le
+} EWavFormat_t;
+
+typedef struct
+{
+    uint64_t framesQueued;
+    uint64_t framesWritten;
+    uint64_t framesDropped; // the ring was full: the writer fell more than WAV_RING_FRAMES behind
+    uint64_t bytesWritten;
+} SWavStats_t;
+
+/**
+ * @brief the capture driver, writing to pPath, or to stdout for "-". pPath must stay valid until
+ *        the driver is stopped. hand it to audioSetDriver() before audioStart()
+ */
+const SAudioDriver_t *pGetWavAudioDriver(const char *, EWavFormat_t);
+
+void wavGetStats(SWavStats_t *);
+
+#endif //!_AUDIO_WAV_H_
@@ -0,0 +1,413 @@
+/**
+ * @file cputrace.c
+ * @author Toesoe
+ * @brief seaboy instruction trace: compact binary record of every executed instruction
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the writer runs on the emulation thread and fills a buffer that goes out in one fwrite per
+ * 64 KiB; entries are small enough that the file keeps up with a turbo run.
+ */
+
+#include <string.h>
+
+#include "cputrace.h"
+
+#define OUT_BUFFER  (1 << 16)
+#define ENTRY_MAX   32 // flags, PC, mask + 8 registers, SP, a 10-byte varint, mask + 4 bytes
+#define NOT_TRACED  0x100
+
+#define PC_STEP_MASK   0x03
+#define HAS_REGS       0x04
+#define HAS_SP         0x08
+#define HAS_DISTANCE   0x10
+#define HAS_MEM        0x20
+#define RESERVED       0x40
+#define END_OF_TRACE   0x80
+
+bool g_cputraceOn = false;
+
+static FILE            *g_pFile = NULL;
+static uint8_t          g_out[OUT_BUFFER];
+static size_t           g_outLen = 0;
+static bool             g_first = true;
+static SCpuTraceEntry_t g_last;
+static uint64_t         g_distance = 0;
+static uint16_t         g_shadow[0x10000]; // what the trace last said each byte was, or NOT_TRACED
+static uint64_t         g_entries = 0;
+static uint64_t         g_bytes = 0;
+
+static inline void putU16(uint8_t *pDst, uint16_t val)
+{
+    pDst[0] = (uint8_t)val;
+    pDst[1] = (uint8_t)(val >> 8);
+}
+
+static inline uint8_t *pPutVarint(uint8_t *pDst, uint64_t val)
+{
+    while (val >= 0x80)
+    {
+        *pDst++ = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+
+    *pDst++ = (uint8_t)val;
+    return pDst;
+}
+
+static void flushOut(void)
+{
+    if ((g_outLen > 0) && (fwrite(g_out, 1, g_outLen, g_pFile) != g_outLen))
+    {
+        fprintf(stderr, "cannot write cpu trace, stopping it\n");
+        g_cputraceOn = false;
+    }
+
+    g_bytes += g_outLen;
+    g_outLen = 0;
+}
+
+static void capture(const cpu_t *pCpu, const uint8_t *pBus, SCpuTraceEntry_t *pEntry)
+{
+    pEntry->pc      = pCpu->reg16.pc;
+    pEntry->sp      = pCpu->reg16.sp;
+    pEntry->regs[0] = pCpu->reg8.a;
+    pEntry->regs[1] = pCpu->reg8.f;
+    pEntry->regs[2] = pCpu->reg8.b;
+    pEntry->regs[3] = pCpu->reg8.c;
+    pEntry->regs[4] = pCpu->reg8.d;
+    pEntry->regs[5] = pCpu->reg8.e;
+    pEntry->regs[6] = pCpu->reg8.h;
+    pEntry->regs[7] = pCpu->reg8.l;
+
+    for (uint16_t i = 0; i < 4; i++)
+    {
+        pEntry->mem[i] = pBus[(uint16_t)(pEntry->pc + i)];
+    }
+}
+
+bool cputraceOpen(const char *pPath, uint16_t flags)
+{
+    cputraceClose();
+
+    g_pFile = fopen(pPath, "wb");
+
+    if (!g_pFile)
+    {
+        fprintf(stderr, "cannot open cpu trace %s\n", pPath);
+        return false;
+    }
+
+    memcpy(g_out, CPUTRACE_MAGIC, 4);
+    putU16(&g_out[4], CPUTRACE_VERSION);
+    putU16(&g_out[6], flags);
+    memset(&g_out[8], 0, 8);
+
+    g_outLen   = 16;
+    g_first    = true;
+    g_distance = 0;
+    g_entries  = 0;
+    g_bytes    = 0;
+    memset(&g_last, 0, sizeof(g_last));
+
+    for (size_t i = 0; i < 0x10000; i++)
+    {
+        g_shadow[i] = NOT_TRACED;
+    }
+
+    g_cputraceOn = true;
+    return true;
+}
+
+void cputraceClose(void)
+{
+    if (!g_pFile)
+    {
+        return;
+    }
+
+    if (g_cputraceOn)
+    {
+        g_out[g_outLen++] = END_OF_TRACE;
+        flushOut();
+    }
+
+    g_cputraceOn = false;
+    fclose(g_pFile);
+    g_pFile = NULL;
+}
+
+void cputraceRecord(uint64_t cycle, const cpu_t *pCpu, const uint8_t *pBus)
+{
+    SCpuTraceEntry_t entry;
+
+    capture(pCpu, pBus, &entry);
+    entry.cycle = cycle;
+
+    uint8_t *pFlags = &g_out[g_outLen];
+    uint8_t *pOut = pFlags + 1;
+    uint8_t  flags = 0;
+    uint16_t step = (uint16_t)(entry.pc - g_last.pc);
+
+    if (!g_first && (step >= 1) && (step <= 3))
+    {
+        flags |= (uint8_t)step;
+    }
+    else
+    {
+        putU16(pOut, entry.pc);
+        pOut += 2;
+    }
+
+    uint8_t regMask = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        regMask |= (g_first || (entry.regs[i] != g_last.regs[i])) ? (uint8_t)(1 << i) : 0;
+    }
+
+    if (regMask)
+    {
+        flags |= HAS_REGS;
+        *pOut++ = regMask;
+
+        for (int i = 0; i < 8; i++)
+        {
+            if (regMask & (1 << i))
+            {
+                *pOut++ = entry.regs[i];
+            }
+        }
+    }
+
+    if (g_first || (entry.sp != g_last.sp))
+    {
+        flags |= HAS_SP;
+        putU16(pOut, entry.sp);
+        pOut += 2;
+    }
+
+    // a loaded state can move the clock back; the distance then wraps, and so does the reader's sum
+    uint64_t distance = (cycle - g_last.cycle) >> 2;
+
+    if (g_first || (distance != g_distance))
+    {
+        flags |= HAS_DISTANCE;
+        pOut = pPutVarint(pOut, distance);
+        g_distance = distance;
+    }
+
+    uint8_t *pMemMask = pOut;
+    uint8_t  memMask = 0;
+
+    pOut++;
+
+    for (uint16_t i = 0; i < 4; i++)
+    {
+        uint16_t addr = (uint16_t)(entry.pc + i);
+
+        if (g_shadow[addr] != entry.mem[i])
+        {
+            memMask |= (uint8_t)(1 << i);
+            g_shadow[addr] = entry.mem[i];
+            *pOut++ = entry.mem[i];
+        }
+    }
+
+    if (memMask)
+    {
+        flags |= HAS_MEM;
+        *pMemMask = memMask;
+    }
+    else
+    {
+        pOut--;
+    }
+
+    *pFlags = flags;
+    g_outLen = (size_t)(pOut - g_out);
+    g_last = entry;
+    g_first = false;
+    g_entries++;
+
+    if (g_outLen > (OUT_BUFFER - ENTRY_MAX))
+    {
+        flushOut();
+    }
+}
+
+void cputraceGetStats(uint64_t *pEntries, uint64_t *pBytes)
+{
+    *pEntries = g_entries;
+    *pBytes   = g_bytes + g_outLen;
+}
+
+static bool readBytes(SCpuTraceReader_t *pReader, uint8_t *pDst, size_t len)
+{
+    return fread(pDst, 1, len, pReader->pFile) == len;
+}
+
+static bool readU16(SCpuTraceReader_t *pReader, uint16_t *pVal)
+{
+    uint8_t bytes[2];
+
+    if (!readBytes(pReader, bytes, 2))
+    {
+        return false;
+    }
+
+    *pVal = (uint16_t)(bytes[0] | (bytes[1] << 8));
+    return true;
+}
+
+static bool readVarint(SCpuTraceReader_t *pReader, uint64_t *pVal)
+{
+    uint64_t val = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = fgetc(pReader->pFile);
+
+        if (byte == EOF)
+        {
+            return false;
+        }
+
+        val |= (uint64_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *pVal = val;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool cputraceReaderOpen(SCpuTraceReader_t *pReader, const char *pPath)
+{
+    uint8_t header[16];
+
+    memset(pReader, 0, sizeof(SCpuTraceReader_t));
+    pReader->pFile = fopen(pPath, "rb");
+
+    if (!pReader->pFile)
+    {
+        fprintf(stderr, "cannot open %s\n", pPath);
+        return false;
+    }
+
+    if (!readBytes(pReader, header, sizeof(header)) || (memcmp(header, CPUTRACE_MAGIC, 4) != 0) ||
+        ((header[4] | (header[5] << 8)) != CPUTRACE_VERSION))
+    {
+        fprintf(stderr, "%s is not a version %d cpu trace\n", pPath, CPUTRACE_VERSION);
+        fclose(pReader->pFile);
+        pReader->pFile = NULL;
+        return false;
+    }
+
+    pReader->flags = (uint16_t)(header[6] | (header[7] << 8));
+    return true;
+}
+
+ECpuTraceRead_t cputraceRead(SCpuTraceReader_t *pReader, SCpuTraceEntry_t *pEntry)
+{
+    int flags = fgetc(pReader->pFile);
+
+    if ((flags == EOF) || (flags == END_OF_TRACE))
+    {
+        // a run that was killed leaves no end marker; the last whole entry is still good
+        return CPUTRACE_END;
+    }
+
+    if (flags & (RESERVED | END_OF_TRACE))
+    {
+        return CPUTRACE_ERROR;
+    }
+
+    SCpuTraceEntry_t entry = pReader->last;
+    bool             ok = true;
+
+    if (flags & PC_STEP_MASK)
+    {
+        entry.pc = (uint16_t)(entry.pc + (flags & PC_STEP_MASK));
+    }
+    else
+    {
+        ok = readU16(pReader, &entry.pc);
+    }
+
+    if (ok && (flags & HAS_REGS))
+    {
+        uint8_t regMask = 0;
+
+        ok = readBytes(pReader, &regMask, 1);
+
+        for (int i = 0; ok && (i < 8); i++)
+        {
+            ok = !(regMask & (1 << i)) || readBytes(pReader, &entry.regs[i], 1);
+        }
+    }
+
+    if (ok && (flags & HAS_SP))
+    {
+        ok = readU16(pReader, &entry.sp);
+    }
+
+    if (ok && (flags & HAS_DISTANCE))
+    {
+        ok = readVarint(pReader, &pReader->distance);
+    }
+
+    entry.cycle += pReader->distance << 2;
+
+    if (ok && (flags & HAS_MEM))
+    {
+        uint8_t memMask = 0;
+
+        ok = readBytes(pReader, &memMask, 1);
+
+        for (uint16_t i = 0; ok && (i < 4); i++)
+        {
+            uint16_t addr = (uint16_t)(entry.pc + i);
+
+            ok = !(memMask & (1 << i)) || readBytes(pReader, &pReader->shadow[addr], 1);
+        }
+    }
+
+    if (!ok)
+    {
+        return CPUTRACE_ERROR;
+    }
+
+    for (uint16_t i = 0; i < 4; i++)
+    {
+        entry.mem[i] = pReader->shadow[(uint16_t)(entry.pc + i)];
+    }
+
+    pReader->last = entry;
+    pReader->entries++;
+    *pEntry = entry;
+
+    return CPUTRACE_ENTRY;
+}
+
+void cputraceReaderClose(SCpuTraceReader_t *pReader)
+{
+    if (pReader->pFile)
+    {
+        fclose(pReader->pFile);
+        pReader->pFile = NULL;
+    }
+}
+
+void cputraceFormat(const SCpuTraceEntry_t *pEntry, char *pDst, size_t len)
+{
+    snprintf(pDst, len, "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X",
+             pEntry->regs[0], pEntry->regs[1], pEntry->regs[2], pEntry->regs[3], pEntry->regs[4], pEntry->regs[5],
+             pEntry->regs[6], pEntry->regs[7], pEntry->sp, pEntry->pc, pEntry->mem[0], pEntry->mem[1], pEntry->mem[2],
+             pEntry->mem[3]);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file cputrace.h
+ * @author Toesoe
+ * @brief seaboy instruction trace: compact binary record of every executed instruction
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * one entry per instruction, taken just before it executes: the registers, the 4 bytes at PC and
+ * the T-cycle, the same state a Gameboy Doctor log line holds. each entry only stores what changed
+ * since the one before, 2-4 bytes for most instructions. bytes at PC are compared to what the trace
+ * last said they were, so code that stays put is stored once.
+ *
+ * file format, little endian:
+ *   header: "SBCT", u16 version, u16 flags (bit 0: LY read as 0x90), u64 0
+ *   entries, each a flags byte, then the fields it announces in this order:
+ *     bits 0-1  0: u16 PC follows, 1-3: PC is the previous PC + 1-3
+ *     bit 2     u8 register mask (bit 0 A, F, B, C, D, E, H, bit 7 L), then each register set in it
+ *     bit 3     u16 SP
+ *     bit 4     varint: M-cycles since the previous entry, when different from the previous
+ *               distance; otherwise the same distance again
+ *     bit 5     u8 mask of the bytes at PC + 0-3 that changed, then each of those bytes
+ *     bit 6     0
+ *     bit 7     alone: the end of the trace
+ *   varints are 7 bits a byte, least significant first, high bit set on all but the last.
+ */
+
+#ifndef _CPUTRACE_H_
+#define _CPUTRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "../hw/cpu.h"
+
+#define CPUTRACE_MAGIC   "SBCT"
+#define CPUTRACE_VERSION 1
+
+#define CPUTRACE_FLAG_LY_STUB 0x0001
+
+typedef struct
+{
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t  regs[8]; // A F B C D E H L
+    uint8_t  mem[4];  // at PC
+} SCpuTraceEntry_t;
+
+typedef enum
+{
+    CPUTRACE_ENTRY,
+    CPUTRACE_END,
+    CPUTRACE_ERROR // truncated or not a trace
+} ECpuTraceRead_t;
+
+typedef struct
+{
+    FILE            *pFile;
+    uint16_t         flags;
+    SCpuTraceEntry_t last;
+    uint64_t         distance;
+    uint64_t         entries;
+    uint8_t          shadow[0x10000];
+} SCpuTraceReader_t;
+
+extern bool g_cputraceOn;
+
+/**
+ * @brief start tracing every instruction to pPath. pass CPUTRACE_FLAG_LY_STUB if LY reads are stubbed
+ */
+bool cputraceOpen(const char *, uint16_t);
+void cputraceClose(void);
+
+/**
+ * @brief the CPU is about to execute the instruction at PC, at a T-cycle. pBus is the 64 KiB bus
+ */
+void cputraceRecord(uint64_t, const cpu_t *, const uint8_t *);
+
+static inline void cputraceStep(uint64_t cycle, const cpu_t *pCpu, const uint8_t *pBus)
+{
+    if (g_cputraceOn)
+    {
+        cputraceRecord(cycle, pCpu, pBus);
+    }
+}
+
+/**
+ * @brief entries and bytes written since cputraceOpen()
+ */
+void cputraceGetStats(uint64_t *, uint64_t *);
+
+bool            cputraceReaderOpen(SCpuTraceReader_t *, const char *);
+ECpuTraceRead_t cputraceRead(SCpuTraceReader_t *, SCpuTraceEntry_t *);
+void            cputraceReaderClose(SCpuTraceReader_t *);
+
+/**
+ * @brief an entry as a Gameboy Doctor line, without the newline
+ */
+void cputraceFormat(const SCpuTraceEntry_t *, char *, size_t);
+
+#endif //!_CPUTRACE_H_
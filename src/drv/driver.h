@@ -0,0 +1,52 @@
+/**
+ * @file driver.h
+ * @author Toesoe
+ * @brief seaboy host driver interfaces
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef _DRIVER_H_
+#define _DRIVER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct
+{
+    const char *pName;
+    bool (*pfnStart)(void);      // false if the backend cannot run on this host
+    void (*pfnStop)(void);
+    void (*pfnFrameReady)(void); // a frame was put in the mailbox. NULL: never shows frames, skip the mailbox
+} SRenderDriver_t;
+
+typedef struct
+{
+    const char *pName;
+    bool (*pfnStart)(uint32_t, uint8_t);       // sample rate, channels
+    void (*pfnStop)(void);
+    void (*pfnQueue)(const int16_t *, size_t); // interleaved sample frames. NULL: pulls them with audioRead()
+} SAudioDriver_t;
+
+typedef struct
+{
+    const char *pName;
+    bool (*pfnStart)(void);
+    void (*pfnStop)(void);
+    void (*pfnPoll)(void); // pick up host input, once per emulated frame
+} SInputDriver_t;
+
+const SRenderDriver_t *pGetNullRenderDriver(void);
+const SAudioDriver_t  *pGetNullAudioDriver(void);
+const SInputDriver_t  *pGetNullInputDriver(void);
+
+#ifndef SEABOY_HEADLESS
+const SRenderDriver_t *pGetSdlRenderDriver(void);
+const SAudioDriver_t  *pGetSdlAudioDriver(void);
+#endif
+
+#endif //!_DRIVER_H_
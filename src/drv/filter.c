@@ -0,0 +1,674 @@
+/**
+ * @file filter.c
+ * @author Toesoe
+ * @brief seaboy upscaling filters
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "filter.h"
+#include "render.h"
+
+#define ROW_MAX        (DISP_WIDTH * 2) // widest filter input: second Scale2x pass of Scale4x
+#define XBR_PAD        2                // xBR looks two pixels out from E
+#define MAX_OUT_PIXELS (DISP_WIDTH * FILTER_MAX_SCALE * DISP_HEIGHT * FILTER_MAX_SCALE)
+
+// RGBA8888: take a quarter off each colour channel, leave alpha alone
+#define DARKEN_MASK 0x3F3F3F00u
+
+typedef struct SFilterPass
+{
+    void (*pfnRows)(const struct SFilterPass *, size_t, size_t); // process input rows [y0, y1)
+    const uint32_t *pIn;
+    uint32_t       *pOut;
+    size_t          width;  // input size
+    size_t          height;
+    uint8_t         scale;
+} SFilterPass_t;
+
+static SFilterConfig_t g_config = { FILTER_NONE, 1, false };
+
+static uint32_t g_scratch[DISP_WIDTH * 2 * DISP_HEIGHT * 2]; // Scale4x intermediate
+static uint32_t g_padded[(DISP_WIDTH + XBR_PAD * 2) * (DISP_HEIGHT + XBR_PAD * 2)];
+static uint32_t g_ghost[MAX_OUT_PIXELS];                      // last shown output
+static bool     g_ghostPrimed = false;
+
+static const SFilterPass_t *g_pPass = NULL;
+static pthread_t            g_workers[FILTER_MAX_THREADS];
+static sem_t                g_workStart[FILTER_MAX_THREADS];
+static sem_t                g_workDone;
+static unsigned int         g_workersStarted = 1; // index 0 is always the caller
+static unsigned int         g_threads = 1;
+
+static const char *g_filterNames[FILTER_COUNT] = {
+    "none", "nearest", "scale2x", "scale3x", "scale4x", "xbr2x", "lcd"
+};
+
+static inline uint32_t darken(uint32_t px)
+{
+    return px - ((px >> 2) & DARKEN_MASK);
+}
+
+// per-byte average, rounding up like _mm_avg_epu8
+static inline uint32_t average(uint32_t a, uint32_t b)
+{
+    return (a | b) - (((a ^ b) & 0xFEFEFEFEu) >> 1);
+}
+
+// sum of absolute colour channel differences, alpha ignored
+static inline uint32_t distance(uint32_t a, uint32_t b)
+{
+#ifdef __SSE2__
+    __m128i sad = _mm_sad_epu8(_mm_cvtsi32_si128((int)(a | 0xFF)), _mm_cvtsi32_si128((int)(b | 0xFF)));
+    return (uint32_t)_mm_cvtsi128_si32(sad);
+#else
+    uint32_t sum = 0;
+
+    for (int shift = 8; shift < 32; shift += 8)
+    {
+        int delta = (int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF);
+        sum += (uint32_t)(delta < 0 ? -delta : delta);
+    }
+
+    return sum;
+#endif
+}
+
+/**
+ * @brief distance(a0, b0) + ... + distance(a3, b3)
+ */
+static inline uint32_t distance4(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3,
+                                 uint32_t b0, uint32_t b1, uint32_t b2, uint32_t b3)
+{
+#ifdef __SSE2__
+    const __m128i alpha = _mm_set1_epi32(0xFF);
+    __m128i a   = _mm_or_si128(_mm_set_epi32((int)a3, (int)a2, (int)a1, (int)a0), alpha);
+    __m128i b   = _mm_or_si128(_mm_set_epi32((int)b3, (int)b2, (int)b1, (int)b0), alpha);
+    __m128i sad = _mm_sad_epu8(a, b);
+    return (uint32_t)(_mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+#else
+    return distance(a0, b0) + distance(a1, b1) + distance(a2, b2) + distance(a3, b3);
+#endif
+}
+
+/**
+ * @brief copy a row with one guard pixel on each side, so neighbours never need bounds checks
+ */
+static inline void padRow(const uint32_t *pRow, size_t width, uint32_t *pPadded)
+{
+    pPadded[0] = pRow[0];
+    memcpy(&pPadded[1], pRow, width * sizeof(uint32_t));
+    pPadded[width + 1] = pRow[width - 1];
+}
+
+static inline const uint32_t *pClampedRow(const SFilterPass_t *pPass, ptrdiff_t y)
+{
+    if (y < 0)
+    {
+        y = 0;
+    }
+    else if ((size_t)y >= pPass->height)
+    {
+        y = (ptrdiff_t)pPass->height - 1;
+    }
+
+    return &pPass->pIn[(size_t)y * pPass->width];
+}
+
+static void expandRow(const uint32_t *pSrc, uint32_t *pDst, size_t width, uint8_t scale)
+{
+    size_t x = 0;
+
+    if (scale == 1)
+    {
+        memcpy(pDst, pSrc, width * sizeof(uint32_t));
+        return;
+    }
+
+#ifdef __SSE2__
+    if (scale == 2)
+    {
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)&pSrc[x]);
+            _mm_storeu_si128((__m128i *)&pDst[x * 2],     _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i *)&pDst[x * 2 + 4], _mm_unpackhi_epi32(v, v));
+        }
+    }
+    else if (scale == 4)
+    {
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)&pSrc[x]);
+            _mm_storeu_si128((__m128i *)&pDst[x * 4],      _mm_shuffle_epi32(v, 0x00));
+            _mm_storeu_si128((__m128i *)&pDst[x * 4 + 4],  _mm_shuffle_epi32(v, 0x55));
+            _mm_storeu_si128((__m128i *)&pDst[x * 4 + 8],  _mm_shuffle_epi32(v, 0xAA));
+            _mm_storeu_si128((__m128i *)&pDst[x * 4 + 12], _mm_shuffle_epi32(v, 0xFF));
+        }
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+        for (uint8_t i = 0; i < scale; i++)
+        {
+            pDst[x * scale + i] = pSrc[x];
+        }
+    }
+}
+
+static void darkenRow(uint32_t *pRow, size_t width)
+{
+    size_t x = 0;
+
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32((int)DARKEN_MASK);
+
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&pRow[x]);
+        _mm_storeu_si128((__m128i *)&pRow[x], _mm_sub_epi32(v, _mm_and_si128(_mm_srli_epi32(v, 2), mask)));
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+        pRow[x] = darken(pRow[x]);
+    }
+}
+
+static void nearestRows(const SFilterPass_t *pPass, size_t y0, size_t y1)
+{
+    const size_t outWidth = pPass->width * pPass->scale;
+
+    for (size_t y = y0; y < y1; y++)
+    {
+        uint32_t *pDst = &pPass->pOut[y * pPass->scale * outWidth];
+
+        expandRow(&pPass->pIn[y * pPass->width], pDst, pPass->width, pPass->scale);
+
+        for (uint8_t i = 1; i < pPass->scale; i++)
+        {
+            memcpy(&pDst[i * outWidth], pDst, outWidth * sizeof(uint32_t));
+        }
+    }
+}
+
+/**
+ * @brief nearest, then darken the right column and bottom row of every output cell
+ */
+static void lcdRows(const SFilterPass_t *pPass, size_t y0, size_t y1)
+{
+    const size_t  outWidth = pPass->width * pPass->scale;
+    const uint8_t scale    = pPass->scale;
+
+    for (size_t y = y0; y < y1; y++)
+    {
+        uint32_t *pDst = &pPass->pOut[y * scale * outWidth];
+
+        expandRow(&pPass->pIn[y * pPass->width], pDst, pPass->width, scale);
+
+        for (size_t x = scale - 1; x < outWidth; x += scale)
+        {
+            pDst[x] = darken(pDst[x]);
+        }
+
+        for (uint8_t i = 1; i < scale; i++)
+        {
+            memcpy(&pDst[i * outWidth], pDst, outWidth * sizeof(uint32_t));
+        }
+
+        darkenRow(&pDst[(scale - 1) * outWidth], outWidth);
+    }
+}
+
+/**
+ * @brief EPX/Scale2x. with B above, D left, F right and H below E:
+ *        E0 = D==B ? D : E, E1 = B==F ? F : E, E2 = D==H ? D : E, E3 = H==F ? F : E,
+ *        all only where B!=H and D!=F
+ */
+static void scale2xRows(const SFilterPass_t *pPass, size_t y0, size_t y1)
+{
+    const size_t width    = pPass->width;
+    const size_t outWidth = width * 2;
+    uint32_t     row[ROW_MAX + 2];
+
+    for (size_t y = y0; y < y1; y++)
+    {
+        const uint32_t *pB  = pClampedRow(pPass, (ptrdiff_t)y - 1);
+        const uint32_t *pH  = pClampedRow(pPass, (ptrdiff_t)y + 1);
+        uint32_t       *pO0 = &pPass->pOut[y * 2 * outWidth];
+        uint32_t       *pO1 = &pO0[outWidth];
+        size_t          x   = 0;
+
+        padRow(&pPass->pIn[y * width], width, row);
+
+#ifdef __SSE2__
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i b = _mm_loadu_si128((const __m128i *)&pB[x]);
+            __m128i h = _mm_loadu_si128((const __m128i *)&pH[x]);
+            __m128i d = _mm_loadu_si128((const __m128i *)&row[x]);
+            __m128i e = _mm_loadu_si128((const __m128i *)&row[x + 1]);
+            __m128i f = _mm_loadu_si128((const __m128i *)&row[x + 2]);
+
+            // andnot(same, ones): B!=H and D!=F
+            __m128i same = _mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f));
+            __m128i cond = _mm_andnot_si128(same, _mm_set1_epi32(-1));
+
+            __m128i m0 = _mm_and_si128(cond, _mm_cmpeq_epi32(d, b));
+            __m128i m1 = _mm_and_si128(cond, _mm_cmpeq_epi32(b, f));
+            __m128i m2 = _mm_and_si128(cond, _mm_cmpeq_epi32(d, h));
+            __m128i m3 = _mm_and_si128(cond, _mm_cmpeq_epi32(h, f));
+
+            __m128i e0 = _mm_or_si128(_mm_and_si128(m0, d), _mm_andnot_si128(m0, e));
+            __m128i e1 = _mm_or_si128(_mm_and_si128(m1, f), _mm_andnot_si128(m1, e));
+            __m128i e2 = _mm_or_si128(_mm_and_si128(m2, d), _mm_andnot_si128(m2, e));
+            __m128i e3 = _mm_or_si128(_mm_and_si128(m3, f), _mm_andnot_si128(m3, e));
+
+            _mm_storeu_si128((__m128i *)&pO0[x * 2],     _mm_unpacklo_epi32(e0, e1));
+            _mm_storeu_si128((__m128i *)&pO0[x * 2 + 4], _mm_unpackhi_epi32(e0, e1));
+            _mm_storeu_si128((__m128i *)&pO1[x * 2],     _mm_unpacklo_epi32(e2, e3));
+            _mm_storeu_si128((__m128i *)&pO1[x * 2 + 4], _mm_unpackhi_epi32(e2, e3));
+        }
+#endif
+
+        for (; x < width; x++)
+        {
+            uint32_t b = pB[x], h = pH[x], d = row[x], e = row[x + 1], f = row[x + 2];
+            bool     cond = (b != h) && (d != f);
+
+            pO0[x * 2]     = (cond && d == b) ? d : e;
+            pO0[x * 2 + 1] = (cond && b == f) ? f : e;
+            pO1[x * 2]     = (cond && d == h) ? d : e;
+            pO1[x * 2 + 1] = (cond && h == f) ? f : e;
+        }
+    }
+}
+
+/**
+ * @brief AdvMAME3x/Scale3x, same edge test as Scale2x with the edge-centre cells added
+ */
+static void scale3xRows(const SFilterPass_t *pPass, size_t y0, size_t y1)
+{
+    const size_t width    = pPass->width;
+    const size_t outWidth = width * 3;
+    uint32_t     above[ROW_MAX + 2];
+    uint32_t     row[ROW_MAX + 2];
+    uint32_t     below[ROW_MAX + 2];
+
+    for (size_t y = y0; y < y1; y++)
+    {
+        uint32_t *pO0 = &pPass->pOut[y * 3 * outWidth];
+        uint32_t *pO1 = &pO0[outWidth];
+        uint32_t *pO2 = &pO1[outWidth];
+
+        padRow(pClampedRow(pPass, (ptrdiff_t)y - 1), width, above);
+        padRow(&pPass->pIn[y * width], width, row);
+        padRow(pClampedRow(pPass, (ptrdiff_t)y + 1), width, below);
+
+        for (size_t x = 0; x < width; x++)
+        {
+            uint32_t a = above[x], b = above[x + 1], c = above[x + 2];
+            uint32_t d = row[x],   e = row[x + 1],   f = row[x + 2];
+            uint32_t g = below[x], h = below[x + 1], i = below[x + 2];
+
+            bool cond = (b != h) && (d != f);
+            bool db = cond && (d == b), bf = cond && (b == f);
+            bool dh = cond && (d == h), hf = cond && (h == f);
+
+            pO0[x * 3]     = db ? d : e;
+            pO0[x * 3 + 1] = ((db && e != c) || (bf && e != a)) ? b : e;
+            pO0[x * 3 + 2] = bf ? f : e;
+            pO1[x * 3]     = ((db && e != g) || (dh && e != a)) ? d : e;
+            pO1[x * 3 + 1] = e;
+            pO1[x * 3 + 2] = ((bf && e != i) || (hf && e != c)) ? f : e;
+            pO2[x * 3]     = dh ? d : e;
+            pO2[x * 3 + 1] = ((dh && e != i) || (hf && e != g)) ? h : e;
+            pO2[x * 3 + 2] = hf ? f : e;
+        }
+    }
+}
+
+/**
+ * @brief one xBR level-1 corner of E. (dx, dy) points at the corner; the neighbourhood is
+ *        mirrored so the rule is always written for the bottom-right one:
+ *
+ *            B  C
+ *         D  E  F  F4
+ *         G  H  I  I4
+ *            H5 I5
+ */
+static inline uint32_t xbrCorner(const uint32_t *pE, ptrdiff_t dx, ptrdiff_t dy)
+{
+    uint32_t e = pE[0];
+    uint32_t f = pE[dx];
+    uint32_t h = pE[dy];
+
+    if ((e == f) && (e == h))
+    {
+        return e;
+    }
+
+    uint32_t b  = pE[-dy];
+    uint32_t c  = pE[dx - dy];
+    uint32_t d  = pE[-dx];
+    uint32_t f4 = pE[2 * dx];
+    uint32_t g  = pE[dy - dx];
+    uint32_t i  = pE[dx + dy];
+    uint32_t i4 = pE[2 * dx + dy];
+    uint32_t h5 = pE[2 * dy];
+    uint32_t i5 = pE[dx + 2 * dy];
+
+    // weight of an edge along F-H against one along E-I
+    uint32_t across = distance4(e, e, i, i, c, g, f4, h5) + 4 * distance(h, f);
+    uint32_t along  = distance4(h, h, f, f, d, i5, i4, b) + 4 * distance(e, i);
+
+    if (across >= along)
+    {
+        return e;
+    }
+
+    return average(e, (distance(e, f) <= distance(e, h)) ? f : h);
+}
+
+/**
+ * @brief pIn is the source with XBR_PAD guard pixels on every side, see padImage()
+ */
+static void xbr2xRows(const SFilterPass_t *pPass, size_t y0, size_t y1)
+{
+    const size_t    outWidth = pPass->width * 2;
+    const ptrdiff_t stride   = (ptrdiff_t)(pPass->width + XBR_PAD * 2);
+
+    for (size_t y = y0; y < y1; y++)
+    {
+        const uint32_t *pE  = &pPass->pIn[(y + XBR_PAD) * (size_t)stride + XBR_PAD];
+        uint32_t       *pO0 = &pPass->pOut[y * 2 * outWidth];
+        uint32_t       *pO1 = &pO0[outWidth];
+
+        for (size_t x = 0; x < pPass->width; x++, pE++)
+        {
+            pO0[x * 2]     = xbrCorner(pE, -1, -stride);
+            pO0[x * 2 + 1] = xbrCorner(pE,  1, -stride);
+            pO1[x * 2]     = xbrCorner(pE, -1,  stride);
+            pO1[x * 2 + 1] = xbrCorner(pE,  1,  stride);
+        }
+    }
+}
+
+/**
+ * @brief copy the native frame into g_padded, repeating the edge pixels XBR_PAD times outward
+ */
+static void padImage(const uint32_t *pIn)
+{
+    const size_t stride = DISP_WIDTH + XBR_PAD * 2;
+
+    for (size_t y = 0; y < DISP_HEIGHT + XBR_PAD * 2; y++)
+    {
+        size_t          srcY  = (y < XBR_PAD) ? 0 : (y - XBR_PAD >= DISP_HEIGHT) ? DISP_HEIGHT - 1 : y - XBR_PAD;
+        const uint32_t *pSrc  = &pIn[srcY * DISP_WIDTH];
+        uint32_t       *pDst  = &g_padded[y * stride];
+
+        for (size_t x = 0; x < XBR_PAD; x++)
+        {
+            pDst[x] = pSrc[0];
+            pDst[XBR_PAD + DISP_WIDTH + x] = pSrc[DISP_WIDTH - 1];
+        }
+
+        memcpy(&pDst[XBR_PAD], pSrc, DISP_WIDTH * sizeof(uint32_t));
+    }
+}
+
+/**
+ * @brief blend the output with the previously shown frame; pIn is the output, pOut the history.
+ *        both end up holding the blended frame
+ */
+static void ghostRows(const SFilterPass_t *pPass, size_t y0, size_t y1)
+{
+    uint32_t *pCur  = (uint32_t *)&pPass->pIn[y0 * pPass->width];
+    uint32_t *pPrev = &pPass->pOut[y0 * pPass->width];
+    size_t    count = (y1 - y0) * pPass->width;
+    size_t    i     = 0;
+
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)&pCur[i]), _mm_loadu_si128((const __m128i *)&pPrev[i]));
+        _mm_storeu_si128((__m128i *)&pCur[i], v);
+        _mm_storeu_si128((__m128i *)&pPrev[i], v);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        pCur[i] = pPrev[i] = average(pCur[i], pPrev[i]);
+    }
+}
+
+static void runBand(const SFilterPass_t *pPass, unsigned int band)
+{
+    size_t rows = (pPass->height + g_threads - 1) / g_threads;
+    size_t y0   = band * rows;
+    size_t y1   = y0 + rows;
+
+    if (y1 > pPass->height)
+    {
+        y1 = pPass->height;
+    }
+
+    if (y0 < y1)
+    {
+        pPass->pfnRows(pPass, y0, y1);
+    }
+}
+
+static void *filterWorker(void *pArg)
+{
+    unsigned int band = (unsigned int)(uintptr_t)pArg;
+
+    for (;;)
+    {
+        while ((sem_wait(&g_workStart[band]) == -1) && (errno == EINTR));
+        runBand(g_pPass, band);
+        sem_post(&g_workDone);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief run a pass split into one band of input rows per thread; the caller takes band 0
+ */
+static void runPass(const SFilterPass_t *pPass)
+{
+    g_pPass = pPass;
+
+    for (unsigned int band = 1; band < g_threads; band++)
+    {
+        sem_post(&g_workStart[band]);
+    }
+
+    runBand(pPass, 0);
+
+    for (unsigned int band = 1; band < g_threads; band++)
+    {
+        while ((sem_wait(&g_workDone) == -1) && (errno == EINTR));
+    }
+}
+
+void filterInit(unsigned int threads)
+{
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    else if (threads > FILTER_MAX_THREADS)
+    {
+        threads = FILTER_MAX_THREADS;
+    }
+
+    if (g_workersStarted == 1)
+    {
+        sem_init(&g_workDone, 0, 0);
+    }
+
+    for (; g_workersStarted < threads; g_workersStarted++)
+    {
+        sem_init(&g_workStart[g_workersStarted], 0, 0);
+
+        if (pthread_create(&g_workers[g_workersStarted], NULL, filterWorker, (void *)(uintptr_t)g_workersStarted) != 0)
+        {
+            fprintf(stderr, "cannot start filter thread %u\n", g_workersStarted);
+            break;
+        }
+
+        pthread_detach(g_workers[g_workersStarted]);
+    }
+
+    g_threads = (threads < g_workersStarted) ? threads : g_workersStarted;
+}
+
+void filterConfigure(const SFilterConfig_t *pConfig)
+{
+    g_config = *pConfig;
+
+    if (g_config.type >= FILTER_COUNT)
+    {
+        g_config.type = FILTER_NONE;
+    }
+
+    if (g_config.scale < 1)
+    {
+        g_config.scale = 1;
+    }
+    else if (g_config.scale > FILTER_MAX_SCALE)
+    {
+        g_config.scale = FILTER_MAX_SCALE;
+    }
+
+    g_ghostPrimed = false;
+}
+
+uint8_t filterGetScale(void)
+{
+    switch (g_config.type)
+    {
+        case FILTER_NEAREST:
+            return g_config.scale;
+        case FILTER_SCALE2X:
+        case FILTER_XBR2X:
+            return 2;
+        case FILTER_SCALE3X:
+            return 3;
+        case FILTER_SCALE4X:
+            return 4;
+        case FILTER_LCD:
+            return (g_config.scale < 2) ? 2 : g_config.scale;
+        default:
+            return 1;
+    }
+}
+
+void filterApply(const uint32_t *pIn, uint32_t *pOut)
+{
+    const uint8_t scale = filterGetScale();
+    SFilterPass_t pass  = { nearestRows, pIn, pOut, DISP_WIDTH, DISP_HEIGHT, scale };
+
+    switch (g_config.type)
+    {
+        case FILTER_SCALE2X:
+            pass.pfnRows = scale2xRows;
+            break;
+        case FILTER_SCALE3X:
+            pass.pfnRows = scale3xRows;
+            break;
+        case FILTER_SCALE4X:
+            // Scale2x twice; the first pass has to finish before the second reads its neighbours
+            pass.pfnRows = scale2xRows;
+            pass.pOut    = g_scratch;
+            pass.scale   = 2;
+            runPass(&pass);
+
+            pass.pIn    = g_scratch;
+            pass.pOut   = pOut;
+            pass.width  = DISP_WIDTH * 2;
+            pass.height = DISP_HEIGHT * 2;
+            break;
+        case FILTER_XBR2X:
+            padImage(pIn);
+            pass.pfnRows = xbr2xRows;
+            pass.pIn     = g_padded;
+            break;
+        case FILTER_LCD:
+            pass.pfnRows = lcdRows;
+            break;
+        default:
+            break;
+    }
+
+    runPass(&pass);
+
+    if (g_config.ghosting)
+    {
+        const size_t outPixels = (size_t)DISP_WIDTH * scale * DISP_HEIGHT * scale;
+
+        if (!g_ghostPrimed)
+        {
+            memcpy(g_ghost, pOut, outPixels * sizeof(uint32_t));
+            g_ghostPrimed = true;
+            return;
+        }
+
+        SFilterPass_t ghost = { ghostRows, pOut, g_ghost, DISP_WIDTH * scale, DISP_HEIGHT * scale, 1 };
+        runPass(&ghost);
+    }
+}
+
+const char *filterGetName(EFilter_t filter)
+{
+    return (filter < FILTER_COUNT) ? g_filterNames[filter] : "unknown";
+}
+
+bool filterParse(const char *pStr, SFilterConfig_t *pConfig)
+{
+    for (EFilter_t filter = FILTER_NONE; filter < FILTER_COUNT; filter++)
+    {
+        size_t      len = strlen(g_filterNames[filter]);
+        const char *pScale = &pStr[len];
+
+        if (strncmp(pStr, g_filterNames[filter], len) != 0)
+        {
+            continue;
+        }
+
+        if (*pScale == '\0')
+        {
+            *pConfig = (SFilterConfig_t){ filter, 2, false };
+            return true;
+        }
+
+        if (((filter == FILTER_NEAREST) || (filter == FILTER_LCD)) && (pScale[0] == 'x') &&
+            (pScale[1] >= '1') && (pScale[1] <= ('0' + FILTER_MAX_SCALE)) && (pScale[2] == '\0'))
+        {
+            *pConfig = (SFilterConfig_t){ filter, (uint8_t)(pScale[1] - '0'), false };
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file filter.h
+ * @author Toesoe
+ * @brief seaboy upscaling filters
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FILTER_MAX_SCALE   4
+#define FILTER_MAX_THREADS 8
+#define FILTER_REACH       2 // native rows either side that can change a filtered output row
+
+typedef enum
+{
+    FILTER_NONE,     // native 160x144
+    FILTER_NEAREST,  // integer nearest-neighbour, any scale
+    FILTER_SCALE2X,  // EPX / AdvMAME2x
+    FILTER_SCALE3X,  // AdvMAME3x
+    FILTER_SCALE4X,  // Scale2x applied twice
+    FILTER_XBR2X,    // edge-directed 2x, xBR rules
+    FILTER_LCD,      // nearest with a darkened pixel grid, any scale from 2
+    FILTER_COUNT
+} EFilter_t;
+
+typedef struct
+{
+    EFilter_t type;
+    uint8_t scale;  // FILTER_NEAREST and FILTER_LCD only
+    bool ghosting;  // blend every output frame with the previous one, like a slow DMG LCD
+} SFilterConfig_t;
+
+/**
+ * @brief start the filter worker threads. 1 runs everything on the caller
+ */
+void filterInit(unsigned int);
+
+void filterConfigure(const SFilterConfig_t *);
+
+/**
+ * @brief output pixels per native pixel, per axis, for the configured filter
+ */
+uint8_t filterGetScale(void);
+
+/**
+ * @brief filter a native DISP_WIDTH x DISP_HEIGHT frame
+ * 
+ * output is (DISP_WIDTH * scale) x (DISP_HEIGHT * scale), tightly packed
+ */
+void filterApply(const uint32_t *, uint32_t *);
+
+const char *filterGetName(EFilter_t);
+
+/**
+ * @brief parse "name" or, for nearest and lcd, "namexN", e.g. "scale2x" or "lcdx3"; 2x when not given
+ * @return false on an unknown name or scale
+ */
+bool filterParse(const char *, SFilterConfig_t *);
+
+#endif //!_FILTER_H_
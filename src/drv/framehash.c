@@ -0,0 +1,241 @@
+/**
+ * @file framehash.c
+ * @author Toesoe
+ * @brief seaboy per-frame output hashing
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "framehash.h"
+#include "render.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ull
+#define PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define PRIME64_3 0x165667B19E3779F9ull
+#define PRIME64_4 0x85EBCA77C2B2AE63ull
+#define PRIME64_5 0x27D4EB2F165667C5ull
+
+#define LOG_RECORD_BYTES 16
+
+static bool     g_enabled = false;
+static FILE    *g_pLog = NULL;
+static uint64_t g_last[2];
+static uint32_t g_count[2];
+
+static inline uint64_t rotl64(uint64_t val, int bits)
+{
+    return (val << bits) | (val >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t *pSrc)
+{
+    uint64_t val;
+    memcpy(&val, pSrc, sizeof(val));
+    return val;
+}
+
+static inline uint32_t read32(const uint8_t *pSrc)
+{
+    uint32_t val;
+    memcpy(&val, pSrc, sizeof(val));
+    return val;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc  = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t xxhMerge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxhRound(0, val);
+    return (acc * PRIME64_1) + PRIME64_4;
+}
+
+/**
+ * @brief the four accumulators are independent, so the multiplies of one stripe overlap.
+ *        there is no 64-bit vector multiply below AVX-512, so this stays scalar
+ */
+uint64_t hash64(const void *pData, size_t len, uint64_t seed)
+{
+    const uint8_t *pSrc = (const uint8_t *)pData;
+    const uint8_t *pEnd = pSrc + len;
+    uint64_t       hash;
+
+    if (len >= 32)
+    {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+
+        do
+        {
+            v1 = xxhRound(v1, read64(pSrc));
+            v2 = xxhRound(v2, read64(pSrc + 8));
+            v3 = xxhRound(v3, read64(pSrc + 16));
+            v4 = xxhRound(v4, read64(pSrc + 24));
+            pSrc += 32;
+        } while (pSrc + 32 <= pEnd);
+
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxhMerge(hash, v1);
+        hash = xxhMerge(hash, v2);
+        hash = xxhMerge(hash, v3);
+        hash = xxhMerge(hash, v4);
+    }
+    else
+    {
+        hash = seed + PRIME64_5;
+    }
+
+    hash += (uint64_t)len;
+
+    for (; pSrc + 8 <= pEnd; pSrc += 8)
+    {
+        hash ^= xxhRound(0, read64(pSrc));
+        hash  = (rotl64(hash, 27) * PRIME64_1) + PRIME64_4;
+    }
+
+    if (pSrc + 4 <= pEnd)
+    {
+        hash ^= (uint64_t)read32(pSrc) * PRIME64_1;
+        hash  = (rotl64(hash, 23) * PRIME64_2) + PRIME64_3;
+        pSrc += 4;
+    }
+
+    for (; pSrc < pEnd; pSrc++)
+    {
+        hash ^= (uint64_t)*pSrc * PRIME64_5;
+        hash  = rotl64(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+static void logHash(EHashKind_t kind, uint64_t hash)
+{
+    uint8_t  record[LOG_RECORD_BYTES] = { 0 };
+    uint32_t index = g_count[kind];
+
+    record[0] = (uint8_t)kind;
+
+    for (int i = 0; i < 4; i++)
+    {
+        record[4 + i] = (uint8_t)(index >> (i * 8));
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        record[8 + i] = (uint8_t)(hash >> (i * 8));
+    }
+
+    if (fwrite(record, sizeof(record), 1, g_pLog) != 1)
+    {
+        fprintf(stderr, "hash log write failed: %s\n", strerror(errno));
+        framehashClose();
+    }
+}
+
+static uint64_t record(EHashKind_t kind, uint64_t hash)
+{
+    if (g_pLog)
+    {
+        logHash(kind, hash);
+    }
+
+    g_last[kind] = hash;
+    g_count[kind]++;
+
+    return hash;
+}
+
+void framehashEnable(bool enable)
+{
+    g_enabled = enable;
+}
+
+bool framehashEnabled(void)
+{
+    return g_enabled;
+}
+
+bool framehashOpen(const char *pPath)
+{
+    framehashClose();
+
+    g_pLog = fopen(pPath, "wb");
+
+    if (!g_pLog)
+    {
+        fprintf(stderr, "cannot open hash log %s: %s\n", pPath, strerror(errno));
+        return false;
+    }
+
+    uint8_t header[8] = { 0 };
+    memcpy(header, FRAMEHASH_MAGIC, 4);
+    header[4] = FRAMEHASH_VERSION;
+
+    if (fwrite(header, sizeof(header), 1, g_pLog) != 1)
+    {
+        fprintf(stderr, "cannot write hash log %s\n", pPath);
+        fclose(g_pLog);
+        g_pLog = NULL;
+        return false;
+    }
+
+    g_enabled = true;
+
+    return true;
+}
+
+void framehashClose(void)
+{
+    if (g_pLog)
+    {
+        fclose(g_pLog);
+        g_pLog = NULL;
+    }
+}
+
+uint64_t framehashVideo(const uint32_t *pFrame, size_t pitch)
+{
+    uint64_t hash = 0;
+
+    for (size_t y = 0; y < DISP_HEIGHT; y++)
+    {
+        hash = hash64(&pFrame[y * pitch], DISP_WIDTH * sizeof(uint32_t), hash);
+    }
+
+    return record(HASH_VIDEO, hash);
+}
+
+uint64_t framehashAudio(const int16_t *pSamples, size_t count)
+{
+    return record(HASH_AUDIO, hash64(pSamples, count * sizeof(int16_t), 0));
+}
+
+uint64_t framehashGetLast(EHashKind_t kind)
+{
+    return g_last[kind];
+}
+
+uint32_t framehashGetCount(EHashKind_t kind)
+{
+    return g_count[kind];
+}
@@ -0,0 +1,64 @@
+/**
+ * @file framehash.h
+ * @author Toesoe
+ * @brief seaboy per-frame output hashing
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * log layout, little endian: "SBFH", u16 version, u16 reserved, then one 16-byte record per
+ * hashed block: u8 EHashKind_t, 3 bytes zero, u32 block index, u64 hash.
+ *
+ * a video hash is XXH64 over each DISP_WIDTH-pixel row in turn, seeded with the hash of the row
+ * before (0 for row 0), so it does not depend on the framebuffer pitch. an audio hash is XXH64
+ * of the block's samples, seed 0.
+ */
+
+#ifndef _FRAMEHASH_H_
+#define _FRAMEHASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FRAMEHASH_MAGIC   "SBFH"
+#define FRAMEHASH_VERSION 1
+
+typedef enum
+{
+    HASH_VIDEO = 0,
+    HASH_AUDIO = 1
+} EHashKind_t;
+
+/**
+ * @brief XXH64
+ */
+uint64_t hash64(const void *, size_t, uint64_t);
+
+/**
+ * @brief hash every frame and audio block from now on; also implied by framehashOpen()
+ */
+void framehashEnable(bool);
+bool framehashEnabled(void);
+
+/**
+ * @brief log every hash to pPath as well
+ */
+bool framehashOpen(const char *);
+void framehashClose(void);
+
+/**
+ * @brief hash a finished DISP_WIDTH x DISP_HEIGHT frame with a row pitch in pixels
+ */
+uint64_t framehashVideo(const uint32_t *, size_t);
+
+/**
+ * @brief hash a block of interleaved output samples
+ */
+uint64_t framehashAudio(const int16_t *, size_t);
+
+uint64_t framehashGetLast(EHashKind_t);
+uint32_t framehashGetCount(EHashKind_t);
+
+#endif //!_FRAMEHASH_H_
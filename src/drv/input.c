@@ -9,4 +9,172 @@
  * 
  */
 
-// TODO: implement SDL for input handling
\ No newline at end of file
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "input.h"
+
+#define QUEUE_MASK (INPUT_QUEUE_DEPTH - 1u)
+
+// bounded multi-producer, single-consumer queue. a cell's tag says whose turn it is: equal to
+// the lap base of a position, it is free for that position; one more, it holds its event.
+// zero-initialized, every cell is free for lap 0
+typedef struct
+{
+    atomic_uint   tag;
+    SInputEvent_t event;
+} SInputCell_t;
+
+static const SInputDriver_t *g_pDriver = NULL; // NULL: null driver
+static bool g_running = false;
+
+static SInputCell_t g_cells[INPUT_QUEUE_DEPTH];
+static _Alignas(64) atomic_uint g_enqueuePos = 0;
+static _Alignas(64) unsigned int g_dequeuePos = 0; // consumer only
+
+static atomic_bool g_live = true; // false while a movie drives the joypad
+
+static _Atomic uint64_t g_pushed;
+static _Atomic uint64_t g_dropped;
+static SInputStats_t    g_stats; // the rest belongs to the emulation thread
+
+void inputSetDriver(const SInputDriver_t *pDriver)
+{
+    g_pDriver = pDriver;
+}
+
+bool inputStart(void)
+{
+    if (!g_pDriver)
+    {
+        g_pDriver = pGetNullInputDriver();
+    }
+
+    g_running = g_pDriver->pfnStart();
+
+    if (!g_running)
+    {
+        fprintf(stderr, "cannot start %s input driver\n", g_pDriver->pName);
+    }
+
+    return g_running;
+}
+
+void inputStop(void)
+{
+    if (g_running)
+    {
+        g_pDriver->pfnStop();
+        g_running = false;
+    }
+}
+
+void inputPoll(void)
+{
+    if (g_running)
+    {
+        g_pDriver->pfnPoll();
+    }
+}
+
+bool inputPush(uint64_t cycle, uint8_t mask, uint8_t state)
+{
+    struct timespec ts;
+    unsigned int    pos = atomic_load_explicit(&g_enqueuePos, memory_order_relaxed);
+    SInputCell_t   *pCell;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    atomic_fetch_add_explicit(&g_pushed, 1, memory_order_relaxed);
+
+    if ((cycle == INPUT_NOW) && !atomic_load_explicit(&g_live, memory_order_relaxed))
+    {
+        atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    for (;;)
+    {
+        pCell = &g_cells[pos & QUEUE_MASK];
+
+        int diff = (int)(atomic_load_explicit(&pCell->tag, memory_order_acquire) - (pos & ~QUEUE_MASK));
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&g_enqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // the cell still holds an event from the lap before: full
+            atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&g_enqueuePos, memory_order_relaxed);
+        }
+    }
+
+    pCell->event = (SInputEvent_t){ cycle, ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec, mask, state };
+    atomic_store_explicit(&pCell->tag, (pos & ~QUEUE_MASK) + 1, memory_order_release);
+
+    return true;
+}
+
+void inputSetLive(bool live)
+{
+    atomic_store_explicit(&g_live, live, memory_order_relaxed);
+}
+
+bool inputPushAtFrame(uint64_t frame, uint8_t mask, uint8_t state)
+{
+    return inputPush(frame * INPUT_FRAME_CYCLES, mask, state);
+}
+
+bool inputPop(SInputEvent_t *pEvent)
+{
+    SInputCell_t *pCell = &g_cells[g_dequeuePos & QUEUE_MASK];
+
+    if (atomic_load_explicit(&pCell->tag, memory_order_acquire) != ((g_dequeuePos & ~QUEUE_MASK) + 1))
+    {
+        return false;
+    }
+
+    *pEvent = pCell->event;
+    atomic_store_explicit(&pCell->tag, (g_dequeuePos & ~QUEUE_MASK) + INPUT_QUEUE_DEPTH, memory_order_release);
+    g_dequeuePos++;
+
+    return true;
+}
+
+void inputCountApplied(const SInputEvent_t *pEvent, uint64_t cycle)
+{
+    g_stats.applied++;
+
+    if (pEvent->cycle == INPUT_NOW)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        uint64_t latency = ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec - pEvent->hostNs;
+
+        g_stats.nowEvents++;
+        g_stats.totalLatencyNs += latency;
+        g_stats.maxLatencyNs    = (latency > g_stats.maxLatencyNs) ? latency : g_stats.maxLatencyNs;
+    }
+    else if (cycle > pEvent->cycle)
+    {
+        g_stats.late++;
+        g_stats.maxLateCycles = ((cycle - pEvent->cycle) > g_stats.maxLateCycles) ? (cycle - pEvent->cycle) : g_stats.maxLateCycles;
+    }
+}
+
+void inputGetStats(SInputStats_t *pStats)
+{
+    *pStats         = g_stats;
+    pStats->pushed  = atomic_load_explicit(&g_pushed, memory_order_relaxed);
+    pStats->dropped = atomic_load_explicit(&g_dropped, memory_order_relaxed);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file input.h
+ * @author Toesoe
+ * @brief seaboy input driver
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+
+#define INPUT_QUEUE_DEPTH  256   // power of two
+#define INPUT_FRAME_CYCLES 70224 // T-cycles per frame, for frame timestamps
+#define INPUT_NOW          0     // timestamp: apply as soon as the emulation picks the event up
+
+typedef enum
+{
+    INPUT_RIGHT  = 0x01,
+    INPUT_LEFT   = 0x02,
+    INPUT_UP     = 0x04,
+    INPUT_DOWN   = 0x08,
+    INPUT_A      = 0x10,
+    INPUT_B      = 0x20,
+    INPUT_SELECT = 0x40,
+    INPUT_START  = 0x80
+} EInputButton_t;
+
+typedef struct
+{
+    uint64_t cycle;  // joypad T-cycle to apply at; one already past applies when picked up
+    uint64_t hostNs; // CLOCK_MONOTONIC at push
+    uint8_t  mask;   // the buttons this event sets
+    uint8_t  state;  // their new state, 1 = pressed
+} SInputEvent_t;
+
+typedef struct
+{
+    uint64_t pushed;
+    uint64_t dropped;        // the queue was full, or an INPUT_NOW event came in with live input off
+    uint64_t applied;
+    uint64_t late;           // timestamped events applied after their cycle: pushed too late
+    uint64_t maxLateCycles;
+    uint64_t nowEvents;      // INPUT_NOW events applied, the ones latency is measured on
+    uint64_t totalLatencyNs; // push to the emulated button changing
+    uint64_t maxLatencyNs;
+} SInputStats_t;
+
+void inputSetDriver(const SInputDriver_t *);
+bool inputStart(void);
+void inputStop(void);
+
+/**
+ * @brief pick up host input, once per emulated frame
+ */
+void inputPoll(void);
+
+/**
+ * @brief queue a button change for a joypad T-cycle (see joypadGetCycle()), or INPUT_NOW. any
+ *        thread, lock-free, never waits
+ * @return false if the queue is full and the event was dropped
+ */
+bool inputPush(uint64_t, uint8_t, uint8_t);
+
+/**
+ * @brief with live input off, INPUT_NOW events are dropped and only timestamped ones get through,
+ *        while a movie plays back for instance. on by default
+ */
+void inputSetLive(bool);
+
+/**
+ * @brief the same, at the start of a frame: INPUT_FRAME_CYCLES per frame since joypadInit()
+ */
+bool inputPushAtFrame(uint64_t, uint8_t, uint8_t);
+
+/**
+ * @brief take the oldest queued event. the emulation thread only
+ */
+bool inputPop(SInputEvent_t *);
+
+/**
+ * @brief for the joypad: an event took effect at a cycle
+ */
+void inputCountApplied(const SInputEvent_t *, uint64_t);
+
+void inputGetStats(SInputStats_t *);
+
+#endif //!_INPUT_H_
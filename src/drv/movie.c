@@ -0,0 +1,678 @@
+/**
+ * @file movie.c
+ * @author Toesoe
+ * @brief seaboy input movies: record, replay, seek
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * everything runs on the emulation thread. a recording writes a few bytes per button change and
+ * one keyframe every interval through a large stdio buffer; playback reads the events and the
+ * keyframe offsets in once and only goes back to the file to seek.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "movie.h"
+#include "input.h"
+#include "framehash.h"
+#include "../hw/mem.h"
+#include "../hw/joypad.h"
+#include "../hw/state.h"
+
+#define MOVIE_HEADER_BYTES 32
+#define RECORD_BYTES       16
+#define WRITE_BUFFER_BYTES (1 << 20)
+#define ROM_HASH_START     0x0100 // past the boot ROM overlay
+#define ROM_HASH_BYTES     (0x8000 - ROM_HASH_START)
+#define TOKEN_LITERAL      0x8000
+#define TOKEN_MAX          0x7FFF
+#define MIN_KEEP           4      // shorter matches are cheaper as literals than as a token
+
+#define REC_EVENT    'E'
+#define REC_KEYFRAME 'K'
+#define REC_END      'X'
+
+typedef struct
+{
+    uint64_t cycle;
+    uint8_t  mask;
+    uint8_t  state;
+} SMovieEvent_t;
+
+typedef struct
+{
+    uint64_t cycle;
+    long     offset; // of the payload; the starting state has none
+    uint32_t bytes;
+} SKeyframe_t;
+
+static FILE    *g_pFile = NULL;
+static char    *g_pWriteBuffer = NULL;
+static bool     g_recording = false;
+static bool     g_playing = false;
+static bool     g_armed = false;  // recording, the starting state not taken yet
+static bool     g_failed = false; // a write failed; said so once
+static uint32_t g_interval = MOVIE_DEFAULT_INTERVAL;
+static uint64_t g_nextKeyframe = 0;
+
+static size_t   g_stateBytes = 0;
+static uint8_t *g_pBase = NULL;   // the starting state, every keyframe is coded against it
+static uint8_t *g_pState = NULL;
+static uint8_t *g_pPacked = NULL;
+
+static SMovieEvent_t *g_pEvents = NULL;
+static size_t         g_eventCount = 0;
+static size_t         g_nextEvent = 0; // the first one not handed to the joypad yet
+static SKeyframe_t   *g_pKeyframes = NULL;
+static size_t         g_keyframeCount = 0;
+static uint64_t       g_endCycle = 0;
+
+static SMovieStats_t g_stats;
+
+static inline void putU16(uint8_t *pDst, uint16_t val)
+{
+    pDst[0] = (uint8_t)val;
+    pDst[1] = (uint8_t)(val >> 8);
+}
+
+static inline void putU32(uint8_t *pDst, uint32_t val)
+{
+    putU16(pDst, (uint16_t)val);
+    putU16(&pDst[2], (uint16_t)(val >> 16));
+}
+
+static inline void putU64(uint8_t *pDst, uint64_t val)
+{
+    putU32(pDst, (uint32_t)val);
+    putU32(&pDst[4], (uint32_t)(val >> 32));
+}
+
+static inline uint16_t getU16(const uint8_t *pSrc)
+{
+    return (uint16_t)(pSrc[0] | (pSrc[1] << 8));
+}
+
+static inline uint32_t getU32(const uint8_t *pSrc)
+{
+    return getU16(pSrc) | ((uint32_t)getU16(&pSrc[2]) << 16);
+}
+
+static inline uint64_t getU64(const uint8_t *pSrc)
+{
+    return getU32(pSrc) | ((uint64_t)getU32(&pSrc[4]) << 32);
+}
+
+static uint64_t romHash(void)
+{
+    return hash64(&pGetBusPtr()->bus[ROM_HASH_START], ROM_HASH_BYTES, 0);
+}
+
+/**
+ * @brief the first frame boundary of the next keyframe interval
+ */
+static uint64_t nextKeyframeCycle(uint64_t cycle)
+{
+    uint64_t intervalCycles = (uint64_t)g_interval * INPUT_FRAME_CYCLES;
+
+    return ((cycle / intervalCycles) + 1) * intervalCycles;
+}
+
+static void writeBytes(const void *pData, size_t bytes)
+{
+    if (!g_failed && (fwrite(pData, 1, bytes, g_pFile) != bytes))
+    {
+        fprintf(stderr, "movie: write failed: %s\n", strerror(errno));
+        g_failed = true;
+    }
+}
+
+static void writeRecord(uint8_t type, uint8_t mask, uint8_t state, uint32_t bytes, uint64_t cycle)
+{
+    uint8_t record[RECORD_BYTES] = { type, mask, state, 0 };
+
+    putU32(&record[4], bytes);
+    putU64(&record[8], cycle);
+    writeBytes(record, sizeof(record));
+}
+
+static bool keepsAhead(const uint8_t *pState, size_t pos)
+{
+    for (size_t i = pos; (i < g_stateBytes) && (i < (pos + MIN_KEEP)); i++)
+    {
+        if (pState[i] != g_pBase[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static size_t packKeyframe(const uint8_t *pState, uint8_t *pOut)
+{
+    size_t pos = 0;
+    size_t out = 0;
+
+    while (pos < g_stateBytes)
+    {
+        size_t run = 0;
+
+        while (((pos + run) < g_stateBytes) && (run < TOKEN_MAX) && (pState[pos + run] == g_pBase[pos + run]))
+        {
+            run++;
+        }
+
+        if (run > 0)
+        {
+            putU16(&pOut[out], (uint16_t)run);
+            out += 2;
+            pos += run;
+            continue;
+        }
+
+        // pState[pos] differs, so there is at least one
+        size_t literal = 1;
+
+        while (((pos + literal) < g_stateBytes) && (literal < TOKEN_MAX) && !keepsAhead(pState, pos + literal))
+        {
+            literal++;
+        }
+
+        putU16(&pOut[out], (uint16_t)(TOKEN_LITERAL | literal));
+        memcpy(&pOut[out + 2], &pState[pos], literal);
+        out += 2 + literal;
+        pos += literal;
+    }
+
+    return out;
+}
+
+static bool unpackKeyframe(const uint8_t *pPacked, size_t bytes, uint8_t *pState)
+{
+    size_t pos = 0;
+    size_t in = 0;
+
+    while (pos < g_stateBytes)
+    {
+        if ((in + 2) > bytes)
+        {
+            return false;
+        }
+
+        uint16_t token = getU16(&pPacked[in]);
+        size_t   count = token & TOKEN_MAX;
+
+        in += 2;
+
+        if ((pos + count) > g_stateBytes)
+        {
+            return false;
+        }
+
+        if (token & TOKEN_LITERAL)
+        {
+            if ((in + count) > bytes)
+            {
+                return false;
+            }
+
+            memcpy(&pState[pos], &pPacked[in], count);
+            in += count;
+        }
+        else
+        {
+            memcpy(&pState[pos], &g_pBase[pos], count);
+        }
+
+        pos += count;
+    }
+
+    return true;
+}
+
+static bool allocBuffers(void)
+{
+    g_stateBytes = stateSize();
+    g_pBase      = malloc(g_stateBytes);
+    g_pState     = malloc(g_stateBytes);
+    g_pPacked    = malloc((g_stateBytes * 2) + 16); // worst case: a short literal and a keep, over and over
+
+    if (!g_pBase || !g_pState || !g_pPacked)
+    {
+        fprintf(stderr, "movie: out of memory\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void release(void)
+{
+    if (g_pFile)
+    {
+        fclose(g_pFile);
+    }
+
+    free(g_pWriteBuffer);
+    free(g_pBase);
+    free(g_pState);
+    free(g_pPacked);
+    free(g_pEvents);
+    free(g_pKeyframes);
+
+    g_pFile         = NULL;
+    g_pWriteBuffer  = NULL;
+    g_pBase         = NULL;
+    g_pState        = NULL;
+    g_pPacked       = NULL;
+    g_pEvents       = NULL;
+    g_pKeyframes    = NULL;
+    g_eventCount    = 0;
+    g_keyframeCount = 0;
+    g_recording     = false;
+    g_playing       = false;
+    g_armed         = false;
+}
+
+static void writeStart(void)
+{
+    uint8_t header[MOVIE_HEADER_BYTES];
+
+    stateSave(g_pBase);
+
+    memcpy(header, MOVIE_MAGIC, 4);
+    putU16(&header[4], MOVIE_VERSION);
+    putU16(&header[6], 0);
+    putU32(&header[8], g_interval);
+    putU32(&header[12], (uint32_t)g_stateBytes);
+    putU64(&header[16], romHash());
+    putU64(&header[24], 0); // seed: nothing in this core needs one
+
+    writeBytes(header, sizeof(header));
+    writeBytes(g_pBase, g_stateBytes);
+
+    g_armed        = false;
+    g_nextKeyframe = nextKeyframeCycle(joypadGetCycle());
+}
+
+static void writeKeyframe(void)
+{
+    uint64_t now = joypadGetCycle();
+
+    stateSave(g_pState);
+
+    size_t bytes = packKeyframe(g_pState, g_pPacked);
+
+    writeRecord(REC_KEYFRAME, 0, 0, (uint32_t)bytes, now);
+    writeBytes(g_pPacked, bytes);
+
+    g_stats.keyframes++;
+    g_stats.keyframeBytes += bytes;
+    g_nextKeyframe = nextKeyframeCycle(now);
+}
+
+bool movieRecordStart(const char *pPath, uint32_t interval)
+{
+    if (g_recording || g_playing)
+    {
+        fprintf(stderr, "movie: already %s\n", g_recording ? "recording" : "playing");
+        return false;
+    }
+
+    g_pFile = fopen(pPath, "wb");
+
+    if (!g_pFile)
+    {
+        fprintf(stderr, "cannot open %s for recording a movie: %s\n", pPath, strerror(errno));
+        return false;
+    }
+
+    g_pWriteBuffer = malloc(WRITE_BUFFER_BYTES);
+
+    if (g_pWriteBuffer)
+    {
+        setvbuf(g_pFile, g_pWriteBuffer, _IOFBF, WRITE_BUFFER_BYTES);
+    }
+
+    if (!allocBuffers())
+    {
+        release();
+        return false;
+    }
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_interval  = (interval > 0) ? interval : MOVIE_DEFAULT_INTERVAL;
+    g_failed    = false;
+    g_armed     = true;
+    g_recording = true;
+
+    return true;
+}
+
+static bool addEvent(const uint8_t *pRecord, size_t *pCapacity)
+{
+    if (g_eventCount == *pCapacity)
+    {
+        size_t         capacity = *pCapacity ? (*pCapacity * 2) : 1024;
+        SMovieEvent_t *pEvents = realloc(g_pEvents, capacity * sizeof(SMovieEvent_t));
+
+        if (!pEvents)
+        {
+            return false;
+        }
+
+        g_pEvents  = pEvents;
+        *pCapacity = capacity;
+    }
+
+    g_pEvents[g_eventCount++] = (SMovieEvent_t){ getU64(&pRecord[8]), pRecord[1], pRecord[2] };
+    return true;
+}
+
+static bool addKeyframe(uint64_t cycle, long offset, uint32_t bytes, size_t *pCapacity)
+{
+    if (g_keyframeCount == *pCapacity)
+    {
+        size_t       capacity = *pCapacity ? (*pCapacity * 2) : 64;
+        SKeyframe_t *pKeyframes = realloc(g_pKeyframes, capacity * sizeof(SKeyframe_t));
+
+        if (!pKeyframes)
+        {
+            return false;
+        }
+
+        g_pKeyframes = pKeyframes;
+        *pCapacity   = capacity;
+    }
+
+    g_pKeyframes[g_keyframeCount++] = (SKeyframe_t){ cycle, offset, bytes };
+    return true;
+}
+
+/**
+ * @brief read the index: every event, and where each keyframe is. a recording cut short ends at
+ *        its last complete record
+ */
+static bool readRecords(void)
+{
+    uint8_t record[RECORD_BYTES];
+    size_t  eventCapacity = 0;
+    size_t  keyframeCapacity = 0;
+
+    g_endCycle = joypadGetCycle();
+
+    if (!addKeyframe(g_endCycle, -1, 0, &keyframeCapacity))
+    {
+        return false;
+    }
+
+    while (fread(record, sizeof(record), 1, g_pFile) == 1)
+    {
+        uint32_t bytes = getU32(&record[4]);
+        uint64_t cycle = getU64(&record[8]);
+        bool     ok = true;
+
+        switch (record[0])
+        {
+            case REC_EVENT:    ok = addEvent(record, &eventCapacity); break;
+            case REC_KEYFRAME: ok = addKeyframe(cycle, ftell(g_pFile), bytes, &keyframeCapacity); break;
+            case REC_END:      g_endCycle = cycle; return true;
+            default:
+                fprintf(stderr, "movie: unknown record '%c', stopping there\n", record[0]);
+                return true;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "movie: out of memory\n");
+            return false;
+        }
+
+        if ((bytes > 0) && (fseek(g_pFile, bytes, SEEK_CUR) != 0))
+        {
+            break;
+        }
+
+        g_endCycle = cycle;
+    }
+
+    fprintf(stderr, "movie: no end record, the recording was cut short\n");
+    return true;
+}
+
+bool moviePlayStart(const char *pPath)
+{
+    uint8_t header[MOVIE_HEADER_BYTES];
+
+    if (g_recording || g_playing)
+    {
+        fprintf(stderr, "movie: already %s\n", g_recording ? "recording" : "playing");
+        return false;
+    }
+
+    g_pFile = fopen(pPath, "rb");
+
+    if (!g_pFile)
+    {
+        fprintf(stderr, "cannot open movie %s: %s\n", pPath, strerror(errno));
+        return false;
+    }
+
+    if ((fread(header, sizeof(header), 1, g_pFile) != 1) || (memcmp(header, MOVIE_MAGIC, 4) != 0) ||
+        (getU16(&header[4]) != MOVIE_VERSION))
+    {
+        fprintf(stderr, "%s is not a seaboy movie\n", pPath);
+        release();
+        return false;
+    }
+
+    if (!allocBuffers())
+    {
+        release();
+        return false;
+    }
+
+    if (getU32(&header[12]) != g_stateBytes)
+    {
+        fprintf(stderr, "movie %s was recorded by another build of seaboy\n", pPath);
+        release();
+        return false;
+    }
+
+    if (getU64(&header[16]) != romHash())
+    {
+        fprintf(stderr, "movie %s was recorded with another ROM\n", pPath);
+    }
+
+    if ((fread(g_pBase, g_stateBytes, 1, g_pFile) != 1) || !stateLoad(g_pBase, g_stateBytes) || !readRecords())
+    {
+        fprintf(stderr, "cannot load movie %s\n", pPath);
+        release();
+        return false;
+    }
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.events    = g_eventCount;
+    g_stats.keyframes = g_keyframeCount - 1;
+    g_interval        = getU32(&header[8]);
+    g_nextEvent       = 0;
+    g_playing         = true;
+    inputSetLive(false);
+
+    return true;
+}
+
+void movieStop(void)
+{
+    if (g_recording && !g_armed)
+    {
+        writeRecord(REC_END, 0, 0, 0, joypadGetCycle());
+
+        if (!g_failed && (fflush(g_pFile) != 0))
+        {
+            fprintf(stderr, "movie: write failed: %s\n", strerror(errno));
+        }
+    }
+
+    if (g_playing)
+    {
+        inputSetLive(true);
+    }
+
+    release();
+}
+
+bool movieIsRecording(void)
+{
+    return g_recording;
+}
+
+bool movieIsPlaying(void)
+{
+    return g_playing;
+}
+
+void movieRecordInput(uint64_t cycle, uint8_t mask, uint8_t state)
+{
+    if (g_recording && !g_armed)
+    {
+        writeRecord(REC_EVENT, mask, state, 0, cycle);
+        g_stats.events++;
+    }
+}
+
+/**
+ * @brief hand the joypad every event up to a frame ahead, well past JOYPAD_DRAIN_CYCLES
+ */
+static void feed(void)
+{
+    uint64_t horizon = joypadGetCycle() + INPUT_FRAME_CYCLES;
+
+    while ((g_nextEvent < g_eventCount) && (g_pEvents[g_nextEvent].cycle <= horizon))
+    {
+        const SMovieEvent_t *pEvent = &g_pEvents[g_nextEvent];
+
+        if (!inputPush(pEvent->cycle, pEvent->mask, pEvent->state))
+        {
+            break; // the queue is full, try again after the next instruction
+        }
+
+        g_nextEvent++;
+    }
+}
+
+void movieTick(bool eiPending)
+{
+    if (g_playing)
+    {
+        feed();
+
+        if (joypadGetCycle() >= g_endCycle)
+        {
+            movieStop();
+        }
+        return;
+    }
+
+    if (!g_recording || (!g_armed && (joypadGetCycle() < g_nextKeyframe)) || !stateCanSave(eiPending))
+    {
+        return;
+    }
+
+    if (g_armed)
+    {
+        writeStart();
+    }
+    else
+    {
+        writeKeyframe();
+    }
+}
+
+static bool loadKeyframe(const SKeyframe_t *pKeyframe)
+{
+    if (pKeyframe->offset < 0)
+    {
+        return stateLoad(g_pBase, g_stateBytes);
+    }
+
+    if ((pKeyframe->bytes > ((g_stateBytes * 2) + 16)) || (fseek(g_pFile, pKeyframe->offset, SEEK_SET) != 0) ||
+        (fread(g_pPacked, pKeyframe->bytes, 1, g_pFile) != 1) || !unpackKeyframe(g_pPacked, pKeyframe->bytes, g_pState))
+    {
+        fprintf(stderr, "movie: keyframe at cycle %llu is damaged\n", (unsigned long long)pKeyframe->cycle);
+        return false;
+    }
+
+    return stateLoad(g_pState, g_stateBytes);
+}
+
+bool movieSeek(uint64_t frame, bool (*pfnStep)(void))
+{
+    if (!g_playing)
+    {
+        return false;
+    }
+
+    // keyframes are taken by the same rule the seek stops by, so one in the frame is the spot
+    size_t k = g_keyframeCount - 1;
+
+    while ((k > 0) && ((g_pKeyframes[k].cycle / INPUT_FRAME_CYCLES) > frame))
+    {
+        k--;
+    }
+
+    while (!loadKeyframe(&g_pKeyframes[k]))
+    {
+        if (k == 0)
+        {
+            movieStop();
+            return false;
+        }
+
+        k--;
+    }
+
+    uint64_t start = joypadGetCycle();
+    uint64_t target = frame * INPUT_FRAME_CYCLES;
+    bool     eiPending = false;
+
+    g_nextEvent = 0;
+
+    while ((g_nextEvent < g_eventCount) && (g_pEvents[g_nextEvent].cycle <= start))
+    {
+        g_nextEvent++;
+    }
+
+    feed();
+
+    while ((joypadGetCycle() < target) || !stateCanSave(eiPending))
+    {
+        if (joypadGetCycle() >= g_endCycle)
+        {
+            g_stats.seekFrames = (joypadGetCycle() - start) / INPUT_FRAME_CYCLES;
+            movieStop();
+            return false;
+        }
+
+        eiPending = pfnStep();
+        feed();
+    }
+
+    g_stats.seekFrames = (joypadGetCycle() - start) / INPUT_FRAME_CYCLES;
+    return true;
+}
+
+uint64_t movieGetFrame(void)
+{
+    return joypadGetCycle() / INPUT_FRAME_CYCLES;
+}
+
+void movieGetStats(SMovieStats_t *pStats)
+{
+    *pStats = g_stats;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file movie.h
+ * @author Toesoe
+ * @brief seaboy input movies: record, replay, seek
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * a movie is a save state, every button change the joypad applied after it with the T-cycle it
+ * applied at, and a keyframe save state every N frames. the joypad only applies input between
+ * instructions, so replaying the changes at their cycles from the state is bit-exact. there is
+ * no RTC or random source in this core; the seed field is kept for one and is always 0.
+ *
+ * file format, little endian:
+ *   header: "SBMV", u16 version, u16 0, u32 keyframe interval in frames, u32 state bytes,
+ *           u64 ROM hash (XXH64 of 0x0100 -> 0x7FFF), u64 seed
+ *   the starting save state, raw
+ *   records: u8 type, u8 mask, u8 state, u8 0, u32 payload bytes, u64 T-cycle, then the payload
+ *     'E'  a button change, no payload
+ *     'K'  a keyframe: u16 tokens against the starting state until every byte is covered,
+ *          0x0000-0x7FFF keep that many bytes, 0x8000|n n literal bytes follow
+ *     'X'  where the recording stopped, no payload
+ * frames are counted on the joypad clock, INPUT_FRAME_CYCLES each since joypadInit().
+ */
+
+#ifndef _MOVIE_H_
+#define _MOVIE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MOVIE_MAGIC            "SBMV"
+#define MOVIE_VERSION          1
+#define MOVIE_DEFAULT_INTERVAL 600 // frames between keyframes, ten seconds
+
+typedef struct
+{
+    uint64_t events;
+    uint64_t keyframes;
+    uint64_t keyframeBytes; // after delta coding
+    uint64_t seekFrames;    // re-emulated by the last seek
+} SMovieStats_t;
+
+/**
+ * @brief start recording to pPath. the starting state is taken at the next point movieTick()
+ *        allows one, so from power-on call this before the first instruction
+ */
+bool movieRecordStart(const char *, uint32_t);
+
+/**
+ * @brief open pPath and load its starting state. live input is off until playback ends
+ */
+bool moviePlayStart(const char *);
+
+/**
+ * @brief finish the file, or stop playback where it is
+ */
+void movieStop(void);
+
+bool movieIsRecording(void);
+bool movieIsPlaying(void);
+
+/**
+ * @brief for the joypad: buttons changed at a T-cycle
+ */
+void movieRecordInput(uint64_t, uint8_t, uint8_t);
+
+/**
+ * @brief after every instruction, with whether an EI is still waiting to take effect. takes the
+ *        keyframes, feeds the joypad ahead of time, and ends playback
+ */
+void movieTick(bool);
+
+/**
+ * @brief during playback: load the last keyframe at or before a frame and run forward with
+ *        pfnStep to the first instruction boundary of that frame a keyframe could be taken at.
+ *        pfnStep runs one instruction and returns whether an EI is waiting
+ * @return false if the movie ends first; it is left at its end
+ */
+bool movieSeek(uint64_t, bool (*)(void));
+
+/**
+ * @brief the frame the joypad clock is in
+ */
+uint64_t movieGetFrame(void);
+
+void movieGetStats(SMovieStats_t *);
+
+#endif //!_MOVIE_H_
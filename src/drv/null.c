@@ -0,0 +1,58 @@
+/**
+ * @file null.c
+ * @author Toesoe
+ * @brief seaboy null drivers, for running without a display, sound card or keyboard
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "driver.h"
+
+static bool nullStart(void)
+{
+    return true;
+}
+
+static void nullStop(void)
+{
+}
+
+static bool nullAudioStart(uint32_t sampleRate, uint8_t channels)
+{
+    (void)sampleRate;
+    (void)channels;
+    return true;
+}
+
+static void nullAudioQueue(const int16_t *pSamples, size_t frames)
+{
+    (void)pSamples;
+    (void)frames;
+}
+
+static void nullPoll(void)
+{
+}
+
+// no pfnFrameReady: frames still reach the hash log, shm export and recorder, but skip the mailbox
+static const SRenderDriver_t g_nullRenderDriver = { "null", nullStart, nullStop, NULL };
+static const SAudioDriver_t  g_nullAudioDriver  = { "null", nullAudioStart, nullStop, nullAudioQueue };
+static const SInputDriver_t  g_nullInputDriver  = { "null", nullStart, nullStop, nullPoll };
+
+const SRenderDriver_t *pGetNullRenderDriver(void)
+{
+    return &g_nullRenderDriver;
+}
+
+const SAudioDriver_t *pGetNullAudioDriver(void)
+{
+    return &g_nullAudioDriver;
+}
+
+const SInputDriver_t *pGetNullInputDriver(void)
+{
+    return &g_nullInputDriver;
+}
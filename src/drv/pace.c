@@ -0,0 +1,236 @@
+/**
+ * @file pace.c
+ * @author Toesoe
+ * @brief seaboy frame pacing
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the emulation thread does all of it; only the mode is handed over from other threads.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "pace.h"
+#include "render.h"
+#include "audio.h"
+
+// PACE_FRAME_CYCLES at 4.194304 MHz is 16742706 + 153/512 ns
+#define FRAME_NS      16742706ull
+#define FRAME_NS_FRAC 153ull
+#define FRAME_NS_DEN  512ull
+
+#define AUDIO_MAX_WAIT_NS (2 * FRAME_NS)
+
+static atomic_int   g_requested = PACE_REALTIME;
+static EPaceMode_t  g_mode = PACE_REALTIME; // in effect, after falling back
+static bool         g_started = false;
+static uint64_t     g_nextFrameCycle = 0;
+
+static uint64_t     g_baseNs = 0;     // the schedule's start
+static uint64_t     g_scheduled = 0;  // frames since then, realtime
+static uint64_t     g_deadlineNs = 0; // the last frame's deadline
+
+static uint64_t     g_frameEnds[PACE_WINDOW];
+static SPaceStats_t g_stats;
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t deadline)
+{
+    uint64_t        before = nowNs();
+    struct timespec ts = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+
+    if (deadline <= before)
+    {
+        return;
+    }
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+
+    uint64_t after = nowNs();
+
+    g_stats.sleptNs     += after - before;
+    g_stats.oversleepNs += (after > deadline) ? (after - deadline) : 0;
+}
+
+static void restart(uint64_t now)
+{
+    g_baseNs     = now;
+    g_scheduled  = 0;
+    g_deadlineNs = now;
+}
+
+static uint64_t realtimeDeadline(void)
+{
+    g_scheduled++;
+
+    return g_baseNs + (g_scheduled * FRAME_NS) + ((g_scheduled * FRAME_NS_FRAC) / FRAME_NS_DEN);
+}
+
+/**
+ * @brief a refresh after the last deadline, on the grid through the last vsync'd present
+ */
+static uint64_t vsyncDeadline(uint64_t lastPresent, uint64_t period)
+{
+    uint64_t next = g_deadlineNs + period;
+
+    if (next > lastPresent)
+    {
+        next = lastPresent + ((((next - lastPresent) + (period / 2)) / period) * period);
+    }
+
+    return (next > g_deadlineNs) ? next : (next + period);
+}
+
+/**
+ * @brief sleep until the ring has drained to its target. emulation then runs at the rate the
+ *        device consumes samples, and the rate control stays near 1
+ */
+static uint64_t audioDeadline(uint64_t now, uint32_t fill, uint32_t rate)
+{
+    if (fill <= AUDIO_TARGET_FRAMES)
+    {
+        return now;
+    }
+
+    uint64_t wait = ((uint64_t)(fill - AUDIO_TARGET_FRAMES) * 1000000000ull) / rate;
+
+    return now + ((wait < AUDIO_MAX_WAIT_NS) ? wait : AUDIO_MAX_WAIT_NS);
+}
+
+static void frameEnd(void)
+{
+    EPaceMode_t mode = (EPaceMode_t)atomic_load_explicit(&g_requested, memory_order_relaxed);
+    uint64_t    now = nowNs();
+    uint64_t    lastPresent = 0;
+    uint64_t    period = 0;
+    uint32_t    fill = 0;
+    uint32_t    rate = 0;
+
+    if (((mode == PACE_VSYNC) && !renderGetVsync(&lastPresent, &period)) ||
+        ((mode == PACE_AUDIO) && !audioGetRingLevel(&fill, &rate)))
+    {
+        mode = PACE_REALTIME;
+    }
+
+    if (mode != g_mode)
+    {
+        g_mode = mode;
+        g_stats.maxFrameNs = 0;
+        restart(now);
+    }
+
+    uint64_t deadline = now;
+
+    switch (mode)
+    {
+        case PACE_REALTIME: deadline = realtimeDeadline();                 break;
+        case PACE_VSYNC:    deadline = vsyncDeadline(lastPresent, period); break;
+        case PACE_AUDIO:    deadline = audioDeadline(now, fill, rate);     break;
+        default:                                                           break;
+    }
+
+    if (now > (deadline + (PACE_MAX_LAG_FRAMES * FRAME_NS)))
+    {
+        // a stall, a breakpoint, a slow host: carry on from here rather than rush
+        g_stats.resyncs++;
+        restart(now);
+    }
+    else
+    {
+        sleepUntil(deadline);
+        g_deadlineNs = deadline;
+    }
+
+    uint64_t end = nowNs();
+    uint64_t previous = g_frameEnds[(g_stats.frames - 1) & (PACE_WINDOW - 1)];
+
+    if ((g_stats.frames > 0) && ((end - previous) > g_stats.maxFrameNs))
+    {
+        g_stats.maxFrameNs = end - previous;
+    }
+
+    g_frameEnds[g_stats.frames & (PACE_WINDOW - 1)] = end;
+    g_stats.frames++;
+}
+
+void paceSetMode(EPaceMode_t mode)
+{
+    if (mode < PACE_MODE_COUNT)
+    {
+        atomic_store_explicit(&g_requested, mode, memory_order_relaxed);
+    }
+}
+
+EPaceMode_t paceGetMode(void)
+{
+    return (EPaceMode_t)atomic_load_explicit(&g_requested, memory_order_relaxed);
+}
+
+void paceSync(uint64_t cycle)
+{
+    if ((cycle < g_nextFrameCycle) && ((cycle + PACE_FRAME_CYCLES) >= g_nextFrameCycle))
+    {
+        return;
+    }
+
+    if (!g_started || (cycle >= (g_nextFrameCycle + PACE_FRAME_CYCLES)) || (cycle < g_nextFrameCycle))
+    {
+        // first call, or the clock jumped
+        g_started = true;
+        restart(nowNs());
+    }
+    else
+    {
+        frameEnd();
+    }
+
+    g_nextFrameCycle = ((cycle / PACE_FRAME_CYCLES) + 1) * PACE_FRAME_CYCLES;
+}
+
+void paceGetStats(SPaceStats_t *pStats)
+{
+    *pStats = g_stats;
+    pStats->mode = g_mode;
+    pStats->speedPercent = 0.0;
+    pStats->frameNs = 0;
+    pStats->jitterNs = 0;
+
+    uint64_t stamps = (g_stats.frames < PACE_WINDOW) ? g_stats.frames : PACE_WINDOW;
+
+    if (stamps < 2)
+    {
+        return;
+    }
+
+    uint64_t newest = g_stats.frames - 1;
+    uint64_t oldest = g_stats.frames - stamps;
+    uint64_t span = g_frameEnds[newest & (PACE_WINDOW - 1)] - g_frameEnds[oldest & (PACE_WINDOW - 1)];
+    double   mean = (double)span / (double)(stamps - 1);
+    double   variance = 0.0;
+
+    for (uint64_t i = oldest + 1; i <= newest; i++)
+    {
+        double delta = (double)(g_frameEnds[i & (PACE_WINDOW - 1)] - g_frameEnds[(i - 1) & (PACE_WINDOW - 1)]) - mean;
+        variance += delta * delta;
+    }
+
+    pStats->frameNs  = (uint64_t)mean;
+    pStats->jitterNs = (uint64_t)sqrt(variance / (double)(stamps - 1));
+
+    if (span > 0)
+    {
+        pStats->speedPercent = 100.0 * ((double)FRAME_NS + ((double)FRAME_NS_FRAC / FRAME_NS_DEN)) / mean;
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file pace.h
+ * @author Toesoe
+ * @brief seaboy frame pacing
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the emulation runs flat out between frame boundaries and sleeps at each one until the mode
+ * says the next frame may start. deadlines are absolute and exact to the nanosecond over any
+ * run length, so sleeping late once does not add up; falling more than PACE_MAX_LAG_FRAMES
+ * behind restarts the schedule from the present instead of racing to catch up.
+ */
+
+#ifndef _PACE_H_
+#define _PACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PACE_FRAME_CYCLES   70224 // T-cycles per frame, on the joypad clock
+#define PACE_MAX_LAG_FRAMES 4
+#define PACE_WINDOW         64    // frames speed and jitter are measured over, power of two
+
+typedef enum
+{
+    PACE_REALTIME, // 59.73 Hz on CLOCK_MONOTONIC
+    PACE_VSYNC,    // one frame per display refresh, on the vblank grid the window reports. realtime until it does
+    PACE_AUDIO,    // the audio device's clock: wait for the ring to drain to its target. realtime without a pulling driver
+    PACE_TURBO,    // never wait
+    PACE_MODE_COUNT
+} EPaceMode_t;
+
+typedef struct
+{
+    EPaceMode_t mode;        // in effect at the last frame, after falling back
+    uint64_t    frames;
+    double      speedPercent; // emulated time over host time, last PACE_WINDOW frames
+    uint64_t    frameNs;      // mean host time per frame, last PACE_WINDOW frames
+    uint64_t    jitterNs;     // standard deviation of it
+    uint64_t    maxFrameNs;   // longest frame since the mode was set
+    uint64_t    sleptNs;      // time handed back to the host
+    uint64_t    oversleepNs;  // woken after the deadline, summed
+    uint64_t    resyncs;      // schedule restarted after falling behind
+} SPaceStats_t;
+
+/**
+ * @brief any thread. takes effect at the next frame boundary. PACE_REALTIME by default
+ */
+void        paceSetMode(EPaceMode_t);
+EPaceMode_t paceGetMode(void);
+
+/**
+ * @brief the emulation has reached a T-cycle on the joypad clock. at every frame boundary,
+ *        wait as the mode asks. a jump, from a loaded state for instance, restarts the schedule
+ */
+void paceSync(uint64_t);
+
+/**
+ * @brief from the emulation thread
+ */
+void paceGetStats(SPaceStats_t *);
+
+#endif //!_PACE_H_
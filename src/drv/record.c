@@ -0,0 +1,449 @@
+/**
+ * @file record.c
+ * @author Toesoe
+ * @brief seaboy video recorder
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+#include "record.h"
+#include "render.h"
+
+#define FRAME_PIXELS (DISP_WIDTH * DISP_HEIGHT)
+
+#define DELTA_HEADER_BYTES 16
+#define DELTA_RUN_MAX      0x7FFF
+#define DELTA_LITERAL      0x8000
+// every pixel literal costs 4 bytes each, plus the length and a few tokens
+#define DELTA_MAX_BYTES    (FRAME_PIXELS * 4 + 16)
+
+#define WRITE_BUFFER_BYTES (1 << 20)
+
+// 4194304 Hz / 70224 cycles per frame
+#define FPS_NUM 4194304u
+#define FPS_DEN 70224u
+
+// single producer (the emulation thread, which publishes every frame, also the ones a PPU
+// worker rasterized), single consumer (the writer thread).
+// each side only stores its own index; sems wake the other side up.
+static uint32_t    g_queue[RECORD_QUEUE_DEPTH][FRAME_PIXELS];
+static atomic_uint g_head = 0;
+static atomic_uint g_tail = 0;
+static sem_t       g_filled;
+static sem_t       g_freed;
+
+static SRecordConfig_t g_config;
+static FILE           *g_pFile = NULL;
+static pthread_t       g_writer;
+static atomic_bool     g_stopping = false;
+static bool            g_active = false;
+static uint32_t        g_intervalCount = 0;
+static char           *g_pWriteBuffer = NULL;
+
+// writer thread only
+static uint32_t g_prevFrame[FRAME_PIXELS];
+static uint8_t  g_deltaBuffer[DELTA_MAX_BYTES];
+
+static _Atomic uint64_t g_framesQueued;
+static _Atomic uint64_t g_framesWritten;
+static _Atomic uint64_t g_framesDropped;
+static _Atomic uint64_t g_bytesWritten;
+
+static inline void putU16(uint8_t *pDst, uint16_t val)
+{
+    pDst[0] = (uint8_t)val;
+    pDst[1] = (uint8_t)(val >> 8);
+}
+
+static inline void putU32(uint8_t *pDst, uint32_t val)
+{
+    putU16(pDst, (uint16_t)val);
+    putU16(&pDst[2], (uint16_t)(val >> 16));
+}
+
+static inline uint16_t getU16(const uint8_t *pSrc)
+{
+    return (uint16_t)(pSrc[0] | (pSrc[1] << 8));
+}
+
+static inline uint32_t getU32(const uint8_t *pSrc)
+{
+    return getU16(pSrc) | ((uint32_t)getU16(&pSrc[2]) << 16);
+}
+
+static inline uint8_t clampByte(int val)
+{
+    return (val > 255) ? 255 : (uint8_t)val;
+}
+
+size_t recordWriteY4mHeader(FILE *pFile, uint32_t interval)
+{
+    int len = fprintf(pFile, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C444 XCOLORRANGE=FULL\n",
+                      DISP_WIDTH, DISP_HEIGHT, FPS_NUM, FPS_DEN * (interval ? interval : 1));
+
+    return (len > 0) ? (size_t)len : 0;
+}
+
+size_t recordWriteY4mFrame(FILE *pFile, const uint32_t *pFrame)
+{
+    static uint8_t planes[3][FRAME_PIXELS];
+
+    for (size_t i = 0; i < FRAME_PIXELS; i++)
+    {
+        int r = (int)(pFrame[i] >> 24);
+        int g = (int)((pFrame[i] >> 16) & 0xFF);
+        int b = (int)((pFrame[i] >> 8) & 0xFF);
+
+        // full range BT.601, offsets folded in so every shift sees a positive value
+        planes[0][i] = clampByte((77 * r + 150 * g + 29 * b + 128) >> 8);
+        planes[1][i] = clampByte((-43 * r - 85 * g + 128 * b + 32896) >> 8);
+        planes[2][i] = clampByte((128 * r - 107 * g - 21 * b + 32896) >> 8);
+    }
+
+    if ((fputs("FRAME\n", pFile) < 0) || (fwrite(planes, sizeof(planes), 1, pFile) != 1))
+    {
+        return 0;
+    }
+
+    return sizeof(planes) + 6;
+}
+
+static size_t writeDeltaHeader(FILE *pFile, uint32_t interval)
+{
+    uint8_t header[DELTA_HEADER_BYTES] = { 0 };
+
+    memcpy(header, RECORD_DELTA_MAGIC, 4);
+    putU16(&header[4], RECORD_DELTA_VERSION);
+    putU16(&header[6], DISP_WIDTH);
+    putU16(&header[8], DISP_HEIGHT);
+    putU16(&header[10], (uint16_t)interval);
+
+    return (fwrite(header, sizeof(header), 1, pFile) == 1) ? sizeof(header) : 0;
+}
+
+/**
+ * @brief encode pFrame against g_prevFrame into g_deltaBuffer, then make it the previous frame
+ */
+static size_t encodeDelta(const uint32_t *pFrame)
+{
+    size_t len = 4; // payload length goes in front
+    size_t i = 0;
+
+    while (i < FRAME_PIXELS)
+    {
+        size_t run = 0;
+
+        while ((i + run < FRAME_PIXELS) && (run < DELTA_RUN_MAX) && (pFrame[i + run] == g_prevFrame[i + run]))
+        {
+            run++;
+        }
+
+        if (run)
+        {
+            putU16(&g_deltaBuffer[len], (uint16_t)run);
+            len += 2;
+            i += run;
+            continue;
+        }
+
+        while ((i + run < FRAME_PIXELS) && (run < DELTA_RUN_MAX) && (pFrame[i + run] != g_prevFrame[i + run]))
+        {
+            run++;
+        }
+
+        putU16(&g_deltaBuffer[len], (uint16_t)(DELTA_LITERAL | run));
+        len += 2;
+
+        for (size_t j = 0; j < run; j++, len += 4)
+        {
+            putU32(&g_deltaBuffer[len], pFrame[i + j]);
+        }
+
+        i += run;
+    }
+
+    putU32(g_deltaBuffer, (uint32_t)(len - 4));
+    memcpy(g_prevFrame, pFrame, sizeof(g_prevFrame));
+
+    return len;
+}
+
+static size_t writeFrame(const uint32_t *pFrame)
+{
+    switch (g_config.format)
+    {
+        case RECORD_Y4M:
+            return recordWriteY4mFrame(g_pFile, pFrame);
+        case RECORD_DELTA:
+        {
+            size_t len = encodeDelta(pFrame);
+            return (fwrite(g_deltaBuffer, len, 1, g_pFile) == 1) ? len : 0;
+        }
+        default:
+            return (fwrite(pFrame, FRAME_PIXELS * sizeof(uint32_t), 1, g_pFile) == 1) ? FRAME_PIXELS * sizeof(uint32_t) : 0;
+    }
+}
+
+static void *writerThread(void *pArg)
+{
+    (void)pArg;
+
+    for (;;)
+    {
+        while ((sem_wait(&g_filled) == -1) && (errno == EINTR));
+
+        unsigned int tail = atomic_load_explicit(&g_tail, memory_order_relaxed);
+
+        while (tail != atomic_load_explicit(&g_head, memory_order_acquire))
+        {
+            size_t bytes = writeFrame(g_queue[tail % RECORD_QUEUE_DEPTH]);
+
+            if (bytes == 0)
+            {
+                fprintf(stderr, "recorder: write failed: %s\n", strerror(errno));
+            }
+
+            atomic_store_explicit(&g_tail, ++tail, memory_order_release);
+            sem_post(&g_freed);
+
+            atomic_fetch_add_explicit(&g_framesWritten, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&g_bytesWritten, bytes, memory_order_relaxed);
+        }
+
+        if (atomic_load(&g_stopping))
+        {
+            return NULL;
+        }
+    }
+}
+
+bool recordStart(const char *pPath, const SRecordConfig_t *pConfig)
+{
+    if (g_active)
+    {
+        recordStop();
+    }
+
+    g_pFile = fopen(pPath, "wb");
+
+    if (!g_pFile)
+    {
+        fprintf(stderr, "cannot open %s for recording: %s\n", pPath, strerror(errno));
+        return false;
+    }
+
+    g_pWriteBuffer = malloc(WRITE_BUFFER_BYTES);
+
+    if (g_pWriteBuffer)
+    {
+        setvbuf(g_pFile, g_pWriteBuffer, _IOFBF, WRITE_BUFFER_BYTES);
+    }
+
+    g_config = *pConfig;
+    g_intervalCount = 0;
+    memset(g_prevFrame, 0, sizeof(g_prevFrame));
+
+    size_t header = 0;
+    bool   headerOk = true; // raw has no header
+
+    if (g_config.format == RECORD_Y4M)
+    {
+        header = recordWriteY4mHeader(g_pFile, g_config.interval);
+        headerOk = (header != 0);
+    }
+    else if (g_config.format == RECORD_DELTA)
+    {
+        header = writeDeltaHeader(g_pFile, g_config.interval);
+        headerOk = (header != 0);
+    }
+
+    if (!headerOk)
+    {
+        fprintf(stderr, "cannot write recording header to %s\n", pPath);
+        fclose(g_pFile);
+        free(g_pWriteBuffer);
+        g_pWriteBuffer = NULL;
+        return false;
+    }
+
+    atomic_store(&g_head, 0);
+    atomic_store(&g_tail, 0);
+    atomic_store(&g_stopping, false);
+    atomic_store(&g_framesQueued, 0);
+    atomic_store(&g_framesWritten, 0);
+    atomic_store(&g_framesDropped, 0);
+    atomic_store(&g_bytesWritten, header);
+
+    sem_init(&g_filled, 0, 0);
+    sem_init(&g_freed, 0, 0);
+
+    if (pthread_create(&g_writer, NULL, writerThread, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start recorder thread\n");
+        fclose(g_pFile);
+        free(g_pWriteBuffer);
+        g_pWriteBuffer = NULL;
+        return false;
+    }
+
+    g_active = true;
+
+    return true;
+}
+
+void recordStop(void)
+{
+    if (!g_active)
+    {
+        return;
+    }
+
+    atomic_store(&g_stopping, true);
+    sem_post(&g_filled);
+    pthread_join(g_writer, NULL);
+
+    fclose(g_pFile);
+    free(g_pWriteBuffer);
+    g_pFile = NULL;
+    g_pWriteBuffer = NULL;
+
+    sem_destroy(&g_filled);
+    sem_destroy(&g_freed);
+
+    g_active = false;
+}
+
+bool recordIsActive(void)
+{
+    return g_active;
+}
+
+void recordFrame(const uint32_t *pFrame, size_t pitch)
+{
+    if (!g_active)
+    {
+        return;
+    }
+
+    if (g_config.interval > 1)
+    {
+        if (g_intervalCount++ != 0)
+        {
+            g_intervalCount %= g_config.interval;
+            return;
+        }
+    }
+
+    unsigned int head = atomic_load_explicit(&g_head, memory_order_relaxed);
+
+    while ((head - atomic_load_explicit(&g_tail, memory_order_acquire)) >= RECORD_QUEUE_DEPTH)
+    {
+        if (!g_config.blockWhenFull)
+        {
+            atomic_fetch_add_explicit(&g_framesDropped, 1, memory_order_relaxed);
+            return;
+        }
+
+        while ((sem_wait(&g_freed) == -1) && (errno == EINTR));
+    }
+
+    uint32_t *pSlot = g_queue[head % RECORD_QUEUE_DEPTH];
+
+    for (size_t y = 0; y < DISP_HEIGHT; y++)
+    {
+        memcpy(&pSlot[y * DISP_WIDTH], &pFrame[y * pitch], DISP_WIDTH * sizeof(uint32_t));
+    }
+
+    atomic_store_explicit(&g_head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&g_framesQueued, 1, memory_order_relaxed);
+    sem_post(&g_filled);
+}
+
+void recordGetStats(SRecordStats_t *pStats)
+{
+    pStats->framesQueued  = atomic_load_explicit(&g_framesQueued, memory_order_relaxed);
+    pStats->framesWritten = atomic_load_explicit(&g_framesWritten, memory_order_relaxed);
+    pStats->framesDropped = atomic_load_explicit(&g_framesDropped, memory_order_relaxed);
+    pStats->bytesWritten  = atomic_load_explicit(&g_bytesWritten, memory_order_relaxed);
+}
+
+bool recordReadDeltaHeader(FILE *pFile, uint32_t *pInterval)
+{
+    uint8_t header[DELTA_HEADER_BYTES];
+
+    if (fread(header, sizeof(header), 1, pFile) != 1)
+    {
+        return false;
+    }
+
+    if ((memcmp(header, RECORD_DELTA_MAGIC, 4) != 0) || (getU16(&header[4]) != RECORD_DELTA_VERSION) ||
+        (getU16(&header[6]) != DISP_WIDTH) || (getU16(&header[8]) != DISP_HEIGHT))
+    {
+        return false;
+    }
+
+    *pInterval = getU16(&header[10]);
+
+    return true;
+}
+
+bool recordReadDeltaFrame(FILE *pFile, uint32_t *pFrame)
+{
+    static uint8_t payload[DELTA_MAX_BYTES];
+    uint8_t        lenBytes[4];
+
+    if (fread(lenBytes, sizeof(lenBytes), 1, pFile) != 1)
+    {
+        return false;
+    }
+
+    uint32_t len = getU32(lenBytes);
+
+    if ((len > sizeof(payload)) || (fread(payload, len, 1, pFile) != 1))
+    {
+        return false;
+    }
+
+    size_t pos = 0;
+    size_t i = 0;
+
+    while ((i < FRAME_PIXELS) && (pos + 2 <= len))
+    {
+        uint16_t token = getU16(&payload[pos]);
+        size_t   run = token & DELTA_RUN_MAX;
+        pos += 2;
+
+        if (i + run > FRAME_PIXELS)
+        {
+            return false;
+        }
+
+        if (token & DELTA_LITERAL)
+        {
+            if (pos + run * 4 > len)
+            {
+                return false;
+            }
+
+            for (size_t j = 0; j < run; j++, pos += 4)
+            {
+                pFrame[i + j] = getU32(&payload[pos]);
+            }
+        }
+
+        i += run;
+    }
+
+    return (i == FRAME_PIXELS) && (pos == len);
+}
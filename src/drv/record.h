@@ -0,0 +1,83 @@
+/**
+ * @file record.h
+ * @author Toesoe
+ * @brief seaboy video recorder
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * delta stream layout, all little endian:
+ *   header: "SBRV", u16 version, u16 width, u16 height, u16 interval, u32 reserved
+ *   frame:  u32 payload bytes, then u16 tokens until every pixel is covered:
+ *           0x0000-0x7FFF  keep that many pixels from the previous frame
+ *           0x8000|n       n literal pixels follow, u32 RGBA8888 each
+ *   the frame before the first one is all zeroes.
+ */
+
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define RECORD_QUEUE_DEPTH 16
+#define RECORD_DELTA_MAGIC "SBRV"
+#define RECORD_DELTA_VERSION 1
+
+typedef enum
+{
+    RECORD_RAW,   // RGBA8888 frames back to back
+    RECORD_Y4M,   // YUV4MPEG2, 4:4:4, full range BT.601
+    RECORD_DELTA  // lossless delta + RLE, see above
+} ERecordFormat_t;
+
+typedef struct
+{
+    ERecordFormat_t format;
+    uint32_t        interval;      // record every Nth frame, 0 and 1 both mean every frame
+    bool            blockWhenFull; // wait for the writer instead of dropping frames
+} SRecordConfig_t;
+
+typedef struct
+{
+    uint64_t framesQueued;
+    uint64_t framesWritten;
+    uint64_t framesDropped; // queue was full
+    uint64_t bytesWritten;
+} SRecordStats_t;
+
+/**
+ * @brief open pPath and start the writer thread
+ */
+bool recordStart(const char *, const SRecordConfig_t *);
+
+/**
+ * @brief write out everything still queued, stop the writer and close the file
+ */
+void recordStop(void);
+
+bool recordIsActive(void);
+
+/**
+ * @brief queue a finished DISP_WIDTH x DISP_HEIGHT frame with a row pitch in pixels. never touches the disk
+ */
+void recordFrame(const uint32_t *, size_t);
+
+void recordGetStats(SRecordStats_t *);
+
+/**
+ * @brief delta stream reading, for tools. pFrame holds the previous frame on entry
+ */
+bool recordReadDeltaHeader(FILE *, uint32_t *);
+bool recordReadDeltaFrame(FILE *, uint32_t *);
+
+/**
+ * @brief Y4M writing, shared with the converter tool. returns bytes written, 0 on error
+ */
+size_t recordWriteY4mHeader(FILE *, uint32_t);
+size_t recordWriteY4mFrame(FILE *, const uint32_t *);
+
+#endif //!_RECORD_H_
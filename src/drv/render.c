@@ -11,126 +11,334 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <wchar.h>
-
-#include "SDL2/SDL.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "render.h"
+#include "driver.h"
+#include "shmfb.h"
+#include "record.h"
+#include "framehash.h"
+
+#define FRAME_PIXELS (DISP_WIDTH * DISP_HEIGHT)
+
+// mailbox slot layout: buffer index in the low bits, set FRESH when it holds an unshown frame
+#define MAILBOX_IDX_MASK 0x3u
+#define MAILBOX_FRESH    0x4u
+
+#define VSYNC_MIN_NS   4000000  // 250 Hz: anything shorter, present is not waiting for vblank
+#define VSYNC_MAX_NS   42000000 // 24 Hz
+#define VSYNC_STALE_NS 250000000
+
+// RGBA8888, shade 0 (lightest) to shade 3 (darkest)
+static uint32_t g_shades[4] = { 0x9bbc0fFF, 0x8bac0fFF, 0x306230FF, 0x0f380fFF };
+static uint8_t  g_paletteRegs[PALETTE_COUNT];
+static uint32_t g_paletteLut[PALETTE_COUNT][4];
+
+static uint32_t *g_pCallerBuffer = NULL;
+static size_t    g_callerPitch = 0;
+
+// triple buffer: the emulation thread owns g_writeIdx, the driver's present thread owns
+// g_presentIdx, and the third buffer sits in the mailbox. ownership only moves through atomic exchanges.
+static uint32_t         g_frames[3][FRAME_PIXELS];
+static uint64_t         g_frameDoneNs[3];
+static unsigned int     g_writeIdx = 0;
+static unsigned int     g_presentIdx = 1;
+static atomic_uint      g_mailbox = 2;
+
+static _Atomic uint64_t g_framesPublished;
+static _Atomic uint64_t g_framesPresented;
+static _Atomic uint64_t g_framesDropped;
+static _Atomic uint64_t g_lastLatencyNs;
+static _Atomic uint64_t g_maxLatencyNs;
+static _Atomic uint64_t g_totalLatencyNs;
+static _Atomic uint64_t g_framesUnchanged;
+static _Atomic uint64_t g_rowsUploaded;
+static _Atomic uint64_t g_lastPresentNs; // present returned, close to a vblank
+static _Atomic uint64_t g_refreshNs;     // estimated refresh period, 0 until known
+
+static const SRenderDriver_t *g_pDriver = NULL; // NULL: build default, picked in initRenderWindow
+static atomic_bool            g_driverRunning = false;
+static atomic_bool            g_quitRequested = false;
+
+// filter changes are handed to the driver, which owns whatever they resize
+static pthread_mutex_t g_filterLock = PTHREAD_MUTEX_INITIALIZER;
+static SFilterConfig_t g_pendingFilter = { FILTER_NONE, 1, false };
+static bool            g_filterChanged = false;
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static void rebuildLut(EPalette_t palette)
+{
+    renderBuildLut(g_paletteRegs[palette], g_paletteLut[palette]);
+}
 
-ETilePalette_t example_data[DISP_HEIGHT][DISP_WIDTH] = {
-    {BLACK, WHITE, LGRAY, DGRAY, BLACK, WHITE, LGRAY, DGRAY},
-    {WHITE, LGRAY, DGRAY, BLACK, WHITE, LGRAY, DGRAY, BLACK},
-    {LGRAY, DGRAY, BLACK, WHITE, LGRAY, DGRAY, BLACK, WHITE},
-    {DGRAY, BLACK, WHITE, LGRAY, DGRAY, BLACK, WHITE, LGRAY},
-    {BLACK, WHITE, LGRAY, DGRAY, BLACK, WHITE, LGRAY, DGRAY},
-    {WHITE, LGRAY, DGRAY, BLACK, WHITE, LGRAY, DGRAY, BLACK},
-    {LGRAY, DGRAY, BLACK, WHITE, LGRAY, DGRAY, BLACK, WHITE},
-    {DGRAY, BLACK, WHITE, LGRAY, DGRAY, BLACK, WHITE, LGRAY}
-};
+void renderSetTarget(uint32_t *pBuffer, size_t pitch)
+{
+    g_pCallerBuffer = pBuffer;
+    g_callerPitch = pitch;
+}
 
-static ETilePalette_t framebuffer[DISP_HEIGHT][DISP_WIDTH] = { 0 };
-static uint32_t       pixelbuffer[DISP_WIDTH * DISP_HEIGHT];
+void renderSetFilter(const SFilterConfig_t *pConfig)
+{
+    pthread_mutex_lock(&g_filterLock);
+    g_pendingFilter = *pConfig;
+    g_filterChanged = true;
+    pthread_mutex_unlock(&g_filterLock);
+}
 
-static SDL_Window *g_pRenderWindow = NULL;
-static SDL_Renderer *g_pRenderer = NULL;
-static SDL_Texture *g_pFbTexture = NULL;
+void renderSetShades(const uint32_t *pShades)
+{
+    memcpy(g_shades, pShades, sizeof(g_shades));
 
-static uint32_t map_palette_to_rgba(ETilePalette_t color) {
-    switch (color) {
-        case BLACK: return 0x0f380fFF; // Black
-        case LGRAY: return 0x8bac0fFF; // Light Gray
-        case DGRAY: return 0x306230FF; // Dark Gray
-        case WHITE: return 0x9bbc0fFF; // White
-        default:    return 0x9bbc0fFF; // Default to black
+    for (EPalette_t palette = PALETTE_BGP; palette < PALETTE_COUNT; palette++)
+    {
+        rebuildLut(palette);
     }
 }
 
-/**
- * @brief set a pixel value at a specific screen x/y location
- * 
- * @param pPixel pointer to pixel value
- */
-void writeFifoToFramebuffer(SFIFO_t *pFifo, uint8_t xStart, uint8_t y)
+void renderBuildLut(uint8_t reg, uint32_t *pLut)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        pLut[i] = g_shades[(reg >> (i * 2)) & 0x03];
+    }
+}
+
+void renderUpdatePalette(EPalette_t palette, uint8_t reg)
 {
-    // Ensure bounds checking
-    if (xStart + 8 > DISP_WIDTH || y >= DISP_HEIGHT) return;
+    g_paletteRegs[palette] = reg;
+    rebuildLut(palette);
+}
+
+uint32_t *pGetScanline(uint8_t y)
+{
+    if (y >= DISP_HEIGHT)
+    {
+        y = DISP_HEIGHT - 1;
+    }
+
+    if (g_pCallerBuffer)
+    {
+        return &g_pCallerBuffer[y * g_callerPitch];
+    }
 
-    // Copy pixel data from FIFO to framebuffer
-    memcpy(&framebuffer[y][xStart], &pFifo->pixels[pFifo->discardLeft], 8 - pFifo->discardLeft);
+    return &g_frames[g_writeIdx][y * DISP_WIDTH];
 }
 
-void setPixel(SPixel_t *pPixel)
+const uint32_t *pGetPaletteLut(EPalette_t palette)
 {
-    // Ensure bounds checking
-    if (pPixel->x >= DISP_WIDTH || pPixel->y >= DISP_HEIGHT) return;
+    return g_paletteLut[palette];
+}
 
-    // Set pixel value in framebuffer
-    framebuffer[pPixel->y][pPixel->x] = pPixel->color;
+const uint32_t *pGetLineLut(EPalette_t palette, uint8_t reg, uint32_t *pScratch)
+{
+    if (reg == g_paletteRegs[palette])
+    {
+        return g_paletteLut[palette];
+    }
+
+    renderBuildLut(reg, pScratch);
+    return pScratch;
 }
 
-void debugFramebuffer(void)
+void renderEndFrame(void)
 {
-    // Update pixelbuffer from framebuffer
-    for (int y = 0; y < DISP_HEIGHT; ++y) {
-        for (int x = 0; x < DISP_WIDTH; ++x) {
-            pixelbuffer[y * DISP_WIDTH + x] = map_palette_to_rgba(framebuffer[y][x]);
-        }
+    atomic_fetch_add_explicit(&g_framesPublished, 1, memory_order_relaxed);
+
+    const uint32_t *pFrame = g_pCallerBuffer ? g_pCallerBuffer : g_frames[g_writeIdx];
+    const size_t    pitch  = g_pCallerBuffer ? g_callerPitch : DISP_WIDTH;
+
+    if (framehashEnabled())
+    {
+        framehashVideo(pFrame, pitch);
+    }
+
+    if (shmfbIsOpen())
+    {
+        shmfbPublish(pFrame, pitch);
+    }
+
+    if (recordIsActive())
+    {
+        recordFrame(pFrame, pitch);
     }
 
-    // Update texture with pixelbuffer data
-    if (SDL_UpdateTexture(g_pFbTexture, NULL, pixelbuffer, DISP_WIDTH * sizeof(uint32_t)) != 0)
+    if (g_pCallerBuffer || !g_pDriver || !g_pDriver->pfnFrameReady || !atomic_load_explicit(&g_driverRunning, memory_order_relaxed))
     {
-        // Error handling
-        fprintf(stderr, "Texture SDL_Error: %s\n", SDL_GetError());
+        return;
     }
 
-    // Render texture onto window
-    SDL_RenderCopy(g_pRenderer, g_pFbTexture, NULL, NULL);
-    SDL_RenderPresent(g_pRenderer);
+    g_frameDoneNs[g_writeIdx] = nowNs();
+
+    unsigned int slot = atomic_exchange_explicit(&g_mailbox, g_writeIdx | MAILBOX_FRESH, memory_order_acq_rel);
+    g_writeIdx = slot & MAILBOX_IDX_MASK;
+
+    if (slot & MAILBOX_FRESH)
+    {
+        // presenter did not get to the previous frame; it is now our back buffer again
+        atomic_fetch_add_explicit(&g_framesDropped, 1, memory_order_relaxed);
+    }
+
+    g_pDriver->pfnFrameReady();
+}
+
+bool renderQuitRequested(void)
+{
+    return atomic_load_explicit(&g_quitRequested, memory_order_relaxed);
+}
+
+void renderGetStats(SRenderStats_t *pStats)
+{
+    pStats->framesPublished = atomic_load_explicit(&g_framesPublished, memory_order_relaxed);
+    pStats->framesPresented = atomic_load_explicit(&g_framesPresented, memory_order_relaxed);
+    pStats->framesDropped   = atomic_load_explicit(&g_framesDropped, memory_order_relaxed);
+    pStats->lastLatencyNs   = atomic_load_explicit(&g_lastLatencyNs, memory_order_relaxed);
+    pStats->maxLatencyNs    = atomic_load_explicit(&g_maxLatencyNs, memory_order_relaxed);
+    pStats->totalLatencyNs  = atomic_load_explicit(&g_totalLatencyNs, memory_order_relaxed);
+    pStats->framesUnchanged = atomic_load_explicit(&g_framesUnchanged, memory_order_relaxed);
+    pStats->rowsUploaded    = atomic_load_explicit(&g_rowsUploaded, memory_order_relaxed);
+}
+
+void renderSetDriver(const SRenderDriver_t *pDriver)
+{
+    g_pDriver = pDriver;
 }
 
 void initRenderWindow(void)
 {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    if (!g_pDriver)
     {
-        // Error handling
-        fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+#ifdef SEABOY_HEADLESS
+        g_pDriver = pGetNullRenderDriver();
+#else
+        g_pDriver = pGetSdlRenderDriver();
+#endif
+    }
+
+    if (!g_pDriver->pfnStart())
+    {
+        fprintf(stderr, "cannot start %s render driver\n", g_pDriver->pName);
         exit(EXIT_FAILURE);
     }
 
-    g_pRenderWindow = SDL_CreateWindow("Framebuffer Example",
-                                          SDL_WINDOWPOS_UNDEFINED,
-                                          SDL_WINDOWPOS_UNDEFINED,
-                                          DISP_WIDTH * 4,
-                                          DISP_HEIGHT * 4,
-                                          SDL_WINDOW_SHOWN);
+    atomic_store(&g_driverRunning, true);
+}
 
-    if (!g_pRenderWindow) {
-        fprintf(stderr, "Window could not be created! SDL_Error: %s\n", SDL_GetError());
-        SDL_Quit();
-        exit(EXIT_FAILURE);
+void closeRenderWindow(void)
+{
+    if (!atomic_exchange(&g_driverRunning, false))
+    {
+        return;
     }
 
-    g_pRenderer = SDL_CreateRenderer(g_pRenderWindow, -1, SDL_RENDERER_ACCELERATED);
+    g_pDriver->pfnStop();
+}
 
-    if (!g_pRenderer) {
-        fprintf(stderr, "Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
-        SDL_DestroyWindow(g_pRenderWindow);
-        SDL_Quit();
-        exit(EXIT_FAILURE);
+const uint32_t *pRenderAcquireFrame(uint64_t *pDoneNs)
+{
+    if (!(atomic_load_explicit(&g_mailbox, memory_order_acquire) & MAILBOX_FRESH))
+    {
+        return NULL;
     }
 
-    //SDL_RenderSetLogicalSize(g_pRenderer, DISP_WIDTH * 4, DISP_HEIGHT * 4);
+    // only the driver clears FRESH, so the exchange always returns an unshown frame
+    unsigned int slot = atomic_exchange_explicit(&g_mailbox, g_presentIdx, memory_order_acq_rel);
+    g_presentIdx = slot & MAILBOX_IDX_MASK;
 
-    g_pFbTexture = SDL_CreateTexture(g_pRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 160, 144);
+    *pDoneNs = g_frameDoneNs[g_presentIdx];
 
-    if (!g_pFbTexture) {
-        fprintf(stderr, "Texture could not be created! SDL_Error: %s\n", SDL_GetError());
-        SDL_DestroyRenderer(g_pRenderer);
-        SDL_DestroyWindow(g_pRenderWindow);
-        SDL_Quit();
-        exit(EXIT_FAILURE);
+    return g_frames[g_presentIdx];
+}
+
+bool renderTakeFilterChange(SFilterConfig_t *pConfig)
+{
+    pthread_mutex_lock(&g_filterLock);
+    bool changed = g_filterChanged;
+    *pConfig = g_pendingFilter;
+    g_filterChanged = false;
+    pthread_mutex_unlock(&g_filterLock);
+
+    return changed;
+}
+
+/**
+ * @brief a vsync'd present returns at a vblank: the gaps between them, divided by the refreshes
+ *        they span, give the refresh period
+ */
+static void trackVsync(uint64_t now)
+{
+    uint64_t last = atomic_load_explicit(&g_lastPresentNs, memory_order_relaxed);
+    uint64_t period = atomic_load_explicit(&g_refreshNs, memory_order_relaxed);
+    uint64_t delta = now - last;
+
+    atomic_store_explicit(&g_lastPresentNs, now, memory_order_relaxed);
+
+    if ((last == 0) || (delta > (4 * VSYNC_MAX_NS)))
+    {
+        return;
+    }
+
+    if (period == 0)
+    {
+        period = ((delta >= VSYNC_MIN_NS) && (delta <= VSYNC_MAX_NS)) ? delta : 0;
+    }
+    else
+    {
+        uint64_t spans = (delta + (period / 2)) / period;
+        uint64_t sample = (spans > 0) ? (delta / spans) : 0;
+
+        if ((sample >= VSYNC_MIN_NS) && (sample <= VSYNC_MAX_NS))
+        {
+            period = (uint64_t)((int64_t)period + (((int64_t)sample - (int64_t)period) / 16));
+        }
+    }
+
+    atomic_store_explicit(&g_refreshNs, period, memory_order_relaxed);
+}
+
+void renderCountPresented(uint64_t doneNs)
+{
+    uint64_t now = nowNs();
+    uint64_t latency = now - doneNs;
+
+    trackVsync(now);
+
+    atomic_fetch_add_explicit(&g_framesPresented, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_totalLatencyNs, latency, memory_order_relaxed);
+    atomic_store_explicit(&g_lastLatencyNs, latency, memory_order_relaxed);
+
+    if (latency > atomic_load_explicit(&g_maxLatencyNs, memory_order_relaxed))
+    {
+        atomic_store_explicit(&g_maxLatencyNs, latency, memory_order_relaxed);
     }
+}
+
+bool renderGetVsync(uint64_t *pLastNs, uint64_t *pPeriodNs)
+{
+    *pLastNs   = atomic_load_explicit(&g_lastPresentNs, memory_order_relaxed);
+    *pPeriodNs = atomic_load_explicit(&g_refreshNs, memory_order_relaxed);
+
+    return (*pPeriodNs != 0) && ((nowNs() - *pLastNs) < VSYNC_STALE_NS);
+}
 
-    memset(pixelbuffer, 0xFFFFFFFF, DISP_WIDTH * DISP_HEIGHT * sizeof(uint32_t));
-}
\ No newline at end of file
+void renderCountUnchanged(void)
+{
+    atomic_fetch_add_explicit(&g_framesUnchanged, 1, memory_order_relaxed);
+}
+
+void renderCountRowsUploaded(size_t rows)
+{
+    atomic_fetch_add_explicit(&g_rowsUploaded, rows, memory_order_relaxed);
+}
+
+void renderRequestQuit(void)
+{
+    atomic_store(&g_quitRequested, true);
+}
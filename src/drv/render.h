@@ -17,22 +17,121 @@
 #include <stdbool.h>
 
 #include "../hw/ppu.h"
+#include "filter.h"
+#include "driver.h"
 
 #define DISP_WIDTH  160
 #define DISP_HEIGHT 144
 
-typedef struct {
-    size_t x;
-    size_t y;
-    ETilePalette_t color;
-} SPixel_t;
+typedef enum
+{
+    PALETTE_BGP = 0, // 0xFF47
+    PALETTE_OBP0,    // 0xFF48
+    PALETTE_OBP1,    // 0xFF49
+    PALETTE_COUNT
+} EPalette_t;
 
-void writeFifoToFramebuffer(SFIFO_t *, uint8_t, uint8_t);
-void setPixel(SPixel_t *);
+typedef struct
+{
+    uint64_t framesPublished; // frames completed by the PPU
+    uint64_t framesPresented; // frames shown by the present thread
+    uint64_t framesDropped;   // frames replaced in the mailbox before they were shown
+    uint64_t lastLatencyNs;   // frame completion -> present returned, last shown frame
+    uint64_t maxLatencyNs;
+    uint64_t totalLatencyNs;  // divide by framesPresented for the average
+    uint64_t framesUnchanged; // frames identical to the texture, not uploaded or presented
+    uint64_t rowsUploaded;    // native rows sent to the texture
+} SRenderStats_t;
 
-void debugFramebuffer(void);
+/**
+ * @brief pick the render driver before initRenderWindow. default is SDL, or null in headless builds
+ */
+void renderSetDriver(const SRenderDriver_t *);
 
 void initRenderWindow(void);
+void closeRenderWindow(void);
 void renderWindow(void);
 
-#endif //!_RENDER_H_
\ No newline at end of file
+/**
+ * @brief true once the user closed the window
+ */
+bool renderQuitRequested(void);
+
+/**
+ * @brief snapshot the frame handoff counters
+ */
+void renderGetStats(SRenderStats_t *);
+
+/**
+ * @brief when the window last presented (CLOCK_MONOTONIC) and the refresh period measured from
+ *        its vsync'd presents
+ * @return false until a period is known, or when nothing was presented for a while
+ */
+bool renderGetVsync(uint64_t *, uint64_t *);
+
+/**
+ * @brief render into a caller-owned buffer instead of the SDL texture
+ * 
+ * buffer must hold DISP_HEIGHT rows of (pitch) pixels. pass NULL to go back to the texture.
+ */
+void renderSetTarget(uint32_t *, size_t);
+
+/**
+ * @brief pick the upscaling filter for the window. takes effect on the next presented frame
+ */
+void renderSetFilter(const SFilterConfig_t *);
+
+/**
+ * @brief set the four host-format colors for DMG shades 0 (lightest) to 3 (darkest)
+ */
+void renderSetShades(const uint32_t *);
+
+/**
+ * @brief rebuild the color lookup table for a palette register
+ */
+void renderUpdatePalette(EPalette_t, uint8_t);
+
+/**
+ * @brief fill a 4-entry color index -> host pixel table for an arbitrary palette value
+ */
+void renderBuildLut(uint8_t, uint32_t *);
+
+/**
+ * @brief retrieve ptr to the start of a scanline in the current frame target
+ */
+uint32_t *pGetScanline(uint8_t);
+
+/**
+ * @brief retrieve the 4-entry color index -> host pixel table for a palette
+ */
+const uint32_t *pGetPaletteLut(EPalette_t);
+
+/**
+ * @brief the table for a palette value latched earlier: the cached one while the register still
+ *        holds it, else one built into the caller's 4-entry scratch table
+ */
+const uint32_t *pGetLineLut(EPalette_t, uint8_t, uint32_t *);
+
+/**
+ * @brief hand the finished frame to the present thread. never blocks
+ */
+void renderEndFrame(void);
+
+// for render drivers
+
+/**
+ * @brief newest unshown frame and its completion time, or NULL. valid until the next call
+ */
+const uint32_t *pRenderAcquireFrame(uint64_t *);
+
+/**
+ * @brief fetch a filter change made with renderSetFilter, if there is one
+ */
+bool renderTakeFilterChange(SFilterConfig_t *);
+
+void renderCountPresented(uint64_t);
+void renderCountUnchanged(void);
+void renderCountRowsUploaded(size_t);
+void renderRequestQuit(void);
+
+#endif //!_RENDER_H_
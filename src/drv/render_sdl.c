@@ -0,0 +1,443 @@
+/**
+ * @file render_sdl.c
+ * @author Toesoe
+ * @brief seaboy SDL render driver
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <errno.h>
+
+#include "SDL2/SDL.h"
+
+#include "render.h"
+#include "input.h"
+#include "driver.h"
+
+#define FRAME_PIXELS (DISP_WIDTH * DISP_HEIGHT)
+
+#define PRESENT_POLL_NS 4000000 // wake up at least this often to pump window events
+
+#define ROW_HASH_MULT 0x9E3779B97F4A7C15ull
+
+static pthread_t   g_presentThread;
+static sem_t       g_frameReady;
+static sem_t       g_presenterUp;
+static atomic_bool g_presenterRunning = false;
+
+static SDL_Window *g_pRenderWindow = NULL;
+static SDL_Renderer *g_pRenderer = NULL;
+static SDL_Texture *g_pFbTexture = NULL;
+
+// everything below is owned by the present thread
+static bool     g_filterActive = false;
+static bool     g_filterGhosting = false;
+static uint8_t  g_textureScale = 1;
+static uint32_t g_filtered[FRAME_PIXELS * FILTER_MAX_SCALE * FILTER_MAX_SCALE];
+
+// row hashes of what the texture currently holds
+static uint64_t g_shownRowHash[DISP_HEIGHT];
+static bool     g_textureStale = true; // next frame uploads every row
+static bool     g_exposed = false;     // window needs repainting even without a new frame
+
+static uint8_t keyToButton(SDL_Keycode key)
+{
+    switch (key)
+    {
+        case SDLK_RIGHT:     return INPUT_RIGHT;
+        case SDLK_LEFT:      return INPUT_LEFT;
+        case SDLK_UP:        return INPUT_UP;
+        case SDLK_DOWN:      return INPUT_DOWN;
+        case SDLK_x:         return INPUT_A;
+        case SDLK_z:         return INPUT_B;
+        case SDLK_BACKSPACE: return INPUT_SELECT;
+        case SDLK_RETURN:    return INPUT_START;
+        default:             return 0;
+    }
+}
+
+/**
+ * @brief window events, keys included: SDL only pumps them on the thread that made the window,
+ *        so key changes go into the input queue from here, stamped INPUT_NOW
+ */
+static void pollWindowEvents(void)
+{
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event))
+    {
+        if (event.type == SDL_QUIT)
+        {
+            renderRequestQuit();
+        }
+        else if (((event.type == SDL_KEYDOWN) || (event.type == SDL_KEYUP)) && !event.key.repeat)
+        {
+            uint8_t button = keyToButton(event.key.keysym.sym);
+
+            if (button)
+            {
+                inputPush(INPUT_NOW, button, (event.type == SDL_KEYDOWN) ? button : 0);
+            }
+        }
+        else if ((event.type == SDL_WINDOWEVENT) &&
+                 ((event.window.event == SDL_WINDOWEVENT_EXPOSED) || (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)))
+        {
+            g_exposed = true;
+        }
+    }
+}
+
+/**
+ * @brief apply a pending filter change, recreating the texture if the output size moved
+ */
+static void updateFilter(void)
+{
+    SFilterConfig_t config;
+
+    if (!renderTakeFilterChange(&config))
+    {
+        return;
+    }
+
+    filterConfigure(&config);
+    g_filterActive = (config.type != FILTER_NONE) || config.ghosting;
+    g_filterGhosting = config.ghosting;
+    g_textureStale = true;
+
+    uint8_t scale = filterGetScale();
+
+    if (scale == g_textureScale)
+    {
+        return;
+    }
+
+    SDL_Texture *pTexture = SDL_CreateTexture(g_pRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                              DISP_WIDTH * scale, DISP_HEIGHT * scale);
+
+    if (!pTexture)
+    {
+        fprintf(stderr, "Texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        // keep the old texture and fill it with plain nearest instead
+        config = (SFilterConfig_t){ FILTER_NEAREST, g_textureScale, false };
+        filterConfigure(&config);
+        g_filterActive = (g_textureScale != 1);
+        g_filterGhosting = false;
+        return;
+    }
+
+    SDL_DestroyTexture(g_pFbTexture);
+    g_pFbTexture = pTexture;
+    g_textureScale = scale;
+}
+
+static uint64_t hashRow(const uint32_t *pRow)
+{
+    uint64_t hash = 0;
+
+    for (size_t i = 0; i < DISP_WIDTH; i += 2)
+    {
+        uint64_t word;
+        memcpy(&word, &pRow[i], sizeof(word));
+        hash = (hash ^ word) * ROW_HASH_MULT;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief hash every row of a frame against what the texture holds
+ * 
+ * @return number of changed rows, flagged in pDirty; [*pFirst, *pLast] spans them
+ */
+static size_t findDirtyRows(const uint32_t *pFrame, bool *pDirty, size_t *pFirst, size_t *pLast)
+{
+    size_t dirty = 0;
+
+    for (size_t y = 0; y < DISP_HEIGHT; y++)
+    {
+        uint64_t hash = hashRow(&pFrame[y * DISP_WIDTH]);
+
+        pDirty[y] = g_textureStale || (hash != g_shownRowHash[y]);
+
+        if (pDirty[y])
+        {
+            g_shownRowHash[y] = hash;
+
+            if (dirty++ == 0)
+            {
+                *pFirst = y;
+            }
+
+            *pLast = y;
+        }
+    }
+
+    g_textureStale = false;
+
+    return dirty;
+}
+
+/**
+ * @brief upload native rows [first, last] to the texture, one call per run of changed rows
+ */
+static void uploadDirtyRows(const uint32_t *pFrame, size_t first, size_t last, const bool *pDirty)
+{
+    size_t y = first;
+
+    while (y <= last)
+    {
+        if (!pDirty[y])
+        {
+            y++;
+            continue;
+        }
+
+        size_t runStart = y;
+
+        while ((y <= last) && pDirty[y])
+        {
+            y++;
+        }
+
+        SDL_Rect rect = { 0, (int)runStart, DISP_WIDTH, (int)(y - runStart) };
+
+        if (SDL_UpdateTexture(g_pFbTexture, &rect, &pFrame[runStart * DISP_WIDTH], DISP_WIDTH * sizeof(uint32_t)) != 0)
+        {
+            fprintf(stderr, "Texture SDL_Error: %s\n", SDL_GetError());
+        }
+
+        renderCountRowsUploaded(y - runStart);
+    }
+}
+
+/**
+ * @brief filter a frame and upload the output rows that can differ from the last upload
+ */
+static void uploadFiltered(const uint32_t *pFrame, size_t first, size_t last)
+{
+    filterApply(pFrame, g_filtered);
+
+    // output rows also depend on up to FILTER_REACH native rows either side
+    first = (first > FILTER_REACH) ? first - FILTER_REACH : 0;
+    last  = (last + FILTER_REACH < DISP_HEIGHT) ? last + FILTER_REACH : DISP_HEIGHT - 1;
+
+    if (g_filterGhosting)
+    {
+        // the blend keeps moving after the source settles
+        first = 0;
+        last  = DISP_HEIGHT - 1;
+    }
+
+    const size_t outWidth = (size_t)DISP_WIDTH * g_textureScale;
+    SDL_Rect     rect = { 0, (int)(first * g_textureScale), (int)outWidth, (int)((last - first + 1) * g_textureScale) };
+
+    if (SDL_UpdateTexture(g_pFbTexture, &rect, &g_filtered[first * g_textureScale * outWidth], (int)(outWidth * sizeof(uint32_t))) != 0)
+    {
+        fprintf(stderr, "Texture SDL_Error: %s\n", SDL_GetError());
+    }
+
+    renderCountRowsUploaded(last - first + 1);
+}
+
+static void repaint(void)
+{
+    SDL_RenderCopy(g_pRenderer, g_pFbTexture, NULL, NULL);
+    SDL_RenderPresent(g_pRenderer);
+    g_exposed = false;
+}
+
+/**
+ * @brief take the newest frame out of the mailbox, if there is one, and show it.
+ *        only rows that changed since the last upload are sent, and identical frames are not presented
+ */
+static void presentNewestFrame(void)
+{
+    uint64_t        doneNs = 0;
+    const uint32_t *pFrame = pRenderAcquireFrame(&doneNs);
+
+    if (!pFrame)
+    {
+        if (g_exposed)
+        {
+            repaint();
+        }
+
+        return;
+    }
+
+    bool            dirty[DISP_HEIGHT];
+    size_t          first = 0, last = 0;
+    size_t          dirtyRows = findDirtyRows(pFrame, dirty, &first, &last);
+
+    if ((dirtyRows == 0) && !g_filterGhosting)
+    {
+        renderCountUnchanged();
+
+        if (g_exposed)
+        {
+            repaint();
+        }
+
+        return;
+    }
+
+    if (g_filterActive)
+    {
+        uploadFiltered(pFrame, first, last);
+    }
+    else
+    {
+        uploadDirtyRows(pFrame, first, last, dirty);
+    }
+
+    repaint();
+
+    renderCountPresented(doneNs);
+}
+
+static bool createWindow(void)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        // Error handling
+        fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+        return false;
+    }
+
+    g_pRenderWindow = SDL_CreateWindow("Framebuffer Example",
+                                          SDL_WINDOWPOS_UNDEFINED,
+                                          SDL_WINDOWPOS_UNDEFINED,
+                                          DISP_WIDTH * 4,
+                                          DISP_HEIGHT * 4,
+                                          SDL_WINDOW_SHOWN);
+
+    if (!g_pRenderWindow) {
+        fprintf(stderr, "Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_Quit();
+        return false;
+    }
+
+    g_pRenderer = SDL_CreateRenderer(g_pRenderWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+    if (!g_pRenderer) {
+        fprintf(stderr, "Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_DestroyWindow(g_pRenderWindow);
+        SDL_Quit();
+        return false;
+    }
+
+    //SDL_RenderSetLogicalSize(g_pRenderer, DISP_WIDTH * 4, DISP_HEIGHT * 4);
+
+    g_pFbTexture = SDL_CreateTexture(g_pRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, DISP_WIDTH, DISP_HEIGHT);
+
+    if (!g_pFbTexture) {
+        fprintf(stderr, "Texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(g_pRenderer);
+        SDL_DestroyWindow(g_pRenderWindow);
+        SDL_Quit();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief present thread. owns every SDL object, so SDL is never touched from the emulation thread
+ */
+static void *presentThread(void *pArg)
+{
+    (void)pArg;
+
+    bool ok = createWindow();
+    atomic_store(&g_presenterRunning, ok);
+    g_textureScale = 1;
+    g_textureStale = true;
+    sem_post(&g_presenterUp);
+
+    if (!ok)
+    {
+        return NULL;
+    }
+
+    while (atomic_load(&g_presenterRunning))
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += PRESENT_POLL_NS;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while ((sem_timedwait(&g_frameReady, &deadline) == -1) && (errno == EINTR));
+
+        pollWindowEvents();
+        updateFilter();
+        presentNewestFrame();
+    }
+
+    SDL_DestroyTexture(g_pFbTexture);
+    SDL_DestroyRenderer(g_pRenderer);
+    SDL_DestroyWindow(g_pRenderWindow);
+    SDL_Quit();
+
+    return NULL;
+}
+
+static bool sdlStart(void)
+{
+    sem_init(&g_frameReady, 0, 0);
+    sem_init(&g_presenterUp, 0, 0);
+
+    if (pthread_create(&g_presentThread, NULL, presentThread, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start present thread\n");
+        return false;
+    }
+
+    while ((sem_wait(&g_presenterUp) == -1) && (errno == EINTR));
+
+    if (!atomic_load(&g_presenterRunning))
+    {
+        pthread_join(g_presentThread, NULL);
+        return false;
+    }
+
+    return true;
+}
+
+static void sdlStop(void)
+{
+    if (!atomic_exchange(&g_presenterRunning, false))
+    {
+        return;
+    }
+
+    sem_post(&g_frameReady);
+    pthread_join(g_presentThread, NULL);
+}
+
+static void sdlFrameReady(void)
+{
+    sem_post(&g_frameReady);
+}
+
+static const SRenderDriver_t g_sdlRenderDriver = {
+    "sdl", sdlStart, sdlStop, sdlFrameReady
+};
+
+const SRenderDriver_t *pGetSdlRenderDriver(void)
+{
+    return &g_sdlRenderDriver;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file shmfb.c
+ * @author Toesoe
+ * @brief seaboy shared-memory framebuffer export
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmfb.h"
+#include "render.h"
+
+#define SLOT_ALIGN 64
+
+static SShmFbHeader_t *g_pHeader = NULL;
+static uint8_t        *g_pSlots = NULL;
+static size_t          g_mapBytes = 0;
+static uint64_t        g_frame = 0;
+static char            g_name[64];
+
+_Static_assert(sizeof(SShmFbHeader_t) == 64, "shm header layout is shared with other processes");
+_Static_assert(sizeof(SShmFbSlot_t) == 64, "shm slot layout is shared with other processes");
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+bool shmfbOpen(const char *pName, uint32_t slots)
+{
+    if (g_pHeader)
+    {
+        shmfbClose();
+    }
+
+    if (slots < SHMFB_SLOTS_MIN)
+    {
+        slots = SHMFB_SLOTS_MIN;
+    }
+    else if (slots > SHMFB_SLOTS_MAX)
+    {
+        slots = SHMFB_SLOTS_MAX;
+    }
+
+    const uint32_t stride    = DISP_WIDTH * sizeof(uint32_t);
+    const uint32_t slotBytes = (sizeof(SShmFbSlot_t) + (stride * DISP_HEIGHT) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1u);
+    const size_t   mapBytes  = sizeof(SShmFbHeader_t) + ((size_t)slotBytes * slots);
+
+    int fd = shm_open(pName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "shm_open %s failed: %s\n", pName, strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(fd, (off_t)mapBytes) != 0)
+    {
+        fprintf(stderr, "cannot size shm %s: %s\n", pName, strerror(errno));
+        close(fd);
+        shm_unlink(pName);
+        return false;
+    }
+
+    void *pMap = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (pMap == MAP_FAILED)
+    {
+        fprintf(stderr, "cannot map shm %s: %s\n", pName, strerror(errno));
+        shm_unlink(pName);
+        return false;
+    }
+
+    g_pHeader  = (SShmFbHeader_t *)pMap;
+    g_pSlots   = (uint8_t *)pMap + sizeof(SShmFbHeader_t);
+    g_mapBytes = mapBytes;
+    g_frame    = 0;
+    snprintf(g_name, sizeof(g_name), "%s", pName);
+
+    // ftruncate zero-filled the object, so every slot seq and latestFrame start at 0
+    g_pHeader->version   = SHMFB_VERSION;
+    g_pHeader->width     = DISP_WIDTH;
+    g_pHeader->height    = DISP_HEIGHT;
+    g_pHeader->stride    = stride;
+    g_pHeader->format    = SHMFB_FORMAT_RGBA8888;
+    g_pHeader->slotCount = slots;
+    g_pHeader->slotBytes = slotBytes;
+
+    // magic goes last: a reader that sees it can trust the rest of the header
+    atomic_thread_fence(memory_order_release);
+    g_pHeader->magic = SHMFB_MAGIC;
+
+    return true;
+}
+
+void shmfbClose(void)
+{
+    if (!g_pHeader)
+    {
+        return;
+    }
+
+    munmap(g_pHeader, g_mapBytes);
+    shm_unlink(g_name);
+
+    g_pHeader = NULL;
+    g_pSlots  = NULL;
+}
+
+bool shmfbIsOpen(void)
+{
+    return g_pHeader != NULL;
+}
+
+void shmfbPublish(const uint32_t *pFrame, size_t pitch)
+{
+    if (!g_pHeader)
+    {
+        return;
+    }
+
+    g_frame++;
+
+    uint8_t      *pSlotBase = &g_pSlots[(size_t)(g_frame % g_pHeader->slotCount) * g_pHeader->slotBytes];
+    SShmFbSlot_t *pSlot     = (SShmFbSlot_t *)pSlotBase;
+    uint32_t     *pPixels   = (uint32_t *)(pSlotBase + sizeof(SShmFbSlot_t));
+
+    // odd: readers must not trust this slot until it is even again
+    uint64_t seq = atomic_load_explicit(&pSlot->seq, memory_order_relaxed) + 1;
+    atomic_store_explicit(&pSlot->seq, seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (pitch == DISP_WIDTH)
+    {
+        memcpy(pPixels, pFrame, DISP_WIDTH * DISP_HEIGHT * sizeof(uint32_t));
+    }
+    else
+    {
+        for (size_t y = 0; y < DISP_HEIGHT; y++)
+        {
+            memcpy(&pPixels[y * DISP_WIDTH], &pFrame[y * pitch], DISP_WIDTH * sizeof(uint32_t));
+        }
+    }
+
+    pSlot->frame       = g_frame;
+    pSlot->timestampNs = nowNs();
+
+    atomic_store_explicit(&pSlot->seq, seq + 1, memory_order_release);
+    atomic_store_explicit(&g_pHeader->latestFrame, g_frame, memory_order_release);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file shmfb.h
+ * @author Toesoe
+ * @brief seaboy shared-memory framebuffer export
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * frames are published into a POSIX shm object made of one SShmFbHeader_t followed by
+ * slotCount slots of slotBytes each. a slot is an SShmFbSlot_t and then height rows of
+ * stride bytes, RGBA8888 in host byte order.
+ *
+ * writer, per frame: pick slot (frame % slotCount), bump its seq to odd, write the pixels,
+ * bump seq to even, then store the frame number in latestFrame.
+ *
+ * reader: load latestFrame (0 = nothing yet), go to slot (latestFrame % slotCount), load seq,
+ * skip the slot if it is odd, use the pixels in place, then load seq again. if it moved, the
+ * writer lapped the ring while the pixels were being read, and they must be thrown away.
+ */
+
+#ifndef _SHMFB_H_
+#define _SHMFB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define SHMFB_MAGIC         0x53424642u // "SBFB"
+#define SHMFB_VERSION       1
+#define SHMFB_SLOTS_MIN     2
+#define SHMFB_SLOTS_MAX     64
+#define SHMFB_SLOTS_DEFAULT 4
+#define SHMFB_FORMAT_RGBA8888 0
+
+typedef struct
+{
+    uint32_t         magic;
+    uint32_t         version;
+    uint32_t         width;
+    uint32_t         height;
+    uint32_t         stride;     // bytes per row
+    uint32_t         format;     // SHMFB_FORMAT_*
+    uint32_t         slotCount;
+    uint32_t         slotBytes;  // slot header plus pixels, multiple of 64
+    _Atomic uint64_t latestFrame; // newest complete frame, counting from 1
+    uint8_t          reserved[24];
+} SShmFbHeader_t;
+
+typedef struct
+{
+    _Atomic uint64_t seq;         // odd while the writer is in the slot
+    uint64_t         frame;       // frame number held by the slot
+    uint64_t         timestampNs; // CLOCK_MONOTONIC when the frame was published
+    uint8_t          reserved[40];
+} SShmFbSlot_t;
+
+/**
+ * @brief create (or replace) the shm object pName, e.g. "/seaboy-0", with the given ring depth
+ */
+bool shmfbOpen(const char *, uint32_t);
+
+/**
+ * @brief unmap and unlink the shm object
+ */
+void shmfbClose(void);
+
+bool shmfbIsOpen(void);
+
+/**
+ * @brief copy a finished DISP_WIDTH x DISP_HEIGHT frame, with a row pitch in pixels, into the ring
+ */
+void shmfbPublish(const uint32_t *, size_t);
+
+#endif //!_SHMFB_H_
@@ -0,0 +1,377 @@
+/**
+ * @file trace.c
+ * @author Toesoe
+ * @brief seaboy event tracing
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * each ring has one producer, the thread that owns it, and one consumer, the drain thread.
+ * rings are created on a thread's first event and never freed, so a thread still emitting
+ * while the trace closes writes into memory that stays valid; the next open skips it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define DRAIN_BATCH    4096
+#define DRAIN_IDLE_NS  1000000
+
+typedef struct
+{
+    uint64_t cycle;
+    uint32_t b;
+    uint16_t a;
+    uint8_t  event;
+} STraceRecord_t;
+
+typedef struct
+{
+    _Alignas(64) atomic_uint head; // the owning thread's
+    uint32_t                 cachedTail;
+    atomic_uint_fast64_t     dropped;
+    _Alignas(64) atomic_uint tail; // the drain thread's
+    uint8_t                  thread;
+    STraceRecord_t           aRecords[TRACE_RING_RECORDS];
+} STraceRing_t;
+
+atomic_uint g_traceMask = 0;
+
+static _Atomic(STraceRing_t *) g_rings[TRACE_MAX_THREADS];
+static atomic_uint             g_ringCount = 0;
+static atomic_uint_fast64_t    g_unattached = 0; // dropped from threads past TRACE_MAX_THREADS
+
+static _Thread_local STraceRing_t *t_pRing = NULL;
+static _Thread_local bool          t_refused = false;
+
+static FILE       *g_pFile = NULL;
+static pthread_t   g_drainer;
+static atomic_bool g_open = false;
+static atomic_bool g_draining = false;
+static uint64_t    g_written = 0;
+static uint8_t     g_batch[DRAIN_BATCH * TRACE_RECORD_BYTES];
+
+static const char *g_categoryNames[TRACE_CATEGORY_COUNT] = { "cpu", "irq", "mem", "mbc", "ppu", "input" };
+
+static inline void putU16(uint8_t *pDst, uint16_t val)
+{
+    pDst[0] = (uint8_t)val;
+    pDst[1] = (uint8_t)(val >> 8);
+}
+
+static inline void putU32(uint8_t *pDst, uint32_t val)
+{
+    putU16(pDst, (uint16_t)val);
+    putU16(pDst + 2, (uint16_t)(val >> 16));
+}
+
+static inline void putU64(uint8_t *pDst, uint64_t val)
+{
+    putU32(pDst, (uint32_t)val);
+    putU32(pDst + 4, (uint32_t)(val >> 32));
+}
+
+static STraceRing_t *pAttachThread(void)
+{
+    if (t_refused)
+    {
+        return NULL;
+    }
+
+    unsigned int index = atomic_fetch_add(&g_ringCount, 1);
+
+    if (index >= TRACE_MAX_THREADS)
+    {
+        t_refused = true;
+        return NULL;
+    }
+
+    STraceRing_t *pRing = aligned_alloc(64, sizeof(STraceRing_t));
+
+    if (!pRing)
+    {
+        t_refused = true;
+        return NULL;
+    }
+
+    atomic_init(&pRing->head, 0);
+    atomic_init(&pRing->tail, 0);
+    atomic_init(&pRing->dropped, 0);
+    pRing->cachedTail = 0;
+    pRing->thread = (uint8_t)index;
+
+    atomic_store_explicit(&g_rings[index], pRing, memory_order_release);
+    t_pRing = pRing;
+
+    return pRing;
+}
+
+void traceEmit(uint8_t event, uint64_t cycle, uint16_t a, uint32_t b)
+{
+    STraceRing_t *pRing = t_pRing ? t_pRing : pAttachThread();
+
+    if (!pRing)
+    {
+        atomic_fetch_add_explicit(&g_unattached, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint32_t head = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+
+    if ((head - pRing->cachedTail) >= TRACE_RING_RECORDS)
+    {
+        // only look at the drain thread's line when the stale view says full
+        pRing->cachedTail = atomic_load_explicit(&pRing->tail, memory_order_acquire);
+
+        if ((head - pRing->cachedTail) >= TRACE_RING_RECORDS)
+        {
+            atomic_fetch_add_explicit(&pRing->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    STraceRecord_t *pRecord = &pRing->aRecords[head & (TRACE_RING_RECORDS - 1)];
+
+    pRecord->cycle = cycle;
+    pRecord->b     = b;
+    pRecord->a     = a;
+    pRecord->event = event;
+
+    atomic_store_explicit(&pRing->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief write what every ring holds now
+ * @return records written
+ */
+static size_t drainRings(void)
+{
+    unsigned int rings = atomic_load(&g_ringCount);
+    size_t       total = 0;
+
+    for (unsigned int i = 0; (i < rings) && (i < TRACE_MAX_THREADS); i++)
+    {
+        STraceRing_t *pRing = atomic_load_explicit(&g_rings[i], memory_order_acquire);
+
+        if (!pRing)
+        {
+            continue;
+        }
+
+        uint32_t tail = atomic_load_explicit(&pRing->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+
+        while (tail != head)
+        {
+            uint32_t count = 0;
+
+            for (; (tail != head) && (count < DRAIN_BATCH); tail++, count++)
+            {
+                const STraceRecord_t *pRecord = &pRing->aRecords[tail & (TRACE_RING_RECORDS - 1)];
+                uint8_t              *pOut = &g_batch[count * TRACE_RECORD_BYTES];
+
+                putU64(pOut, pRecord->cycle);
+                putU32(pOut + 8, pRecord->b);
+                putU16(pOut + 12, pRecord->a);
+                pOut[14] = pRecord->event;
+                pOut[15] = pRing->thread;
+            }
+
+            // the slots are free once copied out
+            atomic_store_explicit(&pRing->tail, tail, memory_order_release);
+
+            if (fwrite(g_batch, TRACE_RECORD_BYTES, count, g_pFile) != count)
+            {
+                fprintf(stderr, "cannot write trace, stopping it\n");
+                atomic_store(&g_traceMask, 0);
+            }
+
+            total += count;
+        }
+    }
+
+    g_written += total;
+    return total;
+}
+
+static void *drainer(void *pArg)
+{
+    (void)pArg;
+
+    struct timespec idle = { 0, DRAIN_IDLE_NS };
+
+    while (atomic_load_explicit(&g_draining, memory_order_acquire))
+    {
+        if (drainRings() == 0)
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    drainRings();
+    return NULL;
+}
+
+bool traceOpen(const char *pPath, uint32_t mask)
+{
+    if (atomic_load(&g_open))
+    {
+        traceClose();
+    }
+
+    g_pFile = fopen(pPath, "wb");
+
+    if (!g_pFile)
+    {
+        fprintf(stderr, "cannot open trace %s\n", pPath);
+        return false;
+    }
+
+    uint8_t header[16] = { 0 };
+
+    memcpy(header, TRACE_MAGIC, 4);
+    putU16(&header[4], TRACE_VERSION);
+    putU16(&header[6], TRACE_RECORD_BYTES);
+    putU32(&header[8], mask & TRACE_COMPILED);
+
+    if (fwrite(header, sizeof(header), 1, g_pFile) != 1)
+    {
+        fprintf(stderr, "cannot write trace %s\n", pPath);
+        fclose(g_pFile);
+        g_pFile = NULL;
+        return false;
+    }
+
+    // skip whatever was left from an earlier trace
+    for (unsigned int i = 0; (i < atomic_load(&g_ringCount)) && (i < TRACE_MAX_THREADS); i++)
+    {
+        STraceRing_t *pRing = atomic_load_explicit(&g_rings[i], memory_order_acquire);
+
+        if (pRing)
+        {
+            atomic_store(&pRing->tail, atomic_load(&pRing->head));
+        }
+    }
+
+    g_written = 0;
+    atomic_store(&g_draining, true);
+
+    if (pthread_create(&g_drainer, NULL, drainer, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start trace thread\n");
+        atomic_store(&g_draining, false);
+        fclose(g_pFile);
+        g_pFile = NULL;
+        return false;
+    }
+
+    atomic_store(&g_open, true);
+    atomic_store(&g_traceMask, mask & TRACE_COMPILED);
+
+    if ((mask & ~TRACE_COMPILED) != 0)
+    {
+        fprintf(stderr, "trace categories 0x%x are not built in\n", mask & ~TRACE_COMPILED);
+    }
+
+    return true;
+}
+
+void traceClose(void)
+{
+    if (!atomic_exchange(&g_open, false))
+    {
+        return;
+    }
+
+    atomic_store(&g_traceMask, 0);
+    atomic_store_explicit(&g_draining, false, memory_order_release);
+    pthread_join(g_drainer, NULL);
+
+    fclose(g_pFile);
+    g_pFile = NULL;
+}
+
+void traceSetMask(uint32_t mask)
+{
+    if (atomic_load(&g_open))
+    {
+        atomic_store(&g_traceMask, mask & TRACE_COMPILED);
+    }
+}
+
+bool traceParseMask(const char *pList, uint32_t *pMask)
+{
+    uint32_t mask = 0;
+
+    while (*pList != '\0')
+    {
+        size_t len = strcspn(pList, ",");
+        bool   known = (len == 3) && (strncmp(pList, "all", 3) == 0);
+
+        mask |= known ? TRACE_ALL : 0;
+
+        for (uint8_t i = 0; !known && (i < TRACE_CATEGORY_COUNT); i++)
+        {
+            if ((strlen(g_categoryNames[i]) == len) && (strncmp(pList, g_categoryNames[i], len) == 0))
+            {
+                mask |= TRACE_BIT(i);
+                known = true;
+            }
+        }
+
+        if (!known)
+        {
+            return false;
+        }
+
+        pList += len + ((pList[len] == ',') ? 1 : 0);
+    }
+
+    *pMask = mask;
+    return true;
+}
+
+const char *pTraceCategoryName(uint8_t category)
+{
+    return (category < TRACE_CATEGORY_COUNT) ? g_categoryNames[category] : "?";
+}
+
+const char *pTraceEventName(uint8_t event)
+{
+    switch (event)
+    {
+        case TRACE_CPU_EXEC:       return "exec";
+        case TRACE_IRQ_DISPATCH:   return "dispatch";
+        case TRACE_MEM_VRAM:       return "vram";
+        case TRACE_MEM_CARTRAM:    return "cartram";
+        case TRACE_MBC_RAM_ENABLE: return "ram-enable";
+        case TRACE_MBC_ROM_BANK:   return "rom-bank";
+        case TRACE_MBC_RAM_BANK:   return "ram-bank";
+        case TRACE_MBC_MODE:       return "mode";
+        case TRACE_PPU_VBLANK:     return "vblank";
+        case TRACE_INPUT_APPLY:    return "apply";
+        default:                   return "?";
+    }
+}
+
+void traceGetStats(STraceStats_t *pStats)
+{
+    unsigned int rings = atomic_load(&g_ringCount);
+
+    pStats->records = g_written;
+    pStats->dropped = atomic_load_explicit(&g_unattached, memory_order_relaxed);
+    pStats->threads = (rings < TRACE_MAX_THREADS) ? rings : TRACE_MAX_THREADS;
+
+    for (uint32_t i = 0; i < pStats->threads; i++)
+    {
+        STraceRing_t *pRing = atomic_load_explicit(&g_rings[i], memory_order_acquire);
+
+        pStats->dropped += pRing ? atomic_load_explicit(&pRing->dropped, memory_order_relaxed) : 0;
+    }
+}
@@ -0,0 +1,121 @@
+/**
+ * @file trace.h
+ * @author Toesoe
+ * @brief seaboy event tracing
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * TRACE() costs nothing for a category left out of TRACE_COMPILED, and one relaxed load and a
+ * branch for one that is compiled in but masked off at runtime. an enabled event is a 16-byte
+ * record in a ring owned by the thread that emits it; a background thread drains every ring to
+ * the file. a full ring drops the record and counts it: tracing never makes the emulation wait.
+ *
+ * file format, little endian:
+ *   header: "SBTR", u16 version, u16 record bytes, u32 category mask, u32 0
+ *   records: u64 cycle, u32 b, u16 a, u8 event, u8 thread
+ * records from one thread are in order; threads are interleaved a batch at a time.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define TRACE_MAGIC        "SBTR"
+#define TRACE_VERSION      1
+#define TRACE_RECORD_BYTES 16
+#define TRACE_RING_RECORDS (1 << 18) // per thread, power of two: 4 MiB
+#define TRACE_MAX_THREADS  16
+
+typedef enum
+{
+    TRACE_CPU,   // every instruction
+    TRACE_IRQ,
+    TRACE_MEM,   // VRAM and cartridge RAM writes
+    TRACE_MBC,   // bank switching
+    TRACE_PPU,
+    TRACE_INPUT,
+    TRACE_CATEGORY_COUNT
+} ETraceCategory_t;
+
+#define TRACE_BIT(category) (1u << (category))
+#define TRACE_ALL           ((1u << TRACE_CATEGORY_COUNT) - 1)
+
+// categories built in; -DTRACE_COMPILED=0 leaves no trace of tracing
+#ifndef TRACE_COMPILED
+#define TRACE_COMPILED TRACE_ALL
+#endif
+
+// an event's category is its high nibble
+#define TRACE_EVENT(category, n) (((category) << 4) | (n))
+#define TRACE_CATEGORY(event)    ((event) >> 4)
+
+typedef enum
+{
+    TRACE_CPU_EXEC         = TRACE_EVENT(TRACE_CPU, 0),   // a: pc, b: opcode
+    TRACE_IRQ_DISPATCH     = TRACE_EVENT(TRACE_IRQ, 0),   // a: vector
+    TRACE_MEM_VRAM         = TRACE_EVENT(TRACE_MEM, 0),   // a: address, b: value
+    TRACE_MEM_CARTRAM      = TRACE_EVENT(TRACE_MEM, 1),   // a: address, b: value | bank << 8
+    TRACE_MBC_RAM_ENABLE   = TRACE_EVENT(TRACE_MBC, 0),   // b: enabled
+    TRACE_MBC_ROM_BANK     = TRACE_EVENT(TRACE_MBC, 1),   // b: bank
+    TRACE_MBC_RAM_BANK     = TRACE_EVENT(TRACE_MBC, 2),   // b: bank
+    TRACE_MBC_MODE         = TRACE_EVENT(TRACE_MBC, 3),   // b: advanced banking
+    TRACE_PPU_VBLANK       = TRACE_EVENT(TRACE_PPU, 0),   // a: ly
+    TRACE_INPUT_APPLY      = TRACE_EVENT(TRACE_INPUT, 0)  // a: mask, b: state
+} ETraceEvent_t;
+
+typedef struct
+{
+    uint64_t records;  // written to the file
+    uint64_t dropped;  // a ring was full, or too many threads traced
+    uint32_t threads;
+} STraceStats_t;
+
+extern atomic_uint g_traceMask;
+
+void traceEmit(uint8_t, uint64_t, uint16_t, uint32_t);
+
+/**
+ * @brief record an event at a T-cycle, with two arguments
+ */
+#define TRACE(event, cycle, a, b)                                                                          \
+    do                                                                                                     \
+    {                                                                                                      \
+        if ((TRACE_COMPILED & TRACE_BIT(TRACE_CATEGORY(event))) &&                                         \
+            (atomic_load_explicit(&g_traceMask, memory_order_relaxed) & TRACE_BIT(TRACE_CATEGORY(event)))) \
+        {                                                                                                  \
+            traceEmit((uint8_t)(event), (uint64_t)(cycle), (uint16_t)(a), (uint32_t)(b));                  \
+        }                                                                                                  \
+    } while (0)
+
+/**
+ * @brief start writing the categories in the mask to pPath
+ */
+bool traceOpen(const char *, uint32_t);
+
+/**
+ * @brief stop tracing, drain what is left and close the file
+ */
+void traceClose(void);
+
+/**
+ * @brief change the categories traced, from any thread
+ */
+void traceSetMask(uint32_t);
+
+/**
+ * @brief parse "cpu,mem,..." or "all"
+ * @return false on an unknown name
+ */
+bool traceParseMask(const char *, uint32_t *);
+
+const char *pTraceCategoryName(uint8_t);
+const char *pTraceEventName(uint8_t);
+
+void traceGetStats(STraceStats_t *);
+
+#endif //!_TRACE_H_
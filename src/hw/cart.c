@@ -16,11 +16,12 @@
 #include <stdio.h>
 
 #include "mem.h"
+#include "cart.h"
 
 /**
  * map a romfile into memory
 */
-void loadRom(const char *fn)
+bool loadRom(const char *fn)
 {
     struct stat sb;
 
@@ -28,29 +29,37 @@ void loadRom(const char *fn)
 
     if (fd == -1)
     {
-        printf("cannot open file %s\n", fn);
-        close(fd);
-        return;
+        fprintf(stderr, "cannot open file %s\n", fn);
+        return false;
     }
 
 
     if (fstat(fd, &sb) == -1)
     {
-        printf("cannot retrieve filesize\n");
+        fprintf(stderr, "cannot retrieve filesize\n");
+        close(fd);
+        return false;
+    }
+
+    if (sb.st_size < (2 * ROMN_SIZE))
+    {
+        // bank 0 and bank 1 are copied onto the bus whole
+        fprintf(stderr, "%s is not a rom: %lld bytes\n", fn, (long long)sb.st_size);
         close(fd);
-        return;
+        return false;
     }
 
     uint8_t *pActiveRom = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
     if (pActiveRom == MAP_FAILED)
     {
-        printf("cannot map rom in memory\n");
+        fprintf(stderr, "cannot map rom in memory\n");
         close(fd);
-        return;
+        return false;
     }
 
     close(fd);
 
     mapRomIntoMem(&pActiveRom, sb.st_size);
+    return true;
 }
\ No newline at end of file
@@ -12,6 +12,12 @@
 #ifndef _CART_H_
 #define _CART_H_
 
-void loadRom(const char *);
+#include <stdbool.h>
+
+/**
+ * @brief map a rom file onto the bus
+ * @return false if it cannot be read or is smaller than two banks
+ */
+bool loadRom(const char *);
 
 #endif //!_CART_H_
\ No newline at end of file
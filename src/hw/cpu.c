@@ -19,6 +19,9 @@
 
 #include "instr.h"
 #include "mem.h"
+#include "joypad.h"
+#include "state.h"
+#include "../drv/trace.h"
 
 static cpu_t cpu;
 static bus_t *pBus;
@@ -26,6 +29,13 @@ static bus_t *pBus;
 static bool imeFlag = false;
 static bool isHalted = false;
 
+// DIV and TIMA prescalers, in M-cycles
+static int divCycles = 0;
+static int timerCycles = 0;
+
+// save state: u16 AF, BC, DE, HL, SP, PC, u8 IME, u8 HALT, u16 0, u32 DIV prescaler, u32 TIMA prescaler
+#define CPU_STATE_BYTES 24
+
 static int getRegisterIndexByOpcodeNibble(uint8_t);
 
 /**
@@ -36,6 +46,9 @@ void resetCpu(void)
     memset(&cpu, 0x00, sizeof(cpu));
     cpu.reg16.pc = 0x0;
     imeFlag = false;
+    isHalted = false;
+    divCycles = 0;
+    timerCycles = 0;
     instrSetCpuPtr(&cpu);
     pBus = pGetBusPtr();
 }
@@ -67,12 +80,28 @@ void cpuSkipBootrom(void)
     memset(&pBus->map.ioregs.lcd.control, 0x91, 1);
     memset(&pBus->map.ioregs.lcd.stat, 0x85, 1);
     memset(&pBus->map.ioregs.lcd.dma, 0xFF, 1);
-    memset(&pBus->map.ioregs.lcd.bgp, 0xFC, 1);
+    write8(0xFC, 0xFF47); // BGP, through the bus so the PPU palette follows
     memset(&pBus->map.ioregs.joypad, 0xCF, 1);
     memset(&pBus->map.ioregs.divRegister, 0x18, 1);
     memset(&pBus->map.ioregs.timers.TAC, 0xF8, 1);
     memset(&pBus->map.ioregs.intFlags, 0xE1, 1);
-    // todo: audio
+    // the boot beep has ended: channel 1 is still on, at volume 0. power first, or the rest is ignored
+    write8(0xF1, 0xFF26); // NR52
+    write8(0x80, 0xFF10); // NR10
+    write8(0xBF, 0xFF11); // NR11
+    write8(0x08, 0xFF12); // NR12, volume 0 with the DAC on for the trigger below
+    write8(0xBF, 0xFF14); // NR14
+    write8(0xF3, 0xFF12);
+    write8(0x3F, 0xFF16); // NR21
+    write8(0xBF, 0xFF19); // NR24, the trigger bit finds the DAC off
+    write8(0x7F, 0xFF1A); // NR30
+    write8(0xFF, 0xFF1B); // NR31
+    write8(0x9F, 0xFF1C); // NR32
+    write8(0xBF, 0xFF1E); // NR34
+    write8(0xFF, 0xFF20); // NR41
+    write8(0xBF, 0xFF23); // NR44
+    write8(0x77, 0xFF24); // NR50
+    write8(0xF3, 0xFF25); // NR51
 
 
 }
@@ -1628,7 +1657,8 @@ int executeInstruction(uint8_t instr)
 
 int handleInterrupts(void)
 {
-    bool fired = false;
+    bool     fired = false;
+    uint16_t vector = 0;
 
     if (checkIME())
     {
@@ -1636,7 +1666,7 @@ int handleInterrupts(void)
         {
             fired = true;
             pBus->map.ioregs.intFlags.vblank = 0;
-            call_nn(0x40);
+            vector = 0x40;
         }
         else if (pBus->map.interruptEnable.lcd && pBus->map.ioregs.intFlags.lcd)
         {
@@ -1648,30 +1678,33 @@ int handleInterrupts(void)
                 // STAT int
                 fired = true;
                 pBus->map.ioregs.intFlags.lcd = 0;
-                call_nn(0x48);
+                vector = 0x48;
             }
         }
         else if (pBus->map.interruptEnable.timer && pBus->map.ioregs.intFlags.timer)
         {
             fired = true;
             pBus->map.ioregs.intFlags.timer = 0;
-            call_nn(0x50);
+            vector = 0x50;
         }
         else if (pBus->map.interruptEnable.serial && pBus->map.ioregs.intFlags.serial)
         {
             fired = true;
             pBus->map.ioregs.intFlags.serial = 0;
-            call_nn(0x58);
+            vector = 0x58;
         }
         else if (pBus->map.interruptEnable.joypad && pBus->map.ioregs.intFlags.joypad)
         {
             fired = true;
             pBus->map.ioregs.intFlags.joypad = 0;
-            call_nn(0x60);
+            vector = 0x60;
         }
 
         if (fired)
         {
+            TRACE(TRACE_IRQ_DISPATCH, joypadGetCycle(), vector, 0);
+            call_nn(vector);
+
             if (isHalted)
             {
                 isHalted = false;
@@ -1685,22 +1718,20 @@ int handleInterrupts(void)
 
 void handleTimers(int mCycles)
 {
-    static int localCycles = 0;
     uint16_t localTim = pBus->map.ioregs.timers.TIMA;
      while (mCycles--)
     {
         // Handle the DIV register
-        localCycles++;
-        if (localCycles == 64)
+        divCycles++;
+        if (divCycles == 64)
         {
             pBus->map.ioregs.divRegister++;
-            localCycles = 0;
+            divCycles = 0;
         }
 
         // Handle TIMA increment
         if (pBus->map.ioregs.timers.TAC.enable)
         {
-            static int timerCycles = 0;
             timerCycles++;
 
             int timerThreshold = 0;
@@ -1727,6 +1758,39 @@ void handleTimers(int mCycles)
     }
 }
 
+size_t cpuStateSize(void)
+{
+    return CPU_STATE_BYTES;
+}
+
+void cpuSaveState(uint8_t *pState)
+{
+    memset(pState, 0, CPU_STATE_BYTES);
+
+    for (size_t i = 0; i < 6; i++)
+    {
+        statePutU16(&pState[i * 2], cpu.reg16_arr[i]);
+    }
+
+    pState[12] = imeFlag ? 1 : 0;
+    pState[13] = isHalted ? 1 : 0;
+    statePutU32(&pState[16], (uint32_t)divCycles);
+    statePutU32(&pState[20], (uint32_t)timerCycles);
+}
+
+void cpuLoadState(const uint8_t *pState)
+{
+    for (size_t i = 0; i < 6; i++)
+    {
+        cpu.reg16_arr[i] = stateGetU16(&pState[i * 2]);
+    }
+
+    imeFlag     = pState[12] != 0;
+    isHalted    = pState[13] != 0;
+    divCycles   = (int)stateGetU32(&pState[16]);
+    timerCycles = (int)stateGetU32(&pState[20]);
+}
+
 static int getRegisterIndexByOpcodeNibble(uint8_t lo)
 {
     switch (lo)
@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef enum _Flag
 {
@@ -152,4 +153,12 @@ int handleInterrupts(void);
 
 void handleTimers(int);
 
+/**
+ * @brief registers, IME, HALT and the timer prescalers, as a fixed-layout blob of cpuStateSize()
+ *        bytes. only valid at an instruction boundary
+ */
+size_t cpuStateSize(void);
+void   cpuSaveState(uint8_t *);
+void   cpuLoadState(const uint8_t *);
+
 #endif // !_CPU_H_
\ No newline at end of file
@@ -0,0 +1,541 @@
+/**
+ * @file debug.c
+ * @author Toesoe
+ * @brief seaboy breakpoints and watchpoints
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * points are few and change rarely: every change rebuilds the bitmaps and the page table from
+ * the list, and a hit scans the list for the points behind it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "debug.h"
+#include "cpu.h"
+#include "mem.h"
+
+#define BANKED_FIRST 0x4000
+#define BANKED_LAST  0x7FFF
+#define BANK_BITS    ((BANKED_LAST - BANKED_FIRST + 1) / 8)
+
+typedef enum
+{
+    OPERAND_REG8,
+    OPERAND_REG16,
+    OPERAND_MEM,
+    OPERAND_VALUE
+} EOperand_t;
+
+typedef enum
+{
+    COMPARE_EQ,
+    COMPARE_NE,
+    COMPARE_LT,
+    COMPARE_LE,
+    COMPARE_GT,
+    COMPARE_GE
+} ECompare_t;
+
+typedef struct
+{
+    bool       present;
+    EOperand_t operand;
+    uint16_t   index; // register, or address
+    ECompare_t compare;
+    uint16_t   value;
+} SCondition_t;
+
+typedef struct
+{
+    bool         used;
+    bool         watch;
+    uint16_t     bank;
+    uint16_t     first;
+    uint16_t     last;
+    uint8_t      kinds;
+    SCondition_t condition;
+    uint64_t     hits;
+} SDebugPoint_t;
+
+bool    g_debugArmed = false;
+uint8_t g_debugPageTraps[256];
+
+static SDebugPoint_t g_points[DEBUG_MAX_POINTS];
+static uint8_t       g_pcBits[0x10000 / 8];           // outside the banked window
+static uint8_t      *g_pBankBits[DEBUG_ROM_BANKS];    // the banked window, per bank, on first use
+static uint16_t      g_instrPc = 0;
+
+static void defaultHandler(const SDebugHit_t *);
+static void (*g_pfnHandler)(const SDebugHit_t *) = defaultHandler;
+
+static const struct
+{
+    const char *pName;
+    EOperand_t  operand;
+    uint16_t    index;
+} g_registers[] = {
+    { "AF", OPERAND_REG16, AF }, { "BC", OPERAND_REG16, BC }, { "DE", OPERAND_REG16, DE },
+    { "HL", OPERAND_REG16, HL }, { "SP", OPERAND_REG16, SP }, { "PC", OPERAND_REG16, PC },
+    { "A", OPERAND_REG8, A },    { "F", OPERAND_REG8, F },    { "B", OPERAND_REG8, B },
+    { "C", OPERAND_REG8, C },    { "D", OPERAND_REG8, D },    { "E", OPERAND_REG8, E },
+    { "H", OPERAND_REG8, H },    { "L", OPERAND_REG8, L },    { "V", OPERAND_VALUE, 0 },
+};
+
+void debugTrap(void)
+{
+    __asm volatile("nop");
+}
+
+static void defaultHandler(const SDebugHit_t *pHit)
+{
+    static const char *kinds[] = { "breakpoint", "read watchpoint", "write watchpoint" };
+    const cpu_t       *pCpu = getCpuObject();
+
+    fprintf(stderr, "%s %d at %02X:%04X, hit %llu", kinds[pHit->kind], pHit->id, pHit->bank, pHit->pc,
+            (unsigned long long)pHit->hits);
+
+    if (pHit->kind != DEBUG_HIT_BREAKPOINT)
+    {
+        fprintf(stderr, ", %02X %s %04X", pHit->value, (pHit->kind == DEBUG_HIT_READ) ? "from" : "to", pHit->addr);
+    }
+
+    fprintf(stderr, "\n  A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X\n",
+            pCpu->reg8.a, pCpu->reg8.f, pCpu->reg8.b, pCpu->reg8.c, pCpu->reg8.d, pCpu->reg8.e, pCpu->reg8.h,
+            pCpu->reg8.l, pCpu->reg16.sp, pCpu->reg16.pc);
+
+    debugTrap();
+}
+
+static uint16_t currentBank(uint16_t addr)
+{
+    return ((addr >= BANKED_FIRST) && (addr <= BANKED_LAST)) ? busGetRomBank() : 0;
+}
+
+static void rebuild(void)
+{
+    memset(g_pcBits, 0, sizeof(g_pcBits));
+    memset(g_debugPageTraps, 0, sizeof(g_debugPageTraps));
+
+    for (int i = 0; i < DEBUG_ROM_BANKS; i++)
+    {
+        if (g_pBankBits[i])
+        {
+            memset(g_pBankBits[i], 0, BANK_BITS);
+        }
+    }
+
+    g_debugArmed = false;
+
+    for (int i = 0; i < DEBUG_MAX_POINTS; i++)
+    {
+        const SDebugPoint_t *pPoint = &g_points[i];
+
+        if (!pPoint->used)
+        {
+            continue;
+        }
+
+        g_debugArmed = true;
+
+        if (pPoint->watch)
+        {
+            for (int page = pPoint->first >> 8; page <= (pPoint->last >> 8); page++)
+            {
+                g_debugPageTraps[page] |= pPoint->kinds;
+            }
+        }
+        else if ((pPoint->first >= BANKED_FIRST) && (pPoint->first <= BANKED_LAST))
+        {
+            uint16_t offset = (uint16_t)(pPoint->first - BANKED_FIRST);
+
+            g_pBankBits[pPoint->bank][offset >> 3] |= (uint8_t)(1 << (offset & 7));
+        }
+        else
+        {
+            g_pcBits[pPoint->first >> 3] |= (uint8_t)(1 << (pPoint->first & 7));
+        }
+    }
+}
+
+static bool parseNumber(const char **ppStr, int base, uint32_t max, uint16_t *pValue)
+{
+    const char *pStr = *ppStr;
+
+    while (isspace((unsigned char)*pStr))
+    {
+        pStr++;
+    }
+
+    if (*pStr == '$')
+    {
+        base = 16;
+        pStr++;
+    }
+    else if ((pStr[0] == '0') && ((pStr[1] == 'x') || (pStr[1] == 'X')))
+    {
+        base = 16;
+        pStr += 2;
+    }
+
+    char         *pEnd = NULL;
+    unsigned long value = isxdigit((unsigned char)*pStr) ? strtoul(pStr, &pEnd, base) : 0;
+
+    if (!pEnd || (pEnd == pStr) || (value > max))
+    {
+        return false;
+    }
+
+    *pValue = (uint16_t)value;
+    *ppStr = pEnd;
+    return true;
+}
+
+static bool parseCondition(const char *pStr, bool watch, SCondition_t *pCondition)
+{
+    memset(pCondition, 0, sizeof(SCondition_t));
+
+    if (!pStr)
+    {
+        return true;
+    }
+
+    while (isspace((unsigned char)*pStr))
+    {
+        pStr++;
+    }
+
+    if (*pStr == '\0')
+    {
+        return true;
+    }
+
+    if (*pStr == '[')
+    {
+        pStr++;
+        pCondition->operand = OPERAND_MEM;
+
+        if (!parseNumber(&pStr, 16, 0xFFFF, &pCondition->index) || (*pStr++ != ']'))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        size_t i = 0;
+        size_t count = sizeof(g_registers) / sizeof(g_registers[0]);
+
+        for (; i < count; i++)
+        {
+            size_t len = strlen(g_registers[i].pName);
+
+            if ((strncasecmp(pStr, g_registers[i].pName, len) == 0) && !isalpha((unsigned char)pStr[len]))
+            {
+                break;
+            }
+        }
+
+        if ((i == count) || ((g_registers[i].operand == OPERAND_VALUE) && !watch))
+        {
+            return false;
+        }
+
+        pCondition->operand = g_registers[i].operand;
+        pCondition->index   = g_registers[i].index;
+        pStr += strlen(g_registers[i].pName);
+    }
+
+    while (isspace((unsigned char)*pStr))
+    {
+        pStr++;
+    }
+
+    static const struct
+    {
+        const char *pText;
+        ECompare_t  compare;
+    } compares[] = {
+        { "==", COMPARE_EQ }, { "!=", COMPARE_NE }, { "<=", COMPARE_LE },
+        { ">=", COMPARE_GE }, { "<", COMPARE_LT },  { ">", COMPARE_GT },
+    };
+    size_t c = 0;
+
+    for (; c < sizeof(compares) / sizeof(compares[0]); c++)
+    {
+        if (strncmp(pStr, compares[c].pText, strlen(compares[c].pText)) == 0)
+        {
+            break;
+        }
+    }
+
+    if (c == sizeof(compares) / sizeof(compares[0]))
+    {
+        return false;
+    }
+
+    pStr += strlen(compares[c].pText);
+    pCondition->compare = compares[c].compare;
+
+    if (!parseNumber(&pStr, 10, 0xFFFF, &pCondition->value))
+    {
+        return false;
+    }
+
+    while (isspace((unsigned char)*pStr))
+    {
+        pStr++;
+    }
+
+    pCondition->present = true;
+    return *pStr == '\0';
+}
+
+static bool conditionHolds(const SCondition_t *pCondition, uint8_t value)
+{
+    if (!pCondition->present)
+    {
+        return true;
+    }
+
+    const cpu_t *pCpu = getCpuObject();
+    uint16_t     lhs = 0;
+
+    switch (pCondition->operand)
+    {
+        case OPERAND_REG8:  lhs = pCpu->reg8_arr[pCondition->index];           break;
+        case OPERAND_REG16: lhs = pCpu->reg16_arr[pCondition->index];          break;
+        case OPERAND_MEM:   lhs = pGetBusPtr()->bus[pCondition->index];        break; // not through fetch8: no watch hits
+        case OPERAND_VALUE: lhs = value;                                       break;
+    }
+
+    switch (pCondition->compare)
+    {
+        case COMPARE_EQ: return lhs == pCondition->value;
+        case COMPARE_NE: return lhs != pCondition->value;
+        case COMPARE_LT: return lhs < pCondition->value;
+        case COMPARE_LE: return lhs <= pCondition->value;
+        case COMPARE_GT: return lhs > pCondition->value;
+        case COMPARE_GE: return lhs >= pCondition->value;
+    }
+
+    return false;
+}
+
+static int addPoint(const SDebugPoint_t *pPoint)
+{
+    for (int i = 0; i < DEBUG_MAX_POINTS; i++)
+    {
+        if (!g_points[i].used)
+        {
+            g_points[i] = *pPoint;
+            g_points[i].used = true;
+            rebuild();
+            return i;
+        }
+    }
+
+    fprintf(stderr, "all %d breakpoints and watchpoints are taken\n", DEBUG_MAX_POINTS);
+    return -1;
+}
+
+int debugAddBreakpoint(uint16_t bank, uint16_t addr, const char *pCondition)
+{
+    SDebugPoint_t point = { 0 };
+    bool          banked = (addr >= BANKED_FIRST) && (addr <= BANKED_LAST);
+
+    if (banked && (bank >= DEBUG_ROM_BANKS))
+    {
+        fprintf(stderr, "no ROM bank %u\n", bank);
+        return -1;
+    }
+
+    if (banked && (bank != busGetRomBank()) && !busSwitchesRomBanks())
+    {
+        fprintf(stderr, "breakpoint %02X:%04X would never hit: this build keeps ROM bank %u at 0x4000\n", bank, addr,
+                busGetRomBank());
+        return -1;
+    }
+
+    if (!parseCondition(pCondition, false, &point.condition))
+    {
+        fprintf(stderr, "cannot parse condition \"%s\"\n", pCondition);
+        return -1;
+    }
+
+    if (banked && !g_pBankBits[bank])
+    {
+        g_pBankBits[bank] = calloc(1, BANK_BITS);
+
+        if (!g_pBankBits[bank])
+        {
+            return -1;
+        }
+    }
+
+    point.bank  = banked ? bank : 0;
+    point.first = addr;
+    point.last  = addr;
+
+    return addPoint(&point);
+}
+
+int debugAddWatchpoint(uint16_t first, uint16_t last, uint8_t kinds, const char *pCondition)
+{
+    SDebugPoint_t point = { 0 };
+
+    kinds &= DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+
+    if ((last < first) || !kinds)
+    {
+        fprintf(stderr, "empty watchpoint %04X-%04X\n", first, last);
+        return -1;
+    }
+
+    if (!parseCondition(pCondition, true, &point.condition))
+    {
+        fprintf(stderr, "cannot parse condition \"%s\"\n", pCondition);
+        return -1;
+    }
+
+    point.watch = true;
+    point.first = first;
+    point.last  = last;
+    point.kinds = kinds;
+
+    return addPoint(&point);
+}
+
+void debugRemove(int id)
+{
+    if ((id >= 0) && (id < DEBUG_MAX_POINTS))
+    {
+        g_points[id].used = false;
+        rebuild();
+    }
+}
+
+void debugClear(void)
+{
+    memset(g_points, 0, sizeof(g_points));
+    rebuild();
+}
+
+int debugParseBreakpoint(const char *pSpec)
+{
+    const char *pStr = pSpec;
+    const char *pColon = strchr(pSpec, ':');
+    uint16_t    bank = 1;
+    uint16_t    addr = 0;
+
+    bool        ok = true;
+
+    if (pColon)
+    {
+        ok = parseNumber(&pStr, 16, DEBUG_ROM_BANKS - 1, &bank) && (pStr == pColon);
+        pStr = pColon + 1;
+    }
+
+    if (!ok || !parseNumber(&pStr, 16, 0xFFFF, &addr) || ((*pStr != '\0') && (*pStr != ',')))
+    {
+        fprintf(stderr, "cannot parse breakpoint \"%s\"\n", pSpec);
+        return -1;
+    }
+
+    return debugAddBreakpoint(bank, addr, (*pStr == ',') ? pStr + 1 : NULL);
+}
+
+int debugParseWatchpoint(const char *pSpec)
+{
+    const char *pStr = pSpec;
+    uint16_t    first = 0;
+    uint16_t    last = 0;
+    uint8_t     kinds = DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+    bool        ok = parseNumber(&pStr, 16, 0xFFFF, &first);
+
+    last = first;
+
+    if (ok && (*pStr == '-'))
+    {
+        pStr++;
+        ok = parseNumber(&pStr, 16, 0xFFFF, &last);
+    }
+
+    if (ok && (*pStr == ':'))
+    {
+        pStr++;
+        kinds = 0;
+
+        for (; (*pStr == 'r') || (*pStr == 'w'); pStr++)
+        {
+            kinds |= (*pStr == 'r') ? DEBUG_WATCH_READ : DEBUG_WATCH_WRITE;
+        }
+    }
+
+    if (!ok || ((*pStr != '\0') && (*pStr != ',')))
+    {
+        fprintf(stderr, "cannot parse watchpoint \"%s\"\n", pSpec);
+        return -1;
+    }
+
+    return debugAddWatchpoint(first, last, kinds, (*pStr == ',') ? pStr + 1 : NULL);
+}
+
+void debugSetHandler(void (*pfnHandler)(const SDebugHit_t *))
+{
+    g_pfnHandler = pfnHandler ? pfnHandler : defaultHandler;
+}
+
+void debugCheckPc(uint16_t pc)
+{
+    g_instrPc = pc;
+
+    uint16_t bank = currentBank(pc);
+    bool     set = false;
+
+    if ((pc >= BANKED_FIRST) && (pc <= BANKED_LAST))
+    {
+        uint16_t offset = (uint16_t)(pc - BANKED_FIRST);
+
+        set = (bank < DEBUG_ROM_BANKS) && g_pBankBits[bank] && (g_pBankBits[bank][offset >> 3] & (1 << (offset & 7)));
+    }
+    else
+    {
+        set = g_pcBits[pc >> 3] & (1 << (pc & 7));
+    }
+
+    for (int i = 0; set && (i < DEBUG_MAX_POINTS); i++)
+    {
+        SDebugPoint_t *pPoint = &g_points[i];
+
+        if (pPoint->used && !pPoint->watch && (pPoint->first == pc) && (pPoint->bank == bank) &&
+            conditionHolds(&pPoint->condition, 0))
+        {
+            SDebugHit_t hit = { DEBUG_HIT_BREAKPOINT, i, bank, pc, pc, 0, ++pPoint->hits };
+
+            g_pfnHandler(&hit);
+        }
+    }
+}
+
+void debugWatchHit(uint8_t kind, uint16_t addr, uint8_t val)
+{
+    for (int i = 0; i < DEBUG_MAX_POINTS; i++)
+    {
+        SDebugPoint_t *pPoint = &g_points[i];
+
+        if (pPoint->used && pPoint->watch && (pPoint->kinds & kind) && (addr >= pPoint->first) &&
+            (addr <= pPoint->last) && conditionHolds(&pPoint->condition, val))
+        {
+            SDebugHit_t hit = { (kind == DEBUG_WATCH_READ) ? DEBUG_HIT_READ : DEBUG_HIT_WRITE,
+                                i, currentBank(g_instrPc), g_instrPc, addr, val, ++pPoint->hits };
+
+            g_pfnHandler(&hit);
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/**
+ * @file debug.h
+ * @author Toesoe
+ * @brief seaboy breakpoints and watchpoints
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * PC breakpoints are bits in a bitmap per ROM bank for 0x4000-0x7FFF and one for the rest of the
+ * address space; the main loop only looks at them while something is armed. watchpoints flag
+ * their 256-byte pages in a table the bus checks on every access, and compare the exact range
+ * only on a flagged page, so an empty table costs a load and a branch.
+ *
+ * a condition is "lhs op value": lhs a register (A-L, AF, BC, DE, HL, SP, PC), a byte [FF44],
+ * or, for a watchpoint, V, the byte read or written; op one of == != < <= > >=; the value hex
+ * with 0x or $, or decimal. all of it is for the emulation thread.
+ */
+
+#ifndef _DEBUG_H_
+#define _DEBUG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DEBUG_MAX_POINTS 64
+#define DEBUG_ROM_BANKS  512 // MBC5
+
+#define DEBUG_WATCH_READ  0x01
+#define DEBUG_WATCH_WRITE 0x02
+
+typedef enum
+{
+    DEBUG_HIT_BREAKPOINT,
+    DEBUG_HIT_READ,
+    DEBUG_HIT_WRITE
+} EDebugHit_t;
+
+typedef struct
+{
+    EDebugHit_t kind;
+    int         id;
+    uint16_t    bank;  // ROM bank mapped at 0x4000
+    uint16_t    pc;    // of the instruction that hit
+    uint16_t    addr;  // watchpoints: the byte accessed
+    uint8_t     value; // watchpoints: read or written
+    uint64_t    hits;  // of this point, this one included
+} SDebugHit_t;
+
+extern bool    g_debugArmed;
+extern uint8_t g_debugPageTraps[256];
+
+void debugCheckPc(uint16_t);
+void debugWatchHit(uint8_t, uint16_t, uint8_t);
+
+/**
+ * @brief the CPU is about to execute the instruction at PC
+ */
+static inline void debugStep(uint16_t pc)
+{
+    if (g_debugArmed)
+    {
+        debugCheckPc(pc);
+    }
+}
+
+static inline void debugRead(uint16_t addr, uint8_t val)
+{
+    if (g_debugPageTraps[addr >> 8] & DEBUG_WATCH_READ)
+    {
+        debugWatchHit(DEBUG_WATCH_READ, addr, val);
+    }
+}
+
+static inline void debugWrite(uint16_t addr, uint8_t val)
+{
+    if (g_debugPageTraps[addr >> 8] & DEBUG_WATCH_WRITE)
+    {
+        debugWatchHit(DEBUG_WATCH_WRITE, addr, val);
+    }
+}
+
+/**
+ * @brief break at addr; in 0x4000-0x7FFF only while bank is mapped there
+ * @param pCondition NULL to always break
+ * @return the point's id, or -1 if the condition does not parse or all points are taken
+ */
+int debugAddBreakpoint(uint16_t, uint16_t, const char *);
+
+/**
+ * @brief break on DEBUG_WATCH_READ and/or DEBUG_WATCH_WRITE accesses to first -> last
+ */
+int debugAddWatchpoint(uint16_t, uint16_t, uint8_t, const char *);
+
+void debugRemove(int);
+void debugClear(void);
+
+/**
+ * @brief "[bank:]addr[,condition]"
+ */
+int debugParseBreakpoint(const char *);
+
+/**
+ * @brief "addr[-addr][:r|w|rw][,condition]", rw when not given
+ */
+int debugParseWatchpoint(const char *);
+
+/**
+ * @brief called on every hit. the default prints the hit and the registers, then calls debugTrap()
+ */
+void debugSetHandler(void (*)(const SDebugHit_t *));
+
+/**
+ * @brief does nothing, out of line: put the host debugger's breakpoint here
+ */
+void debugTrap(void);
+
+#endif //!_DEBUG_H_
@@ -0,0 +1,329 @@
+/**
+ * @file fetcher.c
+ * @author Toesoe
+ * @brief seaboy dot-accurate PPU engine: pixel fetcher and FIFOs
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#include <string.h>
+
+#include "ppu.h"
+#include "mem.h"
+#include "raster.h"
+#include "../drv/render.h"
+
+#define PIXEL_FIFO_SIZE 8
+#define FETCH_DOTS      6  // tile id, data low, data high: 2 dots each
+#define OBJ_FETCH_DOTS  6
+#define MODE3_MAX_DOTS  (456 - 80)
+
+typedef struct
+{
+    uint8_t color[PIXEL_FIFO_SIZE]; // 2bpp color indices
+    uint8_t attr[PIXEL_FIFO_SIZE];  // object attributes, OBJ FIFO only
+    uint8_t head;
+    uint8_t len;                    // BG FIFO only; the OBJ FIFO is always 8 wide, color 0 is empty
+} SFIFO_t;
+
+typedef struct
+{
+    uint32_t *pLine;
+    SLineRegs_t regs;
+    SFIFO_t bg;
+    SFIFO_t obj;
+    SSprite_t sprites[OBJS_PER_LINE];
+    uint8_t spriteCount;
+    uint16_t spritesFetched;  // bit per sprite
+    int8_t objFetching;       // sprite being fetched, -1 if none
+    int objStall;             // dots left on the object fetch
+    int dots;                 // dots into mode 3
+    uint8_t lx;               // next pixel to leave the FIFO
+    uint8_t discard;          // SCX fine scroll pixels still to drop
+    uint8_t fetchStep;        // 0..FETCH_DOTS; FETCH_DOTS = tile ready, waiting for an empty FIFO
+    uint8_t fetchCol;         // tile column being fetched, counted from the left of the line
+    uint8_t tileId;
+    uint8_t tileLo;
+    uint8_t tileHi;
+    bool dummyFetch;          // the first fetch of a line is thrown away
+    bool window;              // fetcher reads the window tilemap
+    uint8_t windowX;          // screen x at which the fetcher switches to the window
+    bool done;
+    const uint32_t *pBgLut;
+    const uint32_t *pObjLut[2];
+    uint32_t whiteLut[4];
+} SFetcherState_t;
+
+static SFetcherState_t g_fetcher;
+static bus_t *g_pBus = NULL;
+
+static void fetchTileId(uint8_t lcdc)
+{
+    uint16_t mapAddr;
+
+    if (g_fetcher.window)
+    {
+        mapAddr = (lcdc & LCDC_WIN_TILEMAP) ? 0x9C00 : 0x9800;
+        mapAddr += ((g_fetcher.regs.windowLine / 8) * 32) + (g_fetcher.fetchCol & 31);
+    }
+    else
+    {
+        uint8_t bgY = g_fetcher.regs.ly + g_pBus->map.ioregs.lcd.scy;
+        mapAddr = (lcdc & LCDC_BG_TILEMAP) ? 0x9C00 : 0x9800;
+        mapAddr += ((bgY / 8) * 32) + (((g_pBus->map.ioregs.lcd.scx / 8) + g_fetcher.fetchCol) & 31);
+    }
+
+    g_fetcher.tileId = g_pBus->bus[mapAddr];
+}
+
+static uint16_t tileRowAddr(uint8_t lcdc)
+{
+    uint8_t fineY = g_fetcher.window ? g_fetcher.regs.windowLine : (uint8_t)(g_fetcher.regs.ly + g_pBus->map.ioregs.lcd.scy);
+
+    return 0x8000 + rasterTileOffset(lcdc, g_fetcher.tileId) + ((fineY % 8) * 2);
+}
+
+/**
+ * @brief one dot of the BG/window fetcher
+ */
+static void fetcherDot(void)
+{
+    uint8_t lcdc = g_pBus->bus[0xFF40];
+
+    if (g_fetcher.fetchStep < FETCH_DOTS)
+    {
+        g_fetcher.fetchStep++;
+
+        switch (g_fetcher.fetchStep)
+        {
+            case 2: fetchTileId(lcdc); break;
+            case 4: g_fetcher.tileLo = g_pBus->bus[tileRowAddr(lcdc)]; break;
+            case 6: g_fetcher.tileHi = g_pBus->bus[tileRowAddr(lcdc) + 1]; break;
+            default: break;
+        }
+    }
+
+    if ((g_fetcher.fetchStep == FETCH_DOTS) && (g_fetcher.bg.len == 0))
+    {
+        g_fetcher.fetchStep = 0;
+
+        if (g_fetcher.dummyFetch)
+        {
+            g_fetcher.dummyFetch = false;
+            return;
+        }
+
+        rasterDecodeRow(g_fetcher.tileLo, g_fetcher.tileHi, g_fetcher.bg.color);
+        g_fetcher.bg.head = 0;
+        g_fetcher.bg.len = PIXEL_FIFO_SIZE;
+        g_fetcher.fetchCol++;
+    }
+}
+
+/**
+ * @brief next object whose left edge has been reached and that still has to be fetched
+ */
+static int8_t pendingSprite(void)
+{
+    if ((g_fetcher.discard > 0) || !(g_pBus->bus[0xFF40] & LCDC_OBJ_ENABLE))
+    {
+        return -1;
+    }
+
+    for (uint8_t i = 0; i < g_fetcher.spriteCount; i++)
+    {
+        if (!(g_fetcher.spritesFetched & (1 << i)) && (g_fetcher.sprites[i].x <= (g_fetcher.lx + 8)))
+        {
+            return (int8_t)i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief overlay a fetched object row onto the OBJ FIFO. earlier objects keep their opaque pixels
+ */
+static void mergeSprite(const SSprite_t *pSprite)
+{
+    uint8_t row[8];
+
+    rasterSpriteRow(pSprite, g_pBus->bus[0xFF40], g_fetcher.regs.ly, g_pBus->map.vram.all, row);
+
+    for (int i = 0; i < 8; i++)
+    {
+        int slot = (int)pSprite->x - 8 + i - g_fetcher.lx;
+
+        if ((slot < 0) || !row[i])
+        {
+            continue;
+        }
+
+        uint8_t idx = (g_fetcher.obj.head + slot) % PIXEL_FIFO_SIZE;
+
+        if (!g_fetcher.obj.color[idx])
+        {
+            g_fetcher.obj.color[idx] = row[i];
+            g_fetcher.obj.attr[idx] = pSprite->attr;
+        }
+    }
+}
+
+/**
+ * @brief WX reached: drop the queued BG pixels and restart the fetcher on the window tilemap
+ */
+static void startWindow(void)
+{
+    g_fetcher.window = true;
+    g_fetcher.bg.len = 0;
+    g_fetcher.fetchStep = 0;
+    g_fetcher.fetchCol = 0;
+
+    // WX below 7 pushes the window's first pixels off the left edge
+    g_fetcher.discard = (g_fetcher.regs.wx < 7) ? (uint8_t)(7 - g_fetcher.regs.wx) : 0;
+}
+
+/**
+ * @brief shift one pixel out of the FIFOs onto the line
+ */
+static void shiftDot(void)
+{
+    if (!g_fetcher.window && (g_fetcher.lx >= g_fetcher.windowX))
+    {
+        startWindow();
+        return;
+    }
+
+    if (g_fetcher.bg.len == 0)
+    {
+        return;
+    }
+
+    uint8_t color = g_fetcher.bg.color[g_fetcher.bg.head];
+    g_fetcher.bg.head = (g_fetcher.bg.head + 1) % PIXEL_FIFO_SIZE;
+    g_fetcher.bg.len--;
+
+    if (g_fetcher.discard > 0)
+    {
+        g_fetcher.discard--;
+        return;
+    }
+
+    uint8_t objColor = g_fetcher.obj.color[g_fetcher.obj.head];
+    uint8_t objAttr = g_fetcher.obj.attr[g_fetcher.obj.head];
+    g_fetcher.obj.color[g_fetcher.obj.head] = 0;
+    g_fetcher.obj.head = (g_fetcher.obj.head + 1) % PIXEL_FIFO_SIZE;
+
+    if (g_fetcher.pLine)
+    {
+        uint8_t lcdc = g_pBus->bus[0xFF40];
+        const uint32_t *pBgLut = g_fetcher.pBgLut;
+
+        if (!(lcdc & LCDC_BG_ENABLE))
+        {
+            color = 0;
+            pBgLut = g_fetcher.whiteLut;
+        }
+
+        bool objVisible = objColor && (lcdc & LCDC_OBJ_ENABLE) && !((objAttr & OBJ_ATTR_BEHIND_BG) && color);
+
+        g_fetcher.pLine[g_fetcher.lx] = objVisible ? g_fetcher.pObjLut[(objAttr & OBJ_ATTR_PALETTE) ? 1 : 0][objColor] : pBgLut[color];
+    }
+
+    g_fetcher.lx++;
+    g_fetcher.done = g_fetcher.lx == DISP_WIDTH;
+}
+
+static void fifoDot(void)
+{
+    g_fetcher.dots++;
+
+    if (g_fetcher.objStall > 0)
+    {
+        if (--g_fetcher.objStall == 0)
+        {
+            mergeSprite(&g_fetcher.sprites[g_fetcher.objFetching]);
+            g_fetcher.spritesFetched |= 1 << g_fetcher.objFetching;
+            g_fetcher.objFetching = -1;
+        }
+        return;
+    }
+
+    int8_t sprite = pendingSprite();
+
+    if (sprite >= 0)
+    {
+        // the BG fetch in progress has to get to its last step before the object fetch starts
+        if (g_fetcher.fetchStep < (FETCH_DOTS - 1))
+        {
+            fetcherDot();
+            return;
+        }
+
+        g_fetcher.objFetching = sprite;
+        g_fetcher.objStall = OBJ_FETCH_DOTS - 1; // this dot is the first of the fetch
+        return;
+    }
+
+    shiftDot();
+    fetcherDot();
+
+    if (g_fetcher.dots >= MODE3_MAX_DOTS)
+    {
+        g_fetcher.done = true;
+    }
+}
+
+static void fifoStartLine(const SLineRegs_t *pRegs, uint32_t *pLine)
+{
+    if (!g_pBus)
+    {
+        g_pBus = pGetBusPtr();
+    }
+
+    memset(&g_fetcher, 0, sizeof(g_fetcher));
+    memcpy(&g_fetcher.regs, pRegs, sizeof(SLineRegs_t));
+
+    g_fetcher.pLine = pLine;
+    g_fetcher.objFetching = -1;
+    g_fetcher.dummyFetch = true;
+    g_fetcher.windowX = rasterWindowX(pRegs);
+    g_fetcher.discard = pRegs->scx % 8;
+
+    // OAM scan result for the line (mode 2 on hardware)
+    if (pRegs->lcdc & LCDC_OBJ_ENABLE)
+    {
+        g_fetcher.spriteCount = rasterScanOam(g_pBus->map.oam, pRegs->lcdc, pRegs->ly, g_fetcher.sprites);
+    }
+
+    g_fetcher.pBgLut = pGetPaletteLut(PALETTE_BGP);
+    g_fetcher.pObjLut[0] = pGetPaletteLut(PALETTE_OBP0);
+    g_fetcher.pObjLut[1] = pGetPaletteLut(PALETTE_OBP1);
+    renderBuildLut(0x00, g_fetcher.whiteLut);
+}
+
+static bool fifoRunMode3(int *pDots)
+{
+    while (!g_fetcher.done && (*pDots > 0))
+    {
+        fifoDot();
+        (*pDots)--;
+    }
+
+    return g_fetcher.done;
+}
+
+static const SPPUEngine_t g_fifoEngine = {
+    .pName = "fifo",
+    .pfnStartLine = fifoStartLine,
+    .pfnRunMode3 = fifoRunMode3,
+    .pfnRegisterWrite = NULL
+};
+
+const SPPUEngine_t *pGetFifoEngine(void)
+{
+    return &g_fifoEngine;
+}
@@ -1,10 +1,184 @@
 /**
- * @file input.c
+ * @file joypad.c
  * @author Toesoe
- * @brief seaboy input handling
+ * @brief seaboy joypad (JOYP, 0xFF00)
  * @version 0.1
  * @date 2023-06-13
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
- */
\ No newline at end of file
+ *
+ */
+
+#include <string.h>
+
+#include "joypad.h"
+#include "mem.h"
+#include "state.h"
+#include "../drv/input.h"
+#include "../drv/movie.h"
+#include "../drv/trace.h"
+
+#define SELECT_DPAD    0x10 // P14: low selects the d-pad
+#define SELECT_BUTTONS 0x20 // P15: low selects A, B, select and start
+
+static uint64_t g_now = 0;
+static uint64_t g_nextCheck = 0;
+static uint8_t  g_buttons = 0; // EInputButton_t bits, 1 = pressed
+
+// picked up from the queue, not due yet, in cycle order
+static SInputEvent_t g_pending[INPUT_QUEUE_DEPTH];
+static size_t        g_pendingCount = 0;
+
+// save state: u64 cycle, u8 buttons held, 7 bytes 0
+#define JOYPAD_STATE_BYTES 16
+
+/**
+ * @brief P10 -> P13 as the CPU sees them: a held button in a selected group pulls its line low
+ */
+static uint8_t inputLines(void)
+{
+    uint8_t select = pGetBusPtr()->bus[0xFF00];
+    uint8_t lines = 0x0F;
+
+    if (!(select & SELECT_DPAD))
+    {
+        lines &= (uint8_t)~(g_buttons & 0x0F);
+    }
+
+    if (!(select & SELECT_BUTTONS))
+    {
+        lines &= (uint8_t)~(g_buttons >> 4);
+    }
+
+    return lines;
+}
+
+static void raiseOnFallingEdge(uint8_t before)
+{
+    if (before & ~inputLines())
+    {
+        pGetBusPtr()->map.ioregs.intFlags.joypad = 1;
+    }
+}
+
+static void apply(const SInputEvent_t *pEvent)
+{
+    uint8_t before = inputLines();
+
+    g_buttons = (uint8_t)((g_buttons & ~pEvent->mask) | (pEvent->state & pEvent->mask));
+    raiseOnFallingEdge(before);
+    inputCountApplied(pEvent, g_now);
+    movieRecordInput(g_now, pEvent->mask, pEvent->state);
+    TRACE(TRACE_INPUT_APPLY, g_now, pEvent->mask, pEvent->state);
+}
+
+/**
+ * @brief move queued events into the pending list, apply those that are due, and work out
+ *        when to look again
+ */
+static void service(void)
+{
+    SInputEvent_t event;
+
+    while ((g_pendingCount < INPUT_QUEUE_DEPTH) && inputPop(&event))
+    {
+        // after every event with the same cycle, so those keep their push order
+        size_t pos = g_pendingCount;
+
+        while ((pos > 0) && (g_pending[pos - 1].cycle > event.cycle))
+        {
+            g_pending[pos] = g_pending[pos - 1];
+            pos--;
+        }
+
+        g_pending[pos] = event;
+        g_pendingCount++;
+    }
+
+    size_t due = 0;
+
+    while ((due < g_pendingCount) && (g_pending[due].cycle <= g_now))
+    {
+        apply(&g_pending[due++]);
+    }
+
+    g_pendingCount -= due;
+    memmove(g_pending, &g_pending[due], g_pendingCount * sizeof(SInputEvent_t));
+
+    g_nextCheck = g_now + JOYPAD_DRAIN_CYCLES;
+
+    if ((g_pendingCount > 0) && (g_pending[0].cycle < g_nextCheck))
+    {
+        g_nextCheck = g_pending[0].cycle;
+    }
+}
+
+void joypadInit(void)
+{
+    g_now          = 0;
+    g_nextCheck    = 0;
+    g_buttons      = 0;
+    g_pendingCount = 0;
+}
+
+void joypadLoop(int cycles)
+{
+    g_now += (uint64_t)cycles;
+
+    if (g_now >= g_nextCheck)
+    {
+        service();
+    }
+}
+
+/**
+ * @brief events are only ever applied between instructions, so a movie lands them the same way
+ */
+uint8_t joypadBusRead(void)
+{
+    return (uint8_t)(0xC0 | (pGetBusPtr()->bus[0xFF00] & (SELECT_DPAD | SELECT_BUTTONS)) | inputLines());
+}
+
+void joypadBusWrite(uint8_t val)
+{
+    uint8_t before = inputLines();
+
+    // only the select lines are writable; the rest is built on read
+    pGetBusPtr()->bus[0xFF00] = (uint8_t)(0xC0 | (val & (SELECT_DPAD | SELECT_BUTTONS)) | 0x0F);
+    raiseOnFallingEdge(before);
+}
+
+uint64_t joypadGetCycle(void)
+{
+    return g_now;
+}
+
+uint8_t joypadGetButtons(void)
+{
+    return g_buttons;
+}
+
+size_t joypadStateSize(void)
+{
+    return JOYPAD_STATE_BYTES;
+}
+
+void joypadSaveState(uint8_t *pState)
+{
+    memset(pState, 0, JOYPAD_STATE_BYTES);
+    statePutU64(pState, g_now);
+    pState[8] = g_buttons;
+}
+
+void joypadLoadState(const uint8_t *pState)
+{
+    SInputEvent_t event;
+
+    // queued events were meant for another timeline
+    while (inputPop(&event));
+
+    g_now          = stateGetU64(pState);
+    g_buttons      = pState[8];
+    g_pendingCount = 0;
+    g_nextCheck    = g_now;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file joypad.h
+ * @author Toesoe
+ * @brief seaboy joypad (JOYP, 0xFF00)
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * button changes arrive through the input queue in drv/input.h, stamped with the cycle they
+ * belong to. JOYP is only worked out when it is read, from the buttons held at that cycle and
+ * the select lines. the joypad interrupt is raised when a selected line goes from 1 to 0.
+ */
+
+#ifndef _JOYPAD_H_
+#define _JOYPAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JOYPAD_DRAIN_CYCLES 456 // the queue is looked at least once per scanline
+
+/**
+ * @brief back to cycle 0, every button released
+ */
+void joypadInit(void);
+
+/**
+ * @brief advance by a number of T-cycles, applying the events that come due. an event queued
+ *        at least JOYPAD_DRAIN_CYCLES ahead of its cycle lands on the first instruction
+ *        boundary at or after it
+ */
+void joypadLoop(int);
+
+uint8_t joypadBusRead(void);
+void    joypadBusWrite(uint8_t);
+
+/**
+ * @brief the T-cycle clock events are stamped against
+ */
+uint64_t joypadGetCycle(void);
+
+/**
+ * @brief buttons held now, EInputButton_t bits
+ */
+uint8_t joypadGetButtons(void);
+
+/**
+ * @brief the clock and the buttons held, as a fixed-layout blob of joypadStateSize() bytes.
+ *        loading drops every event still queued or pending
+ */
+size_t joypadStateSize(void);
+void   joypadSaveState(uint8_t *);
+void   joypadLoadState(const uint8_t *);
+
+#endif //!_JOYPAD_H_
@@ -10,6 +10,11 @@
  */
 
 #include "mem.h"
+#include "ppu.h"
+#include "snd.h"
+#include "joypad.h"
+#include "debug.h"
+#include "../drv/trace.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -19,8 +24,9 @@
 static bus_t addressBus;
 static uint8_t *pRom;
 static size_t romSize;
+static bool lyStub = false;
+static uint16_t romBankNo = 1;
 
-#define DEBUG_WRITES
 #define TEST
 
 #ifndef TEST
@@ -50,6 +56,11 @@ void unmapBootrom(void)
     addressBus.map.ioregs.disableBootrom = 0;
 }
 
+void busSetLyStub(bool stub)
+{
+    lyStub = stub;
+}
+
 void resetBus(void)
 {
     memset(&addressBus, 0x00, sizeof(addressBus));
@@ -67,17 +78,48 @@ void overrideBus(bus_t *pBus)
     memcpy(&addressBus, pBus, sizeof(bus_t));
 }
 
-uint8_t fetch8(uint16_t addr)
+static inline uint8_t busRead(uint16_t addr)
 {
+    if (addr >= 0xFF00)
+    {
+        // one compare for everything outside IO
+        if (addr == 0xFF00)
+        {
+            return joypadBusRead();
+        }
+        if ((addr >= 0xFF10) && (addr <= 0xFF3F))
+        {
+            return sndBusRead(addr);
+        }
+        if ((addr == 0xFF44) && lyStub)
+        {
+            return 0x90;
+        }
+    }
     return addressBus.bus[addr];
 }
+
+uint8_t fetch8(uint16_t addr)
+{
+    uint8_t val = busRead(addr);
+
+    debugRead(addr, val);
+    return val;
+}
 uint16_t fetch16(uint16_t addr)
 {
-    return (uint16_t)(addressBus.bus[addr + 1] << 8) | addressBus.bus[addr];
+    uint8_t lo = busRead(addr);
+    uint8_t hi = busRead((uint16_t)(addr + 1));
+
+    debugRead(addr, lo);
+    debugRead((uint16_t)(addr + 1), hi);
+    return (uint16_t)(hi << 8) | lo;
 }
 
 void write8(uint8_t val, uint16_t addr)
 {
+    debugWrite(addr, val);
+
 #ifndef TEST
     if (addr < (ROMN_SIZE * 2))
     {
@@ -90,15 +132,10 @@ void write8(uint8_t val, uint16_t addr)
         {
             return;
         }
-        #ifdef DEBUG_WRITES
-        printf("VRAM WRITE %02X at %04X\n", val, addr);
-        #endif
     }
     else if ((addr >= 0xA000) && (addr <= ERAM_SIZE)) //&& cartramEnabled)
     {
-        #ifdef DEBUG_WRITES
-        printf("CARTRAM WRITE %02X at %04X bank %d\n", val, addr, ramBankNo);
-        #endif
+        TRACE(TRACE_MEM_CARTRAM, joypadGetCycle(), addr, val | (ramBankNo << 8));
         cartRam[addr + (ramBankNo * ERAM_SIZE)] = val;
     }
     else if (addr == 0xFF46) // OAM DMA
@@ -111,17 +148,34 @@ void write8(uint8_t val, uint16_t addr)
     {
         return;
     }
+    if ((addr >= 0x8000) && (addr < 0xA000))
+    {
+        TRACE(TRACE_MEM_VRAM, joypadGetCycle(), addr, val);
+    }
+    if (((addr >= 0x8000) && (addr < 0xA000)) ||
+        ((addr >= 0xFE00) && (addr < 0xFEA0)) ||
+        ((addr >= 0xFF40) && (addr <= 0xFF4B)))
+    {
+        ppuBusWrite(val, addr);
+    }
+    else if ((addr >= 0xFF10) && (addr <= 0xFF3F))
+    {
+        sndBusWrite(val, addr); // stores the byte itself
+        return;
+    }
+    else if (addr == 0xFF00)
+    {
+        joypadBusWrite(val); // only the select lines stick
+        return;
+    }
     addressBus.bus[addr] = val;
 }
 
 void write16(uint16_t val, uint16_t addr)
 {
-    if (addr < ROMN_SIZE * 2)
-    {
-        return;
-    }
-    addressBus.bus[addr]     = (uint8_t)(val & 0xFF);
-    addressBus.bus[addr + 1] = (uint8_t)(val >> 8);
+    // two byte stores, low first, so the PPU, APU and joypad see both
+    write8((uint8_t)(val & 0xFF), addr);
+    write8((uint8_t)(val >> 8), (uint16_t)(addr + 1));
 }
 
 bus_t *pGetBusPtr(void)
@@ -129,6 +183,20 @@ bus_t *pGetBusPtr(void)
     return &addressBus;
 }
 
+uint16_t busGetRomBank(void)
+{
+    return romBankNo;
+}
+
+bool busSwitchesRomBanks(void)
+{
+#ifdef TEST
+    return false;
+#else
+    return true;
+#endif
+}
+
 #ifndef TEST
 static void bankSwitch(uint8_t val, uint16_t addr)
 {
@@ -137,26 +205,27 @@ static void bankSwitch(uint8_t val, uint16_t addr)
         // RAM enable
         if ((val & 0xF) == 0xA)
         {
-            //printf("enabling cartram\n");
             cartramEnabled = true;
         }
         else
         {
-            //printf("disabling cartram\n");
             cartramEnabled = false;
         }
+
+        TRACE(TRACE_MBC_RAM_ENABLE, joypadGetCycle(), 0, cartramEnabled);
     }
     else if ((addr >= 0x2000) && (addr < ROMN_SIZE))
     {
         // switch bank. 0x1 -> 0x1F
         val &= 0x1F;
-        printf("switching rombank to %d\n", val);
+        TRACE(TRACE_MBC_ROM_BANK, joypadGetCycle(), 0, val);
+        romBankNo = val;
         memcpy(&addressBus.map.romn, pRom + (val * ROMN_SIZE), ROMN_SIZE);
     }
     else if ((addr >= ROMN_SIZE) && (addr < 0x6000))
     {
         // ram bank no
-        printf("switching rambank to %d\n", val);
+        TRACE(TRACE_MBC_RAM_BANK, joypadGetCycle(), 0, val);
         ramBankNo = val;
     }
     else if ((addr >= 0x6000) && (addr <= 0x8000))
@@ -165,14 +234,14 @@ static void bankSwitch(uint8_t val, uint16_t addr)
         if (val & 0x01)
         {
             // advanced banking
-            printf("enabling advanced banking mode");
             advancedBankingMode = true;
         }
         else
         {
-            printf("disabling advanced banking mode");
             advancedBankingMode = false;
         }
+
+        TRACE(TRACE_MBC_MODE, joypadGetCycle(), 0, advancedBankingMode);
     }
 }
 #endif
\ No newline at end of file
@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #define GB_BUS_SIZE     0x10000
 
@@ -173,6 +174,22 @@ void overrideBus(bus_t *);
 void mapRomIntoMem(uint8_t **, size_t);
 void unmapBootrom(void);
 
+/**
+ * @brief make LY (0xFF44) read as 0x90, as Gameboy Doctor logs are taken
+ */
+void busSetLyStub(bool);
+
+/**
+ * @brief the ROM bank mapped at 0x4000
+ */
+uint16_t busGetRomBank(void);
+
+/**
+ * @brief whether cartridge writes switch the ROM bank at 0x4000. while TEST leaves the MBC out,
+ *        they do not and bank 1 stays mapped
+ */
+bool busSwitchesRomBanks(void);
+
 uint8_t  fetch8(uint16_t);
 uint16_t fetch16(uint16_t);
 
@@ -11,10 +11,17 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include "ppu.h"
 #include "mem.h"
+#include "raster.h"
+#include "joypad.h"
 #include "../drv/render.h"
+#include "../drv/trace.h"
 
 #define LCD_VIEWPORT_X 160
 #define LCD_VIEWPORT_Y 144
@@ -32,85 +39,302 @@
 #define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
 
 #define TILE_SIZE_BYTES 16
-#define PIXEL_FIFO_SIZE 8
 #define OAM_MAX_SPRITES 10
 
 #define CYCLES_PER_FRAME 70224 // 154 scanlines * 456 cycle
+#define CYCLES_PER_LINE  456
+#define OAM_SCAN_CYCLES  80
+#define LINES_PER_FRAME  154
 
-typedef struct
-{
-    SPixel_t pixels[TILE_DIM_X][TILE_DIM_Y];
-} STile_t;
+#define FRAME_PERIOD_NS     16742706 // CYCLES_PER_FRAME at 4.194304 MHz
+#define FRAMESKIP_AUTO_MAX  8        // always show at least every 9th frame
+
+#define DEFERRED_RETRY_FRAMES 60 // immediate frames after a mid-frame VRAM/OAM write before deferring again
+
+// save state: u8 mode, u8 window triggered, u8 window line, u8 0, u16 line cycles, u16 0
+#define PPU_STATE_BYTES 8
 
 typedef struct
 {
     EPPUMode_t mode;
-    int cycleCount;
     int currentLineCycleCount;
-    uint8_t column;
-    uint8_t row;
-    SFIFO_t pixelFifo;
+    bool renderFrame;      // false: timing only, no pixel writes
+    const SPPUEngine_t *pEngine;
+    const SPPUEngine_t *pNextEngine; // swapped in at the next line
+    SLineRegs_t lineRegs;  // registers latched for the current line
+    bool windowTriggered;  // WY == LY seen this frame
+    uint8_t windowLine;    // window lines drawn this frame
 } SPPUState_t;
 
+typedef struct
+{
+    int setting;           // 0, N, or PPU_FRAMESKIP_AUTO
+    int skippedInRow;
+    uint64_t lastFrameNs;  // host time at the previous frame boundary
+    uint64_t lastRenderNs; // host time at which the last rendered frame started
+    uint64_t debtNs;       // how far behind real time the host has fallen
+} SFrameSkip_t;
+
+typedef struct
+{
+    SLineRegs_t lines[LCD_VIEWPORT_Y];
+    uint8_t lineCount;
+    uint8_t vram[VRAM_SIZE]; // only filled in for the worker
+    uint8_t oam[OAM_SIZE];
+} SDeferredFrame_t;
+
+typedef struct
+{
+    EPPURenderMode_t setting;
+    bool frameDeferred;     // current frame is logged instead of drawn
+    int retryCountdown;
+    uint32_t vramVersion;
+    uint32_t oamVersion;
+    SDeferredFrame_t log;   // frame being logged by ppuLoop
+    SDeferredFrame_t job;   // frame being rasterized by the worker
+    bool workerStarted;
+    bool jobPending;
+    pthread_t worker;
+    sem_t jobReady;
+    sem_t jobDone;
+} SDeferred_t;
+
 static SPPUState_t g_currentPPUState;
+static SFrameSkip_t g_frameSkip;
+static SDeferred_t g_deferred;
 static bus_t *g_pMemoryBus = NULL;
 
+static uint64_t hostNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
 /**
- * @brief builds current FIFO buffer, 8 pixels
+ * @brief decide at the frame boundary whether the upcoming frame gets rasterized
  * 
- * @param lx current X position
+ * auto mode renders at most once per frame period of host time (fast-forward), and skips
+ * while the host is behind real time (slow host), but never more than FRAMESKIP_AUTO_MAX in a row
  */
-static void fillPixelFifo(uint8_t lx)
+static bool shouldRenderFrame(void)
 {
-    bool isWindow = false;
-    uint8_t adjustedScanline = (g_pMemoryBus->map.ioregs.lcd.ly + g_pMemoryBus->map.ioregs.lcd.scy) % 256;
+    bool render = true;
+
+    if (g_frameSkip.setting == PPU_FRAMESKIP_AUTO)
+    {
+        uint64_t now = hostNs();
+        uint64_t frameNs = now - g_frameSkip.lastFrameNs;
+        g_frameSkip.lastFrameNs = now;
 
-    if (g_pMemoryBus->map.ioregs.lcd.control.bgWindowEnable) {
-        uint8_t windowEnd = g_pMemoryBus->map.ioregs.lcd.wy + ((g_pMemoryBus->map.ioregs.lcd.control.bgWindowTileMap ? 4 : 3) << 3);
-        if ((g_pMemoryBus->map.ioregs.lcd.ly >= g_pMemoryBus->map.ioregs.lcd.wy) &&
-             g_pMemoryBus->map.ioregs.lcd.ly < windowEnd) {
-            isWindow = true;
+        if (frameNs > FRAME_PERIOD_NS)
+        {
+            g_frameSkip.debtNs += frameNs - FRAME_PERIOD_NS;
+        }
+        else
+        {
+            uint64_t slack = FRAME_PERIOD_NS - frameNs;
+            g_frameSkip.debtNs = (slack > g_frameSkip.debtNs) ? 0 : g_frameSkip.debtNs - slack;
         }
+
+        // 3/4 of a period, so a paced real-time run is not thrown off by jitter
+        bool due = (now - g_frameSkip.lastRenderNs) >= ((FRAME_PERIOD_NS / 4) * 3);
+        render = (due && (g_frameSkip.debtNs < FRAME_PERIOD_NS)) || (g_frameSkip.skippedInRow >= FRAMESKIP_AUTO_MAX);
+
+        if (render)
+        {
+            g_frameSkip.lastRenderNs = now;
+        }
+    }
+    else if (g_frameSkip.setting > 0)
+    {
+        render = g_frameSkip.skippedInRow >= g_frameSkip.setting;
+    }
+
+    g_frameSkip.skippedInRow = render ? 0 : g_frameSkip.skippedInRow + 1;
+    return render;
+}
+
+static void captureLineRegs(SLineRegs_t *pRegs)
+{
+    pRegs->ly   = g_pMemoryBus->map.ioregs.lcd.ly;
+    pRegs->lcdc = g_pMemoryBus->bus[0xFF40];
+    pRegs->scy  = g_pMemoryBus->map.ioregs.lcd.scy;
+    pRegs->scx  = g_pMemoryBus->map.ioregs.lcd.scx;
+    pRegs->wy   = g_pMemoryBus->map.ioregs.lcd.wy;
+    pRegs->wx   = g_pMemoryBus->map.ioregs.lcd.wx;
+    pRegs->bgp  = g_pMemoryBus->bus[0xFF47];
+    pRegs->obp0 = g_pMemoryBus->bus[0xFF48];
+    pRegs->obp1 = g_pMemoryBus->bus[0xFF49];
+    pRegs->vramVersion = g_deferred.vramVersion;
+    pRegs->oamVersion  = g_deferred.oamVersion;
+
+    // the WY condition latches for the rest of the frame; the window line counter only moves on lines that show it
+    if (pRegs->ly == pRegs->wy)
+    {
+        g_currentPPUState.windowTriggered = true;
+    }
+
+    pRegs->windowTriggered = g_currentPPUState.windowTriggered;
+    pRegs->windowLine = g_currentPPUState.windowLine;
+
+    if (rasterWindowX(pRegs) < DISP_WIDTH)
+    {
+        g_currentPPUState.windowLine++;
+    }
+}
+
+static void rasterizeLoggedFrame(const SDeferredFrame_t *pFrame, const uint8_t *pVram, const uint8_t *pOam)
+{
+    for (uint8_t i = 0; i < pFrame->lineCount; i++)
+    {
+        const SLineRegs_t *pRegs = &pFrame->lines[i];
+
+        rasterizeLine(pRegs, pVram, pOam, pGetScanline(pRegs->ly));
+    }
+}
+
+static void *deferredWorker(void *pArg)
+{
+    (void)pArg;
+
+    while (true)
+    {
+        while ((sem_wait(&g_deferred.jobReady) == -1) && (errno == EINTR));
+
+        rasterizeLoggedFrame(&g_deferred.job, g_deferred.job.vram, g_deferred.job.oam);
+
+        sem_post(&g_deferred.jobDone);
     }
 
-    uint16_t tileMapBase = ((g_pMemoryBus->map.ioregs.lcd.control.bgTilemap && !isWindow) || (g_pMemoryBus->map.ioregs.lcd.control.bgWindowTileMap && isWindow)) ? 0x9C00 : 0x9800;
-    uint16_t tileAddr = tileMapBase;
+    return NULL;
+}
 
-    if (!isWindow) {
-        uint8_t row = (adjustedScanline / 8);
-        uint8_t col = ((lx + g_pMemoryBus->map.ioregs.lcd.scx) / 8);
-        tileAddr += (row * 32) + col;
-        //printf("BG Mode - TileMapBase: %04X, Row: %d, Col: %d, TileAddr: %04X\n", tileMapBase, row, col, tileAddr);
-    } else {
-        uint8_t row = ((g_pMemoryBus->map.ioregs.lcd.ly - g_pMemoryBus->map.ioregs.lcd.wy) / 8);
-        uint8_t col = (lx / 8);
-        tileAddr += (row * 32) + col;
-        //printf("Window Mode - TileMapBase: %04X, Row: %d, Col: %d, TileAddr: %04X\n", tileMapBase, row, col, tileAddr);
+/**
+ * @brief wait for the worker to finish its frame. it owns the frame target until then
+ */
+static void deferredSync(void)
+{
+    if (g_deferred.jobPending)
+    {
+        while ((sem_wait(&g_deferred.jobDone) == -1) && (errno == EINTR));
+        g_deferred.jobPending = false;
     }
+}
 
+static bool startDeferredWorker(void)
+{
+    if (g_deferred.workerStarted)
+    {
+        return true;
+    }
 
-    uint8_t tileId = fetch8(tileAddr);
+    sem_init(&g_deferred.jobReady, 0, 0);
+    sem_init(&g_deferred.jobDone, 0, 0);
 
-    // Debug: Print the fetched tile ID
-    //printf("Tile ID at (lx=%d, ly=%d): %02X\n", lx, g_pMemoryBus->map.ioregs.lcd.ly, tileId);
+    if (pthread_create(&g_deferred.worker, NULL, deferredWorker, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start deferred render worker, rasterizing on the emulation thread\n");
+        g_deferred.setting = PPU_RENDER_DEFERRED;
+        return false;
+    }
 
-    uint16_t tileRowAddr = g_pMemoryBus->map.ioregs.lcd.control.bgWindowTileData ? 0x8000 : 0x8800;
-    tileRowAddr += tileId * 16; // Each tile occupies 16 bytes (8x8 pixels)
+    g_deferred.workerStarted = true;
+    return true;
+}
 
-    uint8_t lsb = fetch8(tileRowAddr + (adjustedScanline % 8) * 2);
-    uint8_t msb = fetch8(tileRowAddr + (adjustedScanline % 8) * 2 + 1);
+/**
+ * @brief rasterize the logged frame at VBlank, or hand it to the worker together with a VRAM snapshot
+ */
+static void deferredSubmit(void)
+{
+    deferredSync();
 
-    // Debug: Print the fetched tile data
-    //printf("Tile data at (addr=%04X): LSB=%02X, MSB=%02X\n", tileRowAddr + (adjustedScanline % 8) * 2, lsb, msb);
+    if ((g_deferred.setting == PPU_RENDER_DEFERRED_WORKER) && startDeferredWorker())
+    {
+        memcpy(g_deferred.job.lines, g_deferred.log.lines, sizeof(SLineRegs_t) * g_deferred.log.lineCount);
+        memcpy(g_deferred.job.vram, g_pMemoryBus->map.vram.all, VRAM_SIZE);
+        memcpy(g_deferred.job.oam, g_pMemoryBus->map.oam, OAM_SIZE);
+        g_deferred.job.lineCount = g_deferred.log.lineCount;
 
-    for (size_t i = 0; i < PIXEL_FIFO_SIZE; i++) {
-        uint8_t pixel = 0;
-        pixel |= ((msb & (1 << (7 - i))) ? 2 : 0); // Combine MSB
-        pixel |= ((lsb & (1 << (7 - i))) ? 1 : 0); // Combine LSB
-        g_currentPPUState.pixelFifo.pixels[i] = pixel;
+        g_deferred.jobPending = true;
+        sem_post(&g_deferred.jobReady);
+    }
+    else
+    {
+        rasterizeLoggedFrame(&g_deferred.log, g_pMemoryBus->map.vram.all, g_pMemoryBus->map.oam);
     }
 
-    g_currentPPUState.pixelFifo.len = PIXEL_FIFO_SIZE;
+    g_deferred.log.lineCount = 0;
+}
+
+/**
+ * @brief VRAM/OAM is about to change under lines we only logged: draw them now, finish the frame immediately
+ */
+static void deferredFallback(void)
+{
+    deferredSync();
+    rasterizeLoggedFrame(&g_deferred.log, g_pMemoryBus->map.vram.all, g_pMemoryBus->map.oam);
+
+    g_deferred.log.lineCount = 0;
+    g_deferred.frameDeferred = false;
+    g_deferred.retryCountdown = DEFERRED_RETRY_FRAMES;
+}
+
+/**
+ * @brief frame boundary: publish the finished frame and decide how the next one is produced
+ *
+ * a frame the worker rasterizes is taken back here, so the frame outputs stay on the emulation
+ * thread; the worker has had the VBlank lines to finish it
+ */
+static void startFrame(void)
+{
+    if (g_currentPPUState.renderFrame)
+    {
+        deferredSync();
+        renderEndFrame();
+    }
+
+    g_currentPPUState.renderFrame = shouldRenderFrame();
+    g_currentPPUState.windowTriggered = false;
+    g_currentPPUState.windowLine = 0;
+
+    if (g_deferred.retryCountdown > 0)
+    {
+        g_deferred.retryCountdown--;
+    }
+
+    g_deferred.log.lineCount = 0;
+    g_deferred.frameDeferred = g_currentPPUState.renderFrame &&
+                               (g_deferred.setting != PPU_RENDER_IMMEDIATE) &&
+                               (g_currentPPUState.pEngine == pGetScanlineEngine()) &&
+                               (g_deferred.retryCountdown == 0);
+}
+
+/**
+ * @brief entering mode 3: log the line for later, or hand the engine somewhere to draw it
+ */
+static void startLine(void)
+{
+    uint32_t *pLine = NULL;
+
+    g_currentPPUState.pEngine = g_currentPPUState.pNextEngine;
+    captureLineRegs(&g_currentPPUState.lineRegs);
+
+    if (g_currentPPUState.renderFrame && g_deferred.frameDeferred)
+    {
+        if (g_deferred.log.lineCount < LCD_VIEWPORT_Y)
+        {
+            memcpy(&g_deferred.log.lines[g_deferred.log.lineCount++], &g_currentPPUState.lineRegs, sizeof(SLineRegs_t));
+        }
+    }
+    else if (g_currentPPUState.renderFrame)
+    {
+        deferredSync();
+        pLine = pGetScanline(g_currentPPUState.lineRegs.ly);
+    }
+
+    g_currentPPUState.pEngine->pfnStartLine(&g_currentPPUState.lineRegs, pLine);
 }
 
 void ppuInit(bool skipBootrom)
@@ -129,6 +353,160 @@ void ppuInit(bool skipBootrom)
     g_pMemoryBus->map.ioregs.lcd.control.lcdPPUEnable = 0;
     
     memset(&g_currentPPUState, 0, sizeof(g_currentPPUState));
+    g_currentPPUState.renderFrame = true;
+    g_currentPPUState.pEngine = pGetScanlineEngine();
+    g_currentPPUState.pNextEngine = g_currentPPUState.pEngine;
+
+    rasterInit();
+
+    renderUpdatePalette(PALETTE_BGP,  g_pMemoryBus->bus[0xFF47]);
+    renderUpdatePalette(PALETTE_OBP0, g_pMemoryBus->bus[0xFF48]);
+    renderUpdatePalette(PALETTE_OBP1, g_pMemoryBus->bus[0xFF49]);
+}
+
+size_t ppuStateSize(void)
+{
+    return PPU_STATE_BYTES;
+}
+
+void ppuSaveState(uint8_t *pState)
+{
+    uint16_t cycles = (uint16_t)g_currentPPUState.currentLineCycleCount;
+
+    memset(pState, 0, PPU_STATE_BYTES);
+    pState[0] = (uint8_t)g_currentPPUState.mode;
+    pState[1] = g_currentPPUState.windowTriggered ? 1 : 0;
+    pState[2] = g_currentPPUState.windowLine;
+    pState[4] = (uint8_t)cycles;
+    pState[5] = (uint8_t)(cycles >> 8);
+}
+
+/**
+ * @brief the frame in progress is drawn on from here, whatever was logged or handed to the
+ *        worker for it is dropped. engines and frame skip are settings and stay as they are
+ */
+void ppuLoadState(const uint8_t *pState)
+{
+    deferredSync();
+
+    g_currentPPUState.mode                  = (EPPUMode_t)(pState[0] & 0x03);
+    g_currentPPUState.windowTriggered       = pState[1] != 0;
+    g_currentPPUState.windowLine            = pState[2];
+    g_currentPPUState.currentLineCycleCount = pState[4] | (pState[5] << 8);
+
+    // the line registers are latched again when the next line starts
+    g_currentPPUState.pEngine = g_currentPPUState.pNextEngine;
+
+    g_deferred.frameDeferred = false;
+    g_deferred.log.lineCount = 0;
+    g_deferred.vramVersion++;
+    g_deferred.oamVersion++;
+
+    // the bus came back without going through ppuBusWrite
+    renderUpdatePalette(PALETTE_BGP,  g_pMemoryBus->bus[0xFF47]);
+    renderUpdatePalette(PALETTE_OBP0, g_pMemoryBus->bus[0xFF48]);
+    renderUpdatePalette(PALETTE_OBP1, g_pMemoryBus->bus[0xFF49]);
+}
+
+void ppuFlush(void)
+{
+    deferredSync();
+}
+
+void ppuSetEngine(EPPUEngine_t engine)
+{
+    switch (engine)
+    {
+        case PPU_ENGINE_CAPTURE: g_currentPPUState.pNextEngine = pGetCaptureEngine(); break;
+        case PPU_ENGINE_FIFO:    g_currentPPUState.pNextEngine = pGetFifoEngine();    break;
+        default:                 g_currentPPUState.pNextEngine = pGetScanlineEngine(); break;
+    }
+}
+
+void ppuSetFrameSkip(int setting)
+{
+    g_frameSkip.setting = setting;
+    g_frameSkip.skippedInRow = 0;
+    g_frameSkip.debtNs = 0;
+    g_frameSkip.lastFrameNs = hostNs();
+    g_frameSkip.lastRenderNs = 0;
+}
+
+void ppuSetRenderMode(EPPURenderMode_t mode)
+{
+    deferredSync();
+
+    if (g_deferred.frameDeferred && (mode == PPU_RENDER_IMMEDIATE))
+    {
+        deferredFallback();
+        g_deferred.retryCountdown = 0;
+    }
+
+    g_deferred.setting = mode;
+}
+
+/**
+ * @brief called by the bus before VRAM, OAM or a PPU register is written
+ * 
+ * @param val value being written
+ * @param addr register address
+ */
+void ppuBusWrite(uint8_t val, uint16_t addr)
+{
+    if (addr < 0xA000)
+    {
+        g_deferred.vramVersion++;
+    }
+    else if ((addr < 0xFF00) || (addr == 0xFF46))
+    {
+        g_deferred.oamVersion++;
+    }
+
+    if ((addr < 0xFF00) || (addr == 0xFF46))
+    {
+        if (g_deferred.frameDeferred && (g_deferred.log.lineCount > 0))
+        {
+            deferredFallback();
+        }
+        return;
+    }
+
+    if ((g_currentPPUState.mode == MODE_3) && g_currentPPUState.pEngine->pfnRegisterWrite)
+    {
+        g_currentPPUState.pEngine->pfnRegisterWrite(val, addr);
+    }
+
+    if ((addr >= 0xFF47) && (addr <= 0xFF49))
+    {
+        // the worker reads the cached tables for lines that still use them
+        deferredSync();
+    }
+
+    switch (addr)
+    {
+        case 0xFF47: renderUpdatePalette(PALETTE_BGP, val);  break;
+        case 0xFF48: renderUpdatePalette(PALETTE_OBP0, val); break;
+        case 0xFF49: renderUpdatePalette(PALETTE_OBP1, val); break;
+        default: break;
+    }
+}
+
+/**
+ * @brief advance the current line by a number of PPU cycles
+ */
+static void consumeCycles(int *pCyclesToRun, int cycles)
+{
+    *pCyclesToRun -= cycles;
+    g_currentPPUState.currentLineCycleCount += cycles;
+}
+
+/**
+ * @brief cycles left until the given point in the current line, capped by the cycles available
+ */
+static int cyclesUntil(int lineCycle, int cyclesToRun)
+{
+    int cycles = lineCycle - g_currentPPUState.currentLineCycleCount;
+    return (cycles < cyclesToRun) ? cycles : cyclesToRun;
 }
 
 /**
@@ -149,30 +527,24 @@ bool ppuLoop(int cyclesToRun)
         {
             case MODE_2:
             {
-                // OAM scan
-                // search for OBJs which overlap line
-                // TODO: implement
+                // OAM scan; the engine picks the line's objects when mode 3 starts
+                consumeCycles(&cyclesToRun, cyclesUntil(OAM_SCAN_CYCLES, cyclesToRun));
 
-                g_currentPPUState.currentLineCycleCount++;
-                if (g_currentPPUState.currentLineCycleCount == 80)
+                if (g_currentPPUState.currentLineCycleCount == OAM_SCAN_CYCLES)
                 {
                     g_currentPPUState.mode = MODE_3;
+                    startLine();
                 }
                 break;
             }
             case MODE_3:
             {
-                if (g_currentPPUState.column < 160)
-                {
-                    SPixel_t pixel = {g_currentPPUState.column, g_pMemoryBus->map.ioregs.lcd.ly, g_currentPPUState.pixelFifo.pixels[PIXEL_FIFO_SIZE - g_currentPPUState.pixelFifo.len]};
-                    setPixel(&pixel);
+                int cyclesLeft = cyclesToRun;
+                bool done = g_currentPPUState.pEngine->pfnRunMode3(&cyclesLeft);
 
-                    g_currentPPUState.pixelFifo.len--;
+                consumeCycles(&cyclesToRun, cyclesToRun - cyclesLeft);
 
-                    g_currentPPUState.column++;
-                    g_currentPPUState.currentLineCycleCount++;
-                }
-                else
+                if (done)
                 {
                     g_currentPPUState.mode = MODE_0;
                 }
@@ -180,12 +552,11 @@ bool ppuLoop(int cyclesToRun)
             }
             case MODE_0: // Hblank for remaining cycles until we hit 456
             {
-                g_currentPPUState.currentLineCycleCount++;
+                consumeCycles(&cyclesToRun, cyclesUntil(CYCLES_PER_LINE, cyclesToRun));
 
-                if (g_currentPPUState.currentLineCycleCount == 456)
+                if (g_currentPPUState.currentLineCycleCount == CYCLES_PER_LINE)
                 {
                     // line is done. reset counters
-                    g_currentPPUState.column = 0;
                     g_pMemoryBus->map.ioregs.lcd.ly++;
                     g_currentPPUState.currentLineCycleCount = 0;
 
@@ -194,6 +565,12 @@ bool ppuLoop(int cyclesToRun)
                         // go to Vblank if we processed the last line
                         g_currentPPUState.mode = MODE_1;
                         g_pMemoryBus->map.ioregs.intFlags.vblank = 1;
+                        TRACE(TRACE_PPU_VBLANK, joypadGetCycle(), LCD_VIEWPORT_Y, 0);
+
+                        if (g_deferred.frameDeferred && (g_deferred.log.lineCount > 0))
+                        {
+                            deferredSubmit();
+                        }
                     }
                     else
                     {
@@ -205,40 +582,28 @@ bool ppuLoop(int cyclesToRun)
             }
             case MODE_1: // Vblank for the remaining lines
             {
-                if (g_currentPPUState.cycleCount < CYCLES_PER_FRAME)
+                consumeCycles(&cyclesToRun, cyclesUntil(CYCLES_PER_LINE, cyclesToRun));
+
+                if (g_currentPPUState.currentLineCycleCount == CYCLES_PER_LINE)
                 {
-                    if (g_currentPPUState.currentLineCycleCount == 456)
+                    // end of line, increase ly
+                    g_pMemoryBus->map.ioregs.lcd.ly++;
+                    g_currentPPUState.currentLineCycleCount = 0;
+
+                    if (g_pMemoryBus->map.ioregs.lcd.ly == LINES_PER_FRAME)
                     {
-                        // end of line, increase ly
-                        g_pMemoryBus->map.ioregs.lcd.ly++;
-                        g_currentPPUState.currentLineCycleCount = 0;
+                        frameEnd = true;
+                        startFrame();
+                        g_currentPPUState.mode = MODE_2;
+                        g_pMemoryBus->map.ioregs.lcd.ly = 0;
+                        g_pMemoryBus->map.ioregs.intFlags.vblank = 0;
                     }
-                    g_currentPPUState.currentLineCycleCount++;
-                }
-                else
-                {
-                    frameEnd = true;
-                    debugFramebuffer();
-                    g_currentPPUState.mode = MODE_2;
-                    g_currentPPUState.currentLineCycleCount = 0;
-                    g_pMemoryBus->map.ioregs.lcd.ly = 0;
-                    g_currentPPUState.cycleCount = 0;
-                    g_pMemoryBus->map.ioregs.intFlags.vblank = 0;
                 }
-                
                 break;
             }
         }
-
-        if (g_currentPPUState.pixelFifo.len == 0)
-        {
-            fillPixelFifo(g_currentPPUState.column);
-        }
-
-        cyclesToRun--;
-        g_currentPPUState.cycleCount++;
     }
 
     g_pMemoryBus->map.ioregs.lcd.stat.ppuMode = g_currentPPUState.mode;
     return frameEnd;
-}
\ No newline at end of file
+}
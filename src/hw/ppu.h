@@ -16,11 +16,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+// DMG shades, as selected by the palette registers
 typedef enum {
-    BLACK = 0, // 00; transparent when used in objects
+    WHITE = 0, // 00
     LGRAY = 1, // 01
     DGRAY = 2, // 10
-    WHITE = 3  // 11
+    BLACK = 3  // 11
 } ETilePalette_t;
 
 typedef enum
@@ -31,16 +32,115 @@ typedef enum
     MODE_3  // drawing
 } EPPUMode_t;
 
+typedef enum
+{
+    PPU_RENDER_IMMEDIATE,       // pixels are produced during mode 3
+    PPU_RENDER_DEFERRED,        // mode 3 only logs line registers; the frame is rasterized at VBlank
+    PPU_RENDER_DEFERRED_WORKER  // as deferred, but rasterized on a worker thread during VBlank
+} EPPURenderMode_t;
+
+typedef enum
+{
+    PPU_ENGINE_SCANLINE, // whole line drawn when mode 3 starts, fixed mode 3 length
+    PPU_ENGINE_CAPTURE,  // as scanline, but register writes during mode 3 apply from the pixel they land on
+    PPU_ENGINE_FIFO,     // dot-accurate fetcher and pixel FIFOs, variable mode 3 length
+    PPU_ENGINE_COUNT
+} EPPUEngine_t;
+
+// everything a scanline needs from the PPU registers, captured at the start of mode 3
 typedef struct
 {
-    size_t len;
-    ETilePalette_t pixels[8];
-    size_t discardLeft;
-} SFIFO_t;
+    uint8_t ly;
+    uint8_t lcdc;
+    uint8_t scy;
+    uint8_t scx;
+    uint8_t wy;
+    uint8_t wx;
+    uint8_t bgp;
+    uint8_t obp0;
+    uint8_t obp1;
+    bool windowTriggered; // WY matched LY on this or an earlier line of the frame
+    uint8_t windowLine;   // internal window line counter: window lines drawn so far this frame
+    uint32_t vramVersion; // bumped on every VRAM write
+    uint32_t oamVersion;  // bumped on every OAM write / DMA
+} SLineRegs_t;
+
+/**
+ * @brief a PPU rendering engine. ppu.c owns modes, LY and timing; the engine owns mode 3
+ */
+typedef struct
+{
+    const char *pName;
+
+    /**
+     * @brief entering mode 3. pLine receives the line's pixels, or is NULL when the line is
+     *        not drawn (skipped frame, deferred log) and only its timing is needed
+     */
+    void (*pfnStartLine)(const SLineRegs_t *, uint32_t *);
+
+    /**
+     * @brief run mode 3 for at most *pDots dots, subtracting the dots used
+     * @return true once mode 3 is over for this line
+     */
+    bool (*pfnRunMode3)(int *);
+
+    /**
+     * @brief a PPU register is about to be written during mode 3. may be NULL
+     */
+    void (*pfnRegisterWrite)(uint8_t, uint16_t);
+} SPPUEngine_t;
+
+#define PPU_FRAMESKIP_AUTO (-1)
+
+#define PPU_MODE3_MIN_DOTS 172
 
 void buildTiles(uint32_t);
 
 void ppuInit(bool);
 bool ppuLoop(int);
 
+/**
+ * @brief select the PPU engine. takes effect at the next line
+ */
+void ppuSetEngine(EPPUEngine_t);
+
+const SPPUEngine_t *pGetScanlineEngine(void);
+const SPPUEngine_t *pGetCaptureEngine(void);
+const SPPUEngine_t *pGetFifoEngine(void);
+
+/**
+ * @brief skip rasterization of frames; timing, LY, STAT and interrupts are unaffected
+ * 
+ * 0 renders every frame, N renders one frame and then skips N, PPU_FRAMESKIP_AUTO follows host speed
+ */
+void ppuSetFrameSkip(int);
+
+/**
+ * @brief select immediate or deferred rasterization
+ * 
+ * deferred frames drop back to immediate on their own when VRAM or OAM is written mid-frame.
+ * only the scanline engine defers; the others always draw immediately
+ */
+void ppuSetRenderMode(EPPURenderMode_t);
+
+/**
+ * @brief wait for the render worker to finish the frame it was handed. call before tearing down
+ *        anything a frame is published to
+ */
+void ppuFlush(void);
+
+/**
+ * @brief notify the PPU of a CPU write to VRAM, OAM or one of its registers (0xFF40 -> 0xFF4B)
+ */
+void ppuBusWrite(uint8_t, uint16_t);
+
+/**
+ * @brief mode, line timing and window state, as a blob of ppuStateSize() bytes that does not
+ *        depend on the host. outside mode 3 only: the engines keep no state across lines, but do
+ *        inside one
+ */
+size_t ppuStateSize(void);
+void   ppuSaveState(uint8_t *);
+void   ppuLoadState(const uint8_t *);
+
 #endif //!_PPU_H_
\ No newline at end of file
@@ -0,0 +1,220 @@
+/**
+ * @file raster.c
+ * @author Toesoe
+ * @brief seaboy scanline rasterizer
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#include <string.h>
+
+#include "raster.h"
+#include "../drv/render.h"
+
+#define TILEMAP0_OFFSET 0x1800
+#define TILEMAP1_OFFSET 0x1C00
+
+#define OAM_ENTRIES 40
+
+// tile row byte -> one bit per byte lane, leftmost pixel in lane 0
+static uint64_t g_spread[256];
+static uint64_t g_spreadFlipped[256];
+
+void rasterInit(void)
+{
+    for (unsigned int b = 0; b < 256; b++)
+    {
+        uint64_t lanes = 0;
+        uint64_t flipped = 0;
+
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            lanes   |= (uint64_t)((b >> (7 - i)) & 1) << (i * 8);
+            flipped |= (uint64_t)((b >> i) & 1) << (i * 8);
+        }
+
+        g_spread[b] = lanes;
+        g_spreadFlipped[b] = flipped;
+    }
+}
+
+void rasterDecodeRow(uint8_t lo, uint8_t hi, uint8_t *pIdx)
+{
+    uint64_t lanes = g_spread[lo] | (g_spread[hi] << 1);
+    memcpy(pIdx, &lanes, sizeof(lanes));
+}
+
+/**
+ * @brief decode a run of tiles from one tilemap row into 2bpp color indices, 8 pixels per step
+ */
+static void decodeTileRow(const uint8_t *pVram, uint8_t lcdc, const uint8_t *pMapRow, uint8_t firstCol, uint8_t tiles, uint8_t fineY, uint8_t *pIdx)
+{
+    for (uint8_t t = 0; t < tiles; t++)
+    {
+        uint8_t tileId = pMapRow[(firstCol + t) & 31];
+        const uint8_t *pRow = &pVram[rasterTileOffset(lcdc, tileId) + (fineY * 2)];
+
+        rasterDecodeRow(pRow[0], pRow[1], &pIdx[t * 8]);
+    }
+}
+
+uint8_t rasterScanOam(const uint8_t *pOam, uint8_t lcdc, uint8_t ly, SSprite_t *pSprites)
+{
+    uint8_t height = (lcdc & LCDC_OBJ_TALL) ? 16 : 8;
+    uint8_t count = 0;
+
+    for (size_t i = 0; (i < OAM_ENTRIES) && (count < OBJS_PER_LINE); i++)
+    {
+        const uint8_t *pEntry = &pOam[i * 4];
+        int top = (int)pEntry[0] - 16;
+
+        if ((ly >= top) && (ly < (top + height)))
+        {
+            pSprites[count].y    = pEntry[0];
+            pSprites[count].x    = pEntry[1];
+            pSprites[count].tile = pEntry[2];
+            pSprites[count].attr = pEntry[3];
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void rasterSpriteRow(const SSprite_t *pSprite, uint8_t lcdc, uint8_t ly, const uint8_t *pVram, uint8_t *pIdx)
+{
+    bool tall = lcdc & LCDC_OBJ_TALL;
+    uint8_t row = (uint8_t)(ly + 16 - pSprite->y);
+    uint8_t tile = tall ? (pSprite->tile & 0xFE) : pSprite->tile;
+
+    if (pSprite->attr & OBJ_ATTR_YFLIP)
+    {
+        row = (tall ? 15 : 7) - row;
+    }
+
+    // objects always use 0x8000 addressing; a 16px row simply runs into the next tile
+    const uint8_t *pRow = &pVram[(tile * 16) + (row * 2)];
+    const uint64_t *pTable = (pSprite->attr & OBJ_ATTR_XFLIP) ? g_spreadFlipped : g_spread;
+    uint64_t lanes = pTable[pRow[0]] | (pTable[pRow[1]] << 1);
+
+    memcpy(pIdx, &lanes, sizeof(lanes));
+}
+
+/**
+ * @brief resolve which object pixel wins at every x: lowest X first, then lowest OAM index
+ */
+static void drawSprites(const SLineRegs_t *pRegs, const uint8_t *pVram, const SSprite_t *pSprites, uint8_t count, uint8_t *pObjIdx, uint8_t *pObjAttr)
+{
+    uint8_t order[OBJS_PER_LINE];
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t j = i;
+
+        // stable insertion sort on X keeps OAM order for ties
+        while ((j > 0) && (pSprites[order[j - 1]].x > pSprites[i].x))
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const SSprite_t *pSprite = &pSprites[order[i]];
+        uint8_t row[8];
+
+        rasterSpriteRow(pSprite, pRegs->lcdc, pRegs->ly, pVram, row);
+
+        for (int px = 0; px < 8; px++)
+        {
+            int x = (int)pSprite->x - 8 + px;
+
+            if ((x < 0) || (x >= DISP_WIDTH) || !row[px] || pObjIdx[x])
+            {
+                continue;
+            }
+
+            pObjIdx[x] = row[px];
+            pObjAttr[x] = pSprite->attr;
+        }
+    }
+}
+
+/**
+ * @brief BG and window color indices for a whole line. the window is a span from its start x to the right edge
+ */
+static void drawBackground(const SLineRegs_t *pRegs, const uint8_t *pVram, uint8_t *pLine)
+{
+    // 21 tiles cover 160 pixels at any fine scroll or window offset
+    uint8_t idx[21 * 8];
+    uint8_t winX = rasterWindowX(pRegs);
+
+    if (!(pRegs->lcdc & LCDC_BG_ENABLE))
+    {
+        // with LCDC.0 clear the BG and window are blank
+        memset(pLine, 0, DISP_WIDTH);
+        return;
+    }
+
+    if (winX > 0)
+    {
+        uint8_t bgY = pRegs->ly + pRegs->scy;
+        uint8_t fineX = pRegs->scx % 8;
+        const uint8_t *pMap = &pVram[(pRegs->lcdc & LCDC_BG_TILEMAP) ? TILEMAP1_OFFSET : TILEMAP0_OFFSET];
+
+        decodeTileRow(pVram, pRegs->lcdc, &pMap[(bgY / 8) * 32], pRegs->scx / 8, (uint8_t)((fineX + winX + 7) / 8), bgY % 8, idx);
+        memcpy(pLine, &idx[fineX], winX);
+    }
+
+    if (winX < DISP_WIDTH)
+    {
+        // WX below 7 pushes the window's first pixels off the left edge
+        uint8_t skip = (pRegs->wx < 7) ? (uint8_t)(7 - pRegs->wx) : 0;
+        uint8_t span = DISP_WIDTH - winX;
+        const uint8_t *pMap = &pVram[(pRegs->lcdc & LCDC_WIN_TILEMAP) ? TILEMAP1_OFFSET : TILEMAP0_OFFSET];
+
+        decodeTileRow(pVram, pRegs->lcdc, &pMap[(pRegs->windowLine / 8) * 32], 0, (uint8_t)((skip + span + 7) / 8), pRegs->windowLine % 8, idx);
+        memcpy(&pLine[winX], &idx[skip], span);
+    }
+}
+
+void rasterizeLine(const SLineRegs_t *pRegs, const uint8_t *pVram, const uint8_t *pOam, uint32_t *pOut)
+{
+    uint8_t bg[DISP_WIDTH];
+    uint32_t scratch[PALETTE_COUNT][4];
+
+    // with LCDC.0 clear the BG is color 0, always white
+    const uint32_t *pBgLut = pGetLineLut(PALETTE_BGP, (pRegs->lcdc & LCDC_BG_ENABLE) ? pRegs->bgp : 0x00, scratch[PALETTE_BGP]);
+    drawBackground(pRegs, pVram, bg);
+
+    SSprite_t sprites[OBJS_PER_LINE];
+    uint8_t spriteCount = (pRegs->lcdc & LCDC_OBJ_ENABLE) ? rasterScanOam(pOam, pRegs->lcdc, pRegs->ly, sprites) : 0;
+
+    if (spriteCount == 0)
+    {
+        for (size_t x = 0; x < DISP_WIDTH; x++)
+        {
+            pOut[x] = pBgLut[bg[x]];
+        }
+        return;
+    }
+
+    uint8_t objIdx[DISP_WIDTH] = { 0 };
+    uint8_t objAttr[DISP_WIDTH];
+    const uint32_t *pObjLut[2] = { pGetLineLut(PALETTE_OBP0, pRegs->obp0, scratch[PALETTE_OBP0]),
+                                   pGetLineLut(PALETTE_OBP1, pRegs->obp1, scratch[PALETTE_OBP1]) };
+
+    drawSprites(pRegs, pVram, sprites, spriteCount, objIdx, objAttr);
+
+    for (size_t x = 0; x < DISP_WIDTH; x++)
+    {
+        bool objVisible = objIdx[x] && !((objAttr[x] & OBJ_ATTR_BEHIND_BG) && bg[x]);
+
+        pOut[x] = objVisible ? pObjLut[(objAttr[x] & OBJ_ATTR_PALETTE) ? 1 : 0][objIdx[x]] : pBgLut[bg[x]];
+    }
+}
@@ -0,0 +1,95 @@
+/**
+ * @file raster.h
+ * @author Toesoe
+ * @brief seaboy scanline rasterizer
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#ifndef _RASTER_H_
+#define _RASTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ppu.h"
+#include "../drv/render.h"
+
+#define LCDC_BG_ENABLE    (1 << 0)
+#define LCDC_OBJ_ENABLE   (1 << 1)
+#define LCDC_OBJ_TALL     (1 << 2)
+#define LCDC_BG_TILEMAP   (1 << 3)
+#define LCDC_TILE_DATA    (1 << 4)
+#define LCDC_WINDOW       (1 << 5)
+#define LCDC_WIN_TILEMAP  (1 << 6)
+
+#define OBJ_ATTR_BEHIND_BG (1 << 7)
+#define OBJ_ATTR_YFLIP     (1 << 6)
+#define OBJ_ATTR_XFLIP     (1 << 5)
+#define OBJ_ATTR_PALETTE   (1 << 4)
+
+#define OBJS_PER_LINE 10
+
+// one OAM entry, as selected for a line during the OAM scan
+typedef struct
+{
+    uint8_t y;
+    uint8_t x;
+    uint8_t tile;
+    uint8_t attr;
+} SSprite_t;
+
+/**
+ * @brief offset of a tile's data from 0x8000, honouring the LCDC.4 addressing mode
+ */
+static inline uint16_t rasterTileOffset(uint8_t lcdc, uint8_t tileId)
+{
+    return (lcdc & LCDC_TILE_DATA) ? (uint16_t)(tileId * 16) : (uint16_t)(0x1000 + ((int8_t)tileId * 16));
+}
+
+/**
+ * @brief first screen x covered by the window on this line, DISP_WIDTH if there is no window
+ */
+static inline uint8_t rasterWindowX(const SLineRegs_t *pRegs)
+{
+    if (!pRegs->windowTriggered || !(pRegs->lcdc & LCDC_WINDOW) || (pRegs->wx > 166))
+    {
+        return DISP_WIDTH;
+    }
+
+    return (pRegs->wx < 7) ? 0 : (uint8_t)(pRegs->wx - 7);
+}
+
+void rasterInit(void);
+
+/**
+ * @brief OAM scan: up to 10 objects overlapping the line, in OAM order
+ * 
+ * @return amount of objects found
+ */
+uint8_t rasterScanOam(const uint8_t *, uint8_t, uint8_t, SSprite_t *);
+
+/**
+ * @brief decode one object's row on the given line to 8 color indices, left to right
+ */
+void rasterSpriteRow(const SSprite_t *, uint8_t, uint8_t, const uint8_t *, uint8_t *);
+
+/**
+ * @brief decode a tile row's two bitplanes to 8 color indices, left to right
+ */
+void rasterDecodeRow(uint8_t, uint8_t, uint8_t *);
+
+/**
+ * @brief draw one full scanline: BG, window and objects
+ * 
+ * @param pRegs register state for the line
+ * @param pVram VRAM contents, starting at 0x8000
+ * @param pOam OAM contents, starting at 0xFE00
+ * @param pOut DISP_WIDTH pixels
+ */
+void rasterizeLine(const SLineRegs_t *, const uint8_t *, const uint8_t *, uint32_t *);
+
+#endif //!_RASTER_H_
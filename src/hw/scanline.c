@@ -0,0 +1,186 @@
+/**
+ * @file scanline.c
+ * @author Toesoe
+ * @brief seaboy scanline PPU engines
+ * @version 0.1
+ * @date 2024-03-15
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+
+#include <string.h>
+
+#include "ppu.h"
+#include "mem.h"
+#include "raster.h"
+#include "../drv/render.h"
+
+#define MAX_SEGMENTS    16
+#define FIFO_PIXEL_LEAD 12 // dots from mode 3 start to the first pixel leaving the FIFO
+
+typedef struct
+{
+    uint8_t x;         // first pixel these registers apply to
+    SLineRegs_t regs;
+} SSegment_t;
+
+typedef struct
+{
+    uint32_t *pLine;
+    int dots;          // dots into mode 3
+    uint8_t segmentCount;
+    SSegment_t segments[MAX_SEGMENTS];
+} SScanlineState_t;
+
+static SScanlineState_t g_line;
+static bus_t *g_pBus = NULL;
+
+static bool runFixedMode3(int *pDots)
+{
+    int step = PPU_MODE3_MIN_DOTS - g_line.dots;
+
+    if (step > *pDots)
+    {
+        step = *pDots;
+    }
+
+    *pDots -= step;
+    g_line.dots += step;
+
+    return g_line.dots == PPU_MODE3_MIN_DOTS;
+}
+
+/* fast scanline *********************************************************/
+
+static void scanlineStartLine(const SLineRegs_t *pRegs, uint32_t *pLine)
+{
+    if (!g_pBus)
+    {
+        g_pBus = pGetBusPtr();
+    }
+
+    g_line.dots = 0;
+
+    if (pLine)
+    {
+        rasterizeLine(pRegs, g_pBus->map.vram.all, g_pBus->map.oam, pLine);
+    }
+}
+
+static const SPPUEngine_t g_scanlineEngine = {
+    .pName = "scanline",
+    .pfnStartLine = scanlineStartLine,
+    .pfnRunMode3 = runFixedMode3,
+    .pfnRegisterWrite = NULL
+};
+
+/* scanline with mid-line register capture *******************************/
+
+static void captureStartLine(const SLineRegs_t *pRegs, uint32_t *pLine)
+{
+    if (!g_pBus)
+    {
+        g_pBus = pGetBusPtr();
+    }
+
+    g_line.pLine = pLine;
+    g_line.dots = 0;
+    g_line.segmentCount = 1;
+    g_line.segments[0].x = 0;
+    memcpy(&g_line.segments[0].regs, pRegs, sizeof(SLineRegs_t));
+}
+
+/**
+ * @brief record a register write at the pixel the FIFO would be outputting right now
+ */
+static void captureRegisterWrite(uint8_t val, uint16_t addr)
+{
+    if (!g_line.pLine)
+    {
+        return;
+    }
+
+    int x = g_line.dots - FIFO_PIXEL_LEAD;
+    x = (x < 0) ? 0 : ((x > DISP_WIDTH) ? DISP_WIDTH : x);
+
+    SSegment_t *pLast = &g_line.segments[g_line.segmentCount - 1];
+
+    if ((pLast->x != x) && (g_line.segmentCount < MAX_SEGMENTS))
+    {
+        memcpy(&g_line.segments[g_line.segmentCount], pLast, sizeof(SSegment_t));
+        pLast = &g_line.segments[g_line.segmentCount++];
+        pLast->x = (uint8_t)x;
+    }
+
+    switch (addr)
+    {
+        case 0xFF40: pLast->regs.lcdc = val; break;
+        case 0xFF42: pLast->regs.scy  = val; break;
+        case 0xFF43: pLast->regs.scx  = val; break;
+        case 0xFF47: pLast->regs.bgp  = val; break;
+        case 0xFF48: pLast->regs.obp0 = val; break;
+        case 0xFF49: pLast->regs.obp1 = val; break;
+        case 0xFF4A: pLast->regs.wy   = val; break;
+        case 0xFF4B: pLast->regs.wx   = val; break;
+        default: break;
+    }
+}
+
+/**
+ * @brief draw the line at the end of mode 3, one pass per register segment
+ */
+static void captureFinishLine(void)
+{
+    if (g_line.segmentCount == 1)
+    {
+        rasterizeLine(&g_line.segments[0].regs, g_pBus->map.vram.all, g_pBus->map.oam, g_line.pLine);
+        return;
+    }
+
+    uint32_t scratch[DISP_WIDTH];
+
+    for (uint8_t i = 0; i < g_line.segmentCount; i++)
+    {
+        uint8_t x0 = g_line.segments[i].x;
+        uint8_t x1 = (i + 1 < g_line.segmentCount) ? g_line.segments[i + 1].x : DISP_WIDTH;
+
+        if (x1 <= x0)
+        {
+            continue;
+        }
+
+        rasterizeLine(&g_line.segments[i].regs, g_pBus->map.vram.all, g_pBus->map.oam, scratch);
+        memcpy(&g_line.pLine[x0], &scratch[x0], (x1 - x0) * sizeof(uint32_t));
+    }
+}
+
+static bool captureRunMode3(int *pDots)
+{
+    bool done = runFixedMode3(pDots);
+
+    if (done && g_line.pLine)
+    {
+        captureFinishLine();
+        g_line.pLine = NULL;
+    }
+
+    return done;
+}
+
+static const SPPUEngine_t g_captureEngine = {
+    .pName = "scanline+capture",
+    .pfnStartLine = captureStartLine,
+    .pfnRunMode3 = captureRunMode3,
+    .pfnRegisterWrite = captureRegisterWrite
+};
+
+const SPPUEngine_t *pGetScanlineEngine(void)
+{
+    return &g_scanlineEngine;
+}
+
+const SPPUEngine_t *pGetCaptureEngine(void)
+{
+    return &g_captureEngine;
+}
@@ -1,10 +1,1347 @@
 /**
- * @file audio.c
+ * @file snd.c
  * @author Toesoe
  * @brief seaboy audio emulation
  * @version 0.1
  * @date 2023-06-13
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
- */
\ No newline at end of file
+ *
+ * the channels are not stepped every cycle. time only moves forward in sndLoop(); the
+ * channels catch up ("sync") when a register is touched, when the frame sequencer ticks and
+ * at the end of each block. while catching up, a channel walks its own timer and records a
+ * delta in a band-limited step buffer (blip buffer) each time its output level changes.
+ * once per block the buffers are integrated into samples at the output rate, so the cost
+ * follows the number of level changes, not the 4 MHz clock.
+ *
+ * in deferred mode there are two APUs. the live one answers the CPU without synthesis, and every
+ * register write is also logged with its block time. at the end of a block a worker thread
+ * plays the log back on a replica that does synthesize, while the CPU runs the next block.
+ * both run the same code from the same writes, so the replica's registers, lengths and sweep
+ * never drift from what the CPU saw.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "snd.h"
+#include "sndmix.h"
+#include "mem.h"
+#include "state.h"
+#include "../drv/audio.h"
+#include "../drv/framehash.h"
+
+#define REG_NR10 0xFF10
+#define REG_NR11 0xFF11
+#define REG_NR12 0xFF12
+#define REG_NR13 0xFF13
+#define REG_NR14 0xFF14
+#define REG_NR21 0xFF16
+#define REG_NR22 0xFF17
+#define REG_NR23 0xFF18
+#define REG_NR24 0xFF19
+#define REG_NR30 0xFF1A
+#define REG_NR31 0xFF1B
+#define REG_NR32 0xFF1C
+#define REG_NR33 0xFF1D
+#define REG_NR34 0xFF1E
+#define REG_NR41 0xFF20
+#define REG_NR42 0xFF21
+#define REG_NR43 0xFF22
+#define REG_NR44 0xFF23
+#define REG_NR50 0xFF24
+#define REG_NR51 0xFF25
+#define REG_NR52 0xFF26
+#define REG_WAVE 0xFF30
+#define REG_COUNT 0x30 // 0xFF10 -> 0xFF3F
+
+#define REG(addr) (g_pApu->pRegs[(addr) - REG_NR10])
+
+#define CH_SQUARE1 0
+#define CH_SQUARE2 1
+#define CH_WAVE    2
+#define CH_NOISE   3
+#define CH_COUNT   4
+
+#define SIDE_LEFT  0
+#define SIDE_RIGHT 1
+
+#define BLIP_PHASE_BITS  5
+#define BLIP_PHASES      (1 << BLIP_PHASE_BITS)
+#define BLIP_TAPS        16
+#define BLIP_KERNEL_BITS 14
+#define BLIP_FRAC_BITS   32
+#define BLIP_CUTOFF      0.9 // of the output Nyquist frequency
+#define BLIP_BASS_SHIFT  9   // integrator leak: a ~15 Hz high-pass that removes the DACs' DC
+#define BLIP_BUF_SIZE    (SND_MAX_FRAME_SAMPLES + BLIP_TAPS + 1)
+
+#define PI 3.14159265358979323846 // M_PI is not in strict C
+
+#define VOLUME_UNIT 64 // output units per level step at full master volume: 4 * 15 * 8 * 64 < 32768
+
+// save state, per channel: u8 flags (enabled, DAC, length enable, envelope add), u8 duty, u8 volume,
+// u8 envelope period, u8 envelope timer, u8 0, u16 length, u16 frequency; then u8 flags (powered,
+// sweep enabled), u8 sequencer step, u8 sweep timer, u8 0, u32 block time, u32 next sequencer step,
+// u16 sweep shadow, u16 0. waveform phase only moves with synthesis on: it is left out, and a
+// load starts it as a trigger would
+#define SND_CH_STATE_BYTES 10
+#define SND_STATE_BYTES    ((CH_COUNT * SND_CH_STATE_BYTES) + 16)
+
+// the CPU writes at most once per M-cycle; the slack covers writes made outside the CPU loop
+#define LOG_ENTRIES ((SND_FRAME_CYCLES / 4) + 256)
+
+typedef struct
+{
+    bool     enabled;      // NR52 status bit
+    bool     dacOn;
+    bool     lengthEnable;
+    uint16_t length;       // length ticks left
+    uint16_t freq;         // 11-bit frequency register
+    uint32_t period;       // T-cycles between timer steps
+    uint32_t timerNext;    // block time of the next timer step
+    uint8_t  pos;          // duty step, or wave sample index
+    uint8_t  duty;
+    uint8_t  volume;       // envelope volume, or wave output shift
+    uint8_t  envPeriod;
+    uint8_t  envTimer;
+    bool     envAdd;
+    uint8_t  sample;       // wave: last sample read from wave RAM
+    uint8_t  level;        // digital output, 0 -> 15
+    int32_t  amp[2];       // amplitude last put in each side's blip buffer
+} SChannel_t;
+
+typedef struct
+{
+    SChannel_t ch[CH_COUNT];
+    uint8_t   *pRegs;      // 0xFF10 -> 0xFF3F: on the bus for the live APU, a private copy for the replica
+    bool       synthesis;  // run the channel timers and feed the output stage
+    bool       powered;
+    uint32_t   now;        // T-cycles into the current block
+    uint32_t   seqNext;    // block time of the next frame sequencer step
+    uint8_t    seqStep;
+    uint16_t   sweepShadow;
+    uint8_t    sweepTimer;
+    bool       sweepEnabled;
+    uint16_t   lfsr;
+    bool       noiseFrozen; // clock shift 14 or 15 stops the LFSR
+} SApu_t;
+
+typedef struct
+{
+    int32_t buf[BLIP_BUF_SIZE];
+    int32_t integrator;
+} SBlip_t;
+
+typedef struct
+{
+    uint32_t time; // block time of the write
+    uint16_t addr;
+    uint8_t  val;
+} SSndWrite_t;
+
+// each duty as the output of steps 0 -> 7
+static const uint8_t g_dutyTable[4] = { 0x80, 0x81, 0xE1, 0x7E };
+static const uint8_t g_noiseDivisor[8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+static const uint8_t g_waveShift[4] = { 4, 0, 1, 2 };
+
+// bits that read back as 1, 0xFF10 -> 0xFF2F. NR52 is built on read
+static const uint8_t g_readMask[0x20] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF, 0x9F, 0xFF, 0xBF, 0xFF,
+    0xFF, 0x00, 0x00, 0xBF, 0x00, 0x00, 0x70, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static SApu_t   g_live = { .synthesis = true }; // the one the CPU sees
+static SApu_t   g_replica;                      // deferred mode: the worker's, one block behind
+static uint8_t  g_replicaRegs[REG_COUNT];
+static _Thread_local SApu_t *g_pApu = &g_live;  // the worker thread switches to the replica
+static bool     g_synthesis = true; // false: registers, NR52, length and sweep only; no samples
+
+// output stage: owned by whichever APU synthesizes
+static SBlip_t  g_blip[2];
+static int16_t  g_kernel[BLIP_PHASES][BLIP_TAPS];
+static uint64_t g_baseFactor = 0; // output samples per T-cycle at the nominal rate, 32.32 fixed point
+static uint64_t g_factor = 0;     // the same, after the driver's rate control
+static uint64_t g_offset = 0; // fractional sample position of the block start
+static int16_t  g_block[2][SND_MAX_FRAME_SAMPLES * 2];
+static size_t   g_blockFrames[2];
+static atomic_uint g_blockIdx = 0; // the last finished block; the next one is written to the other
+
+static ESndOutput_t g_output = SND_OUTPUT_SINC;
+static ESndOutput_t g_nextOutput = SND_OUTPUT_SINC;
+
+// deferred mode. the CPU side fills g_log[g_logIdx] while the worker plays the other one
+static SSndWrite_t  g_log[2][LOG_ENTRIES];
+static size_t       g_logCount[2];
+static unsigned int g_logIdx = 0;
+static bool         g_logFull = false;
+static bool         g_deferred = false;
+static bool         g_nextDeferred = false;
+static pthread_t    g_worker;
+static sem_t        g_jobReady;
+static sem_t        g_jobDone;
+static bool         g_workerStarted = false;
+static bool         g_workerBusy = false;
+static bool         g_jobSynthesis = true; // settings for the block handed over, as they were at its end
+static ESndOutput_t g_jobOutput = SND_OUTPUT_SINC;
+
+static void buildKernel(void)
+{
+    const double half = BLIP_TAPS / 2;
+
+    for (int phase = 0; phase < BLIP_PHASES; phase++)
+    {
+        double taps[BLIP_TAPS];
+        double sum = 0.0;
+
+        // a step at fraction f past a sample peaks between taps half - 1 and half
+        for (int k = 0; k < BLIP_TAPS; k++)
+        {
+            double x = (double)k - (half - 1.0) - ((double)phase / BLIP_PHASES);
+            double w = 0.42 + (0.5 * cos(PI * x / half)) + (0.08 * cos(2.0 * PI * x / half));
+            double s = (x == 0.0) ? 1.0 : sin(PI * BLIP_CUTOFF * x) / (PI * BLIP_CUTOFF * x);
+
+            taps[k] = (fabs(x) < half) ? (w * s) : 0.0;
+            sum    += taps[k];
+        }
+
+        // every phase sums to exactly 1 << BLIP_KERNEL_BITS, so a step integrates to its full height
+        int32_t total = 0;
+        int     peak = 0;
+
+        for (int k = 0; k < BLIP_TAPS; k++)
+        {
+            g_kernel[phase][k] = (int16_t)lround(taps[k] * (1 << BLIP_KERNEL_BITS) / sum);
+            total += g_kernel[phase][k];
+
+            if (g_kernel[phase][k] > g_kernel[phase][peak])
+            {
+                peak = k;
+            }
+        }
+
+        g_kernel[phase][peak] += (int16_t)((1 << BLIP_KERNEL_BITS) - total);
+    }
+}
+
+static void blipAdd(int side, uint32_t time, int32_t delta)
+{
+    uint64_t       pos = g_offset + ((uint64_t)time * g_factor);
+    const int16_t *pKernel = g_kernel[(pos >> (BLIP_FRAC_BITS - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+    int32_t       *pOut = &g_blip[side].buf[pos >> BLIP_FRAC_BITS];
+
+    for (int k = 0; k < BLIP_TAPS; k++)
+    {
+        pOut[k] += delta * pKernel[k];
+    }
+}
+
+/**
+ * @brief integrate the first count samples of both buffers into pBlock, then shift the
+ *        kernel tails that reach into the next block to the front
+ */
+static void blipRead(int16_t *pBlock, size_t count)
+{
+    for (int side = 0; side < 2; side++)
+    {
+        SBlip_t *pBlip = &g_blip[side];
+        int32_t  sum = pBlip->integrator;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += pBlip->buf[i];
+
+            int32_t s = sum >> BLIP_KERNEL_BITS;
+            sum -= s * (1 << (BLIP_KERNEL_BITS - BLIP_BASS_SHIFT));
+
+            pBlock[(i * 2) + side] = (int16_t)((s > INT16_MAX) ? INT16_MAX : ((s < INT16_MIN) ? INT16_MIN : s));
+        }
+
+        pBlip->integrator = sum;
+        memmove(pBlip->buf, &pBlip->buf[count], (BLIP_TAPS + 1) * sizeof(int32_t));
+        memset(&pBlip->buf[BLIP_TAPS + 1], 0, (BLIP_BUF_SIZE - BLIP_TAPS - 1) * sizeof(int32_t));
+    }
+}
+
+/**
+ * @brief put a channel's current level on both sides, after NR50 and NR51
+ */
+static void updateAmp(int chIdx, uint32_t time)
+{
+    if (!g_pApu->synthesis || (g_output != SND_OUTPUT_BLIP))
+    {
+        return;
+    }
+
+    SChannel_t *pCh = &g_pApu->ch[chIdx];
+    uint8_t     panning = REG(REG_NR51);
+    uint8_t     master = REG(REG_NR50);
+
+    for (int side = 0; side < 2; side++)
+    {
+        int     shift = (side == SIDE_LEFT) ? 4 : 0;
+        bool    routed = (panning >> (chIdx + shift)) & 1;
+        int32_t amp = routed ? (int32_t)pCh->level * (((master >> shift) & 7) + 1) * VOLUME_UNIT : 0;
+
+        if (amp != pCh->amp[side])
+        {
+            blipAdd(side, time, amp - pCh->amp[side]);
+            pCh->amp[side] = amp;
+        }
+    }
+}
+
+/**
+ * @brief the NR50/NR51 gains, for the mixer in sndmix.c; the blip buffer pans in updateAmp()
+ */
+static void updateGains(uint32_t time)
+{
+    if (!g_pApu->synthesis || (g_output == SND_OUTPUT_BLIP))
+    {
+        return;
+    }
+
+    uint8_t panning = REG(REG_NR51);
+    uint8_t master = REG(REG_NR50);
+    float   gains[2][4];
+
+    for (int side = 0; side < 2; side++)
+    {
+        int shift = (side == SIDE_LEFT) ? 4 : 0;
+
+        for (int i = 0; i < CH_COUNT; i++)
+        {
+            bool routed = (panning >> (i + shift)) & 1;
+            gains[side][i] = routed ? (float)((((master >> shift) & 7) + 1) * VOLUME_UNIT) : 0.0f;
+        }
+    }
+
+    sndmixGains(time, gains);
+}
+
+static void setLevel(int chIdx, uint8_t level, uint32_t time)
+{
+    SChannel_t *pCh = &g_pApu->ch[chIdx];
+
+    if (pCh->level == level)
+    {
+        return;
+    }
+
+    if (g_pApu->synthesis && (g_output != SND_OUTPUT_BLIP))
+    {
+        sndmixLevel(chIdx, time, (int)level - (int)pCh->level);
+    }
+
+    pCh->level = level;
+    updateAmp(chIdx, time);
+}
+
+/**
+ * @brief bring the selected output stage in line with the current levels and gains
+ */
+static void restartOutput(uint32_t time)
+{
+    if (g_output == SND_OUTPUT_BLIP)
+    {
+        for (int i = 0; i < CH_COUNT; i++)
+        {
+            updateAmp(i, time);
+        }
+        return;
+    }
+
+    uint8_t levels[CH_COUNT];
+
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        levels[i] = g_pApu->ch[i].level;
+    }
+
+    sndmixReset(levels);
+    updateGains(time);
+}
+
+static uint8_t currentLevel(int chIdx)
+{
+    const SChannel_t *pCh = &g_pApu->ch[chIdx];
+
+    if (!pCh->enabled)
+    {
+        return 0;
+    }
+
+    switch (chIdx)
+    {
+        case CH_SQUARE1:
+        case CH_SQUARE2:
+            return ((g_dutyTable[pCh->duty] >> pCh->pos) & 1) ? pCh->volume : 0;
+        case CH_WAVE:
+            return pCh->sample >> pCh->volume;
+        default:
+            return (g_pApu->lfsr & 1) ? 0 : pCh->volume;
+    }
+}
+
+static void channelOff(int chIdx, uint32_t time)
+{
+    g_pApu->ch[chIdx].enabled = false;
+    setLevel(chIdx, 0, time);
+}
+
+static void updatePeriod(int chIdx)
+{
+    SChannel_t *pCh = &g_pApu->ch[chIdx];
+
+    if (chIdx == CH_NOISE)
+    {
+        uint8_t nr43 = REG(REG_NR43);
+
+        pCh->period       = (uint32_t)g_noiseDivisor[nr43 & 7] << (nr43 >> 4);
+        g_pApu->noiseFrozen = (nr43 >> 4) >= 14;
+    }
+    else
+    {
+        // a new period is picked up when the running one expires, as on hardware
+        pCh->period = (2048u - pCh->freq) * ((chIdx == CH_WAVE) ? 2u : 4u);
+    }
+}
+
+/**
+ * @brief step a timer over the (timerNext, until] span in one go; used while the output is fixed
+ */
+static uint32_t skipSteps(SChannel_t *pCh, uint32_t until)
+{
+    uint32_t steps = ((until - pCh->timerNext) / pCh->period) + 1;
+
+    pCh->timerNext += steps * pCh->period;
+
+    return steps;
+}
+
+static void runSquare(int chIdx, uint32_t until)
+{
+    SChannel_t *pCh = &g_pApu->ch[chIdx];
+
+    if (pCh->timerNext > until)
+    {
+        return;
+    }
+
+    // volume and enable only change at sync points, so silence lasts the whole span
+    if (!pCh->enabled || (pCh->volume == 0))
+    {
+        pCh->pos = (uint8_t)((pCh->pos + skipSteps(pCh, until)) & 7);
+        return;
+    }
+
+    uint8_t pattern = g_dutyTable[pCh->duty];
+
+    do
+    {
+        pCh->pos = (pCh->pos + 1) & 7;
+        setLevel(chIdx, ((pattern >> pCh->pos) & 1) ? pCh->volume : 0, pCh->timerNext);
+        pCh->timerNext += pCh->period;
+    } while (pCh->timerNext <= until);
+}
+
+static void runWave(uint32_t until)
+{
+    SChannel_t *pCh = &g_pApu->ch[CH_WAVE];
+
+    if (pCh->timerNext > until)
+    {
+        return;
+    }
+
+    if (!pCh->enabled)
+    {
+        pCh->pos = (uint8_t)((pCh->pos + skipSteps(pCh, until)) & 31);
+        return;
+    }
+
+    do
+    {
+        pCh->pos    = (pCh->pos + 1) & 31;
+        uint8_t val = REG(REG_WAVE + (pCh->pos >> 1));
+        pCh->sample = (pCh->pos & 1) ? (val & 0x0F) : (val >> 4);
+        setLevel(CH_WAVE, pCh->sample >> pCh->volume, pCh->timerNext);
+        pCh->timerNext += pCh->period;
+    } while (pCh->timerNext <= until);
+}
+
+static void runNoise(uint32_t until)
+{
+    SChannel_t *pCh = &g_pApu->ch[CH_NOISE];
+
+    if (g_pApu->noiseFrozen)
+    {
+        pCh->timerNext = until + 1;
+        return;
+    }
+
+    if (pCh->timerNext > until)
+    {
+        return;
+    }
+
+    // the LFSR is reset on trigger, so a disabled channel can skip it
+    if (!pCh->enabled)
+    {
+        skipSteps(pCh, until);
+        return;
+    }
+
+    bool width7 = REG(REG_NR43) & 0x08;
+
+    do
+    {
+        uint16_t bit = (g_pApu->lfsr ^ (g_pApu->lfsr >> 1)) & 1;
+
+        g_pApu->lfsr = (uint16_t)((g_pApu->lfsr >> 1) | (bit << 14));
+
+        if (width7)
+        {
+            g_pApu->lfsr = (uint16_t)((g_pApu->lfsr & ~(1u << 6)) | (bit << 6));
+        }
+
+        setLevel(CH_NOISE, (g_pApu->lfsr & 1) ? 0 : pCh->volume, pCh->timerNext);
+        pCh->timerNext += pCh->period;
+    } while (pCh->timerNext <= until);
+}
+
+static void runChannels(uint32_t until)
+{
+    runSquare(CH_SQUARE1, until);
+    runSquare(CH_SQUARE2, until);
+    runWave(until);
+    runNoise(until);
+}
+
+static uint16_t sweepCalc(uint32_t time)
+{
+    uint8_t  nr10 = REG(REG_NR10);
+    uint16_t delta = g_pApu->sweepShadow >> (nr10 & 7);
+    uint16_t freq = (nr10 & 0x08) ? (uint16_t)(g_pApu->sweepShadow - delta) : (uint16_t)(g_pApu->sweepShadow + delta);
+
+    if (freq > 2047)
+    {
+        channelOff(CH_SQUARE1, time);
+    }
+
+    return freq;
+}
+
+static void clockSweep(uint32_t time)
+{
+    uint8_t nr10 = REG(REG_NR10);
+    uint8_t period = (nr10 >> 4) & 7;
+
+    if (--g_pApu->sweepTimer != 0)
+    {
+        return;
+    }
+
+    g_pApu->sweepTimer = period ? period : 8;
+
+    if (!g_pApu->sweepEnabled || !period)
+    {
+        return;
+    }
+
+    uint16_t freq = sweepCalc(time);
+
+    if ((freq <= 2047) && (nr10 & 7))
+    {
+        SChannel_t *pCh = &g_pApu->ch[CH_SQUARE1];
+
+        g_pApu->sweepShadow = freq;
+        pCh->freq         = freq;
+        REG(REG_NR13) = (uint8_t)freq;
+        REG(REG_NR14) = (uint8_t)((REG(REG_NR14) & 0xF8) | (freq >> 8));
+        updatePeriod(CH_SQUARE1);
+        sweepCalc(time);
+    }
+}
+
+static void clockLength(uint32_t time)
+{
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        SChannel_t *pCh = &g_pApu->ch[i];
+
+        if (pCh->lengthEnable && (pCh->length > 0) && (--pCh->length == 0))
+        {
+            channelOff(i, time);
+        }
+    }
+}
+
+static void clockEnvelope(uint32_t time)
+{
+    static const int envChannels[3] = { CH_SQUARE1, CH_SQUARE2, CH_NOISE };
+
+    for (int i = 0; i < 3; i++)
+    {
+        int         chIdx = envChannels[i];
+        SChannel_t *pCh = &g_pApu->ch[chIdx];
+
+        if ((pCh->envPeriod == 0) || (--pCh->envTimer != 0))
+        {
+            continue;
+        }
+
+        pCh->envTimer = pCh->envPeriod;
+
+        if (pCh->envAdd && (pCh->volume < 15))
+        {
+            pCh->volume++;
+        }
+        else if (!pCh->envAdd && (pCh->volume > 0))
+        {
+            pCh->volume--;
+        }
+
+        setLevel(chIdx, currentLevel(chIdx), time);
+    }
+}
+
+static void sequencerStep(uint32_t time)
+{
+    if ((g_pApu->seqStep & 1) == 0)
+    {
+        clockLength(time);
+    }
+
+    if ((g_pApu->seqStep == 2) || (g_pApu->seqStep == 6))
+    {
+        clockSweep(time);
+    }
+
+    if (g_pApu->seqStep == 7)
+    {
+        clockEnvelope(time);
+    }
+
+    g_pApu->seqStep = (g_pApu->seqStep + 1) & 7;
+}
+
+/**
+ * @brief bring the channels and the frame sequencer up to a block time. without synthesis only
+ *        the sequencer runs: length and sweep are what decide the NR52 status bits, the channel
+ *        timers only shape the waveform
+ */
+static void syncTo(uint32_t time)
+{
+    while (g_pApu->seqNext <= time)
+    {
+        if (g_pApu->synthesis)
+        {
+            runChannels(g_pApu->seqNext);
+        }
+
+        if (g_pApu->powered)
+        {
+            sequencerStep(g_pApu->seqNext);
+        }
+
+        g_pApu->seqNext += SND_SEQ_CYCLES;
+    }
+
+    if (g_pApu->synthesis)
+    {
+        runChannels(time);
+    }
+}
+
+static void trigger(int chIdx)
+{
+    SChannel_t *pCh = &g_pApu->ch[chIdx];
+    uint32_t    now = g_pApu->now;
+
+    pCh->enabled = pCh->dacOn;
+
+    if (pCh->length == 0)
+    {
+        pCh->length = (chIdx == CH_WAVE) ? 256 : 64;
+    }
+
+    updatePeriod(chIdx);
+    pCh->timerNext = now + pCh->period;
+
+    if (chIdx == CH_WAVE)
+    {
+        pCh->pos = 0; // the sample buffer keeps playing until the first step
+    }
+    else
+    {
+        uint8_t nrx2 = REG((chIdx == CH_SQUARE1) ? REG_NR12 : ((chIdx == CH_SQUARE2) ? REG_NR22 : REG_NR42));
+
+        pCh->volume    = nrx2 >> 4;
+        pCh->envAdd    = nrx2 & 0x08;
+        pCh->envPeriod = nrx2 & 0x07;
+        pCh->envTimer  = pCh->envPeriod;
+    }
+
+    if (chIdx == CH_NOISE)
+    {
+        g_pApu->lfsr = 0x7FFF;
+    }
+
+    if (chIdx == CH_SQUARE1)
+    {
+        uint8_t nr10 = REG(REG_NR10);
+
+        g_pApu->sweepShadow  = pCh->freq;
+        g_pApu->sweepTimer   = ((nr10 >> 4) & 7) ? ((nr10 >> 4) & 7) : 8;
+        g_pApu->sweepEnabled = (nr10 & 0x77) != 0;
+
+        if (nr10 & 7)
+        {
+            sweepCalc(now);
+        }
+    }
+
+    setLevel(chIdx, currentLevel(chIdx), now);
+}
+
+static void setDac(int chIdx, bool on)
+{
+    g_pApu->ch[chIdx].dacOn = on;
+
+    if (!on)
+    {
+        channelOff(chIdx, g_pApu->now);
+    }
+}
+
+static void powerOff(void)
+{
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        SChannel_t *pCh = &g_pApu->ch[i];
+
+        channelOff(i, g_pApu->now);
+        pCh->dacOn        = false;
+        pCh->lengthEnable = false;
+        pCh->length       = 0;
+        pCh->freq         = 0;
+        pCh->duty         = 0;
+        pCh->pos          = 0;
+        pCh->volume       = 0;
+        pCh->envPeriod    = 0;
+        pCh->sample       = 0;
+    }
+
+    memset(g_pApu->pRegs, 0, REG_NR52 - REG_NR10);
+    g_pApu->powered = false;
+}
+
+static void writeRegister(uint8_t val, uint16_t addr)
+{
+    SChannel_t *pCh = g_pApu->ch;
+
+    switch (addr)
+    {
+        case REG_NR11:
+        case REG_NR21:
+            pCh[(addr - REG_NR11) / 5].duty   = val >> 6;
+            pCh[(addr - REG_NR11) / 5].length = 64 - (val & 0x3F);
+            break;
+        case REG_NR31:
+            pCh[CH_WAVE].length = 256 - val;
+            break;
+        case REG_NR41:
+            pCh[CH_NOISE].length = 64 - (val & 0x3F);
+            break;
+        case REG_NR12:
+        case REG_NR22:
+            setDac((addr - REG_NR12) / 5, (val & 0xF8) != 0);
+            break;
+        case REG_NR42:
+            setDac(CH_NOISE, (val & 0xF8) != 0);
+            break;
+        case REG_NR30:
+            setDac(CH_WAVE, val & 0x80);
+            break;
+        case REG_NR32:
+            pCh[CH_WAVE].volume = g_waveShift[(val >> 5) & 3];
+            setLevel(CH_WAVE, currentLevel(CH_WAVE), g_pApu->now);
+            break;
+        case REG_NR43:
+            updatePeriod(CH_NOISE);
+            break;
+        case REG_NR13:
+        case REG_NR14:
+        case REG_NR23:
+        case REG_NR24:
+        case REG_NR33:
+        case REG_NR34:
+        {
+            int      chIdx = (addr - REG_NR13) / 5;
+            uint16_t nrx3 = REG_NR13 + (uint16_t)(chIdx * 5);
+
+            pCh[chIdx].freq = (uint16_t)(((REG(nrx3 + 1) & 7) << 8) | REG(nrx3));
+            updatePeriod(chIdx);
+
+            if (addr == nrx3 + 1)
+            {
+                pCh[chIdx].lengthEnable = val & 0x40;
+
+                if (val & 0x80)
+                {
+                    trigger(chIdx);
+                }
+            }
+            break;
+        }
+        case REG_NR44:
+            pCh[CH_NOISE].lengthEnable = val & 0x40;
+
+            if (val & 0x80)
+            {
+                trigger(CH_NOISE);
+            }
+            break;
+        case REG_NR50:
+        case REG_NR51:
+            for (int i = 0; i < CH_COUNT; i++)
+            {
+                updateAmp(i, g_pApu->now);
+            }
+
+            updateGains(g_pApu->now);
+            break;
+        default:
+            break;
+    }
+}
+
+static void busWrite(uint8_t val, uint16_t addr)
+{
+    syncTo(g_pApu->now);
+
+    if (addr == REG_NR52)
+    {
+        if (!(val & 0x80) && g_pApu->powered)
+        {
+            powerOff();
+        }
+        else if ((val & 0x80) && !g_pApu->powered)
+        {
+            g_pApu->powered = true;
+            g_pApu->seqStep = 0;
+        }
+
+        REG(REG_NR52) = val & 0x80;
+        return;
+    }
+
+    // wave RAM stays writable while powered off
+    if (!g_pApu->powered && (addr < REG_WAVE))
+    {
+        return;
+    }
+
+    REG(addr) = val;
+    writeRegister(val, addr);
+}
+
+/**
+ * @brief the channel timers stood still: start every one afresh from time, and the output with them
+ */
+static void restartSynthesis(uint32_t time)
+{
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        updatePeriod(i);
+        g_pApu->ch[i].timerNext = time + g_pApu->ch[i].period;
+        g_pApu->ch[i].level     = currentLevel(i);
+    }
+
+    restartOutput(time);
+}
+
+/**
+ * @brief run up to the end of the block and make block times relative to the next one
+ */
+static void finishBlock(void)
+{
+    syncTo(SND_FRAME_CYCLES);
+
+    g_pApu->now     -= SND_FRAME_CYCLES;
+    g_pApu->seqNext -= SND_FRAME_CYCLES;
+}
+
+/**
+ * @brief turn the finished block into samples for the driver, an empty one without synthesis,
+ *        then switch to the next output stage
+ */
+static void renderBlock(ESndOutput_t next)
+{
+    unsigned int idx = atomic_load_explicit(&g_blockIdx, memory_order_relaxed) ^ 1;
+    size_t       frames = 0;
+
+    // without synthesis the channel timers stood still; restartSynthesis() picks them up
+    if (g_pApu->synthesis)
+    {
+        if (g_output == SND_OUTPUT_BLIP)
+        {
+            uint64_t end = g_offset + ((uint64_t)SND_FRAME_CYCLES * g_factor);
+
+            frames   = (size_t)(end >> BLIP_FRAC_BITS);
+            g_offset = end & ((1ull << BLIP_FRAC_BITS) - 1);
+            blipRead(g_block[idx], frames);
+        }
+        else
+        {
+            frames = sndmixRender(g_block[idx], g_output, audioGetRateRatio());
+        }
+
+        for (int i = 0; i < CH_COUNT; i++)
+        {
+            g_pApu->ch[i].timerNext -= SND_FRAME_CYCLES;
+        }
+
+        audioQueue(g_block[idx], frames);
+
+        // the next block is resampled a little faster or slower to keep the driver's ring on target
+        g_factor = (uint64_t)((double)g_baseFactor * audioGetRateRatio());
+    }
+
+    g_blockFrames[idx] = frames;
+    atomic_store_explicit(&g_blockIdx, idx, memory_order_release);
+
+    if (next != g_output)
+    {
+        g_output = next;
+
+        if (g_pApu->synthesis)
+        {
+            restartOutput(0);
+        }
+    }
+}
+
+static void *sndWorker(void *pArg)
+{
+    (void)pArg;
+
+    g_pApu = &g_replica;
+
+    for (;;)
+    {
+        while ((sem_wait(&g_jobReady) == -1) && (errno == EINTR));
+
+        if (g_jobSynthesis != g_replica.synthesis)
+        {
+            g_replica.synthesis = g_jobSynthesis;
+
+            if (g_jobSynthesis)
+            {
+                restartSynthesis(0);
+            }
+        }
+
+        const unsigned int idx = g_logIdx ^ 1;
+
+        for (size_t i = 0; i < g_logCount[idx]; i++)
+        {
+            const SSndWrite_t *pWrite = &g_log[idx][i];
+
+            g_replica.now = pWrite->time;
+            busWrite(pWrite->val, pWrite->addr);
+        }
+
+        g_replica.now = SND_FRAME_CYCLES;
+        finishBlock();
+        renderBlock(g_jobOutput);
+
+        sem_post(&g_jobDone);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief hash the block just finished, on the emulation thread so the hash log keeps one order
+ */
+static void hashBlock(void)
+{
+    size_t         frames;
+    const int16_t *pBlock = pGetSndBlock(&frames);
+
+    if (framehashEnabled() && (frames > 0))
+    {
+        framehashAudio(pBlock, frames * 2);
+    }
+}
+
+static void waitWorker(void)
+{
+    if (g_workerBusy)
+    {
+        while ((sem_wait(&g_jobDone) == -1) && (errno == EINTR));
+        g_workerBusy = false;
+        hashBlock();
+    }
+}
+
+/**
+ * @brief hand the finished block's log to the worker and start filling the other one
+ */
+static void submitBlock(void)
+{
+    waitWorker();
+
+    g_jobSynthesis = g_synthesis;
+    g_jobOutput    = g_nextOutput;
+    g_logIdx      ^= 1;
+    g_logCount[g_logIdx] = 0;
+    g_workerBusy   = true;
+
+    sem_post(&g_jobReady);
+}
+
+/**
+ * @brief at a block start: the replica takes over from the live APU, or the other way round.
+ *        both are exactly in step there, so nothing restarts and the output carries on
+ */
+static void switchDeferred(bool deferred)
+{
+    waitWorker();
+
+    if (deferred)
+    {
+        g_replica           = g_live;
+        g_replica.pRegs     = g_replicaRegs;
+        g_replica.now       = 0;
+        g_replica.synthesis = g_synthesis;
+        memcpy(g_replicaRegs, g_live.pRegs, REG_COUNT);
+
+        g_live.synthesis = false;
+        g_logCount[g_logIdx] = 0;
+        g_logFull = false;
+    }
+    else
+    {
+        uint8_t *pRegs = g_live.pRegs;
+        uint32_t now = g_live.now;
+
+        g_live       = g_replica;
+        g_live.pRegs = pRegs;
+        g_live.now   = now;
+    }
+
+    g_deferred = deferred;
+}
+
+static void logWrite(uint8_t val, uint16_t addr)
+{
+    size_t *pCount = &g_logCount[g_logIdx];
+
+    if (*pCount == LOG_ENTRIES)
+    {
+        if (!g_logFull)
+        {
+            fprintf(stderr, "sound: register write log full, the replica will drift\n");
+            g_logFull = true;
+        }
+        return;
+    }
+
+    g_log[g_logIdx][(*pCount)++] = (SSndWrite_t){ g_live.now, addr, val };
+}
+
+void sndInit(uint32_t sampleRate)
+{
+    waitWorker();
+
+    if (sampleRate > SND_MAX_RATE)
+    {
+        sampleRate = SND_MAX_RATE;
+    }
+
+    buildKernel();
+    sndmixInit(sampleRate);
+    memset(&g_live, 0, sizeof(g_live));
+    memset(g_blip, 0, sizeof(g_blip));
+
+    g_live.pRegs     = &pGetBusPtr()->bus[REG_NR10];
+    g_live.synthesis = g_synthesis;
+    memset(g_live.pRegs, 0, (REG_NR52 - REG_NR10) + 1);
+
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        updatePeriod(i);
+        g_live.ch[i].timerNext = g_live.ch[i].period;
+    }
+
+    g_live.seqNext = SND_SEQ_CYCLES;
+    g_live.lfsr    = 0x7FFF;
+    g_baseFactor   = ((uint64_t)sampleRate << BLIP_FRAC_BITS) / SND_CLOCK_HZ;
+    g_factor       = g_baseFactor;
+    g_offset       = 0;
+    g_output       = g_nextOutput;
+    memset(g_blockFrames, 0, sizeof(g_blockFrames));
+    restartOutput(0);
+
+    // a block start: a pending switch can happen right away
+    g_deferred = false;
+
+    if (g_nextDeferred)
+    {
+        switchDeferred(true);
+    }
+}
+
+void sndLoop(int cycles)
+{
+    g_live.now += (uint32_t)cycles;
+
+    if (g_live.now < SND_FRAME_CYCLES)
+    {
+        return;
+    }
+
+    finishBlock();
+
+    if (g_deferred)
+    {
+        submitBlock();
+    }
+    else
+    {
+        renderBlock(g_nextOutput);
+        hashBlock();
+    }
+
+    if (g_nextDeferred != g_deferred)
+    {
+        switchDeferred(g_nextDeferred);
+    }
+}
+
+void sndSetOutput(ESndOutput_t output)
+{
+    if (output < SND_OUTPUT_COUNT)
+    {
+        g_nextOutput = output;
+    }
+}
+
+bool sndSetDeferred(bool enable)
+{
+    if (enable && !g_workerStarted)
+    {
+        sem_init(&g_jobReady, 0, 0);
+        sem_init(&g_jobDone, 0, 0);
+
+        if (pthread_create(&g_worker, NULL, sndWorker, NULL) != 0)
+        {
+            fprintf(stderr, "cannot start sound thread, synthesizing in line\n");
+            sem_destroy(&g_jobReady);
+            sem_destroy(&g_jobDone);
+            return false;
+        }
+
+        pthread_detach(g_worker);
+        g_workerStarted = true;
+    }
+
+    g_nextDeferred = enable;
+    return true;
+}
+
+bool sndDeferred(void)
+{
+    return g_deferred;
+}
+
+void sndFlush(void)
+{
+    waitWorker();
+}
+
+void sndSetSynthesis(bool enable)
+{
+    if (enable == g_synthesis)
+    {
+        return;
+    }
+
+    g_synthesis = enable;
+
+    // deferred: the replica picks it up with the next block it is handed
+    if (g_deferred)
+    {
+        return;
+    }
+
+    if (g_live.pRegs)
+    {
+        syncTo(g_live.now);
+    }
+
+    g_live.synthesis = enable;
+
+    if (enable && g_live.pRegs)
+    {
+        // waveform phase was not tracked while off; start every timer afresh from here
+        restartSynthesis(g_live.now);
+    }
+}
+
+bool sndSynthesisEnabled(void)
+{
+    return g_synthesis;
+}
+
+size_t sndStateSize(void)
+{
+    return SND_STATE_BYTES;
+}
+
+void sndSaveState(uint8_t *pState)
+{
+    if (!g_live.pRegs)
+    {
+        g_live.pRegs = &pGetBusPtr()->bus[REG_NR10];
+    }
+
+    syncTo(g_live.now);
+    memset(pState, 0, SND_STATE_BYTES);
+
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        const SChannel_t *pCh = &g_live.ch[i];
+        uint8_t          *pDst = &pState[i * SND_CH_STATE_BYTES];
+
+        pDst[0] = (uint8_t)((pCh->enabled ? 0x01 : 0) | (pCh->dacOn ? 0x02 : 0) | (pCh->lengthEnable ? 0x04 : 0) |
+                            (pCh->envAdd ? 0x08 : 0));
+        pDst[1] = pCh->duty;
+        pDst[2] = pCh->volume;
+        pDst[3] = pCh->envPeriod;
+        pDst[4] = pCh->envTimer;
+        statePutU16(&pDst[6], pCh->length);
+        statePutU16(&pDst[8], pCh->freq);
+    }
+
+    pState += CH_COUNT * SND_CH_STATE_BYTES;
+    pState[0] = (uint8_t)((g_live.powered ? 0x01 : 0) | (g_live.sweepEnabled ? 0x02 : 0));
+    pState[1] = g_live.seqStep;
+    pState[2] = g_live.sweepTimer;
+    statePutU32(&pState[4], g_live.now);
+    statePutU32(&pState[8], g_live.seqNext);
+    statePutU16(&pState[12], g_live.sweepShadow);
+}
+
+/**
+ * @brief mid-block, so the replica cannot take over: deferred mode resumes at the next block
+ *        end. the channel timers start afresh, as after turning synthesis on, and the amplitudes
+ *        already in this session's output stage are kept
+ */
+void sndLoadState(const uint8_t *pState)
+{
+    waitWorker();
+
+    g_live.pRegs     = &pGetBusPtr()->bus[REG_NR10];
+    g_live.synthesis = g_synthesis;
+
+    for (int i = 0; i < CH_COUNT; i++)
+    {
+        SChannel_t    *pCh = &g_live.ch[i];
+        const uint8_t *pSrc = &pState[i * SND_CH_STATE_BYTES];
+
+        pCh->enabled      = pSrc[0] & 0x01;
+        pCh->dacOn        = pSrc[0] & 0x02;
+        pCh->lengthEnable = pSrc[0] & 0x04;
+        pCh->envAdd       = pSrc[0] & 0x08;
+        pCh->duty         = pSrc[1];
+        pCh->volume       = pSrc[2];
+        pCh->envPeriod    = pSrc[3];
+        pCh->envTimer     = pSrc[4];
+        pCh->length       = stateGetU16(&pSrc[6]);
+        pCh->freq         = stateGetU16(&pSrc[8]) & 0x7FF;
+        pCh->pos          = 0;
+        pCh->sample       = 0;
+    }
+
+    pState += CH_COUNT * SND_CH_STATE_BYTES;
+    g_live.powered      = pState[0] & 0x01;
+    g_live.sweepEnabled = pState[0] & 0x02;
+    g_live.seqStep      = pState[1];
+    g_live.sweepTimer   = pState[2];
+    g_live.now          = stateGetU32(&pState[4]);
+    g_live.seqNext      = stateGetU32(&pState[8]);
+    g_live.sweepShadow  = stateGetU16(&pState[12]);
+    g_live.lfsr         = 0x7FFF;
+
+    // derived from NR43, set again with the noise period
+    g_live.noiseFrozen = (g_live.pRegs[REG_NR43 - REG_NR10] >> 4) >= 14;
+
+    g_deferred = false;
+    g_logCount[g_logIdx] = 0;
+    g_logFull = false;
+
+    if (g_synthesis)
+    {
+        restartSynthesis(g_live.now);
+    }
+}
+
+void sndBusWrite(uint8_t val, uint16_t addr)
+{
+    if (!g_live.pRegs)
+    {
+        g_live.pRegs = &pGetBusPtr()->bus[REG_NR10];
+    }
+
+    if (g_deferred)
+    {
+        logWrite(val, addr);
+    }
+
+    busWrite(val, addr);
+}
+
+uint8_t sndBusRead(uint16_t addr)
+{
+    if (!g_live.pRegs)
+    {
+        g_live.pRegs = &pGetBusPtr()->bus[REG_NR10];
+    }
+
+    if (addr >= REG_WAVE)
+    {
+        return REG(addr);
+    }
+
+    if (addr == REG_NR52)
+    {
+        uint8_t status = g_live.powered ? 0xF0 : 0x70;
+
+        syncTo(g_live.now); // a length counter may have run out since the last sync
+
+        for (int i = 0; i < CH_COUNT; i++)
+        {
+            status |= (uint8_t)(g_live.ch[i].enabled << i);
+        }
+
+        return status;
+    }
+
+    return REG(addr) | g_readMask[addr - REG_NR10];
+}
+
+const int16_t *pGetSndBlock(size_t *pFrames)
+{
+    unsigned int idx = atomic_load_explicit(&g_blockIdx, memory_order_acquire);
+
+    *pFrames = g_blockFrames[idx];
+    return g_block[idx];
+}
@@ -0,0 +1,96 @@
+/**
+ * @file snd.h
+ * @author Toesoe
+ * @brief seaboy audio emulation
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef _SND_H_
+#define _SND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SND_CLOCK_HZ      4194304
+#define SND_FRAME_CYCLES  70224  // T-cycles per output block: one LCD frame
+#define SND_SEQ_CYCLES    8192   // T-cycles per frame sequencer step (512 Hz)
+#define SND_DEFAULT_RATE  48000
+#define SND_MAX_RATE      96000
+#define SND_MAX_FRAME_SAMPLES ((SND_MAX_RATE / 59) + 1)
+
+typedef enum
+{
+    SND_OUTPUT_BLIP,   // band-limited steps straight at the output rate; cheaper, more aliasing
+    SND_OUTPUT_SINC,   // channels mixed at 262 kHz, DC-blocked, windowed-sinc resampled. default
+    SND_OUTPUT_LINEAR, // as sinc, but linearly interpolated; the reference point for the benchmark
+    SND_OUTPUT_COUNT
+} ESndOutput_t;
+
+/**
+ * @brief reset the APU to its power-on state, producing stereo samples at sampleRate
+ */
+void sndInit(uint32_t);
+
+/**
+ * @brief advance the APU by a number of T-cycles. every SND_FRAME_CYCLES the block of
+ *        samples produced is handed to the audio driver
+ */
+void sndLoop(int);
+
+/**
+ * @brief select the output stage. takes effect at the next block
+ */
+void sndSetOutput(ESndOutput_t);
+
+/**
+ * @brief with synthesis off the APU keeps only what software can observe: registers, the NR52
+ *        channel bits, length counters, sweep and the frame sequencer. no waveforms, mixing or
+ *        samples; blocks are empty and nothing reaches the audio driver. on by default. in
+ *        deferred mode it applies from the next block
+ */
+void sndSetSynthesis(bool);
+bool sndSynthesisEnabled(void);
+
+/**
+ * @brief deferred synthesis: the CPU side only logs register writes with their block time and
+ *        answers reads from an APU without synthesis. at each block end a worker thread plays
+ *        the log back on a replica that synthesizes, in parallel with the next block; audio
+ *        comes out one block later but sample for sample the same. takes effect at the next
+ *        block. off by default
+ * @return false if the worker thread cannot be started
+ */
+bool sndSetDeferred(bool);
+bool sndDeferred(void);
+
+/**
+ * @brief wait until the worker has handed its block to the audio driver. call before audioStop()
+ */
+void sndFlush(void);
+
+/**
+ * @brief what the CPU can observe of the APU, as a fixed-layout blob of sndStateSize() bytes;
+ *        the registers themselves live on the bus. waveform phase is not kept across a load
+ */
+size_t sndStateSize(void);
+void   sndSaveState(uint8_t *);
+void   sndLoadState(const uint8_t *);
+
+/**
+ * @brief CPU access to 0xFF10 -> 0xFF3F. the APU stores the bytes itself: writes are ignored
+ *        while powered off, and reads come back with the write-only bits set
+ */
+void    sndBusWrite(uint8_t, uint16_t);
+uint8_t sndBusRead(uint16_t);
+
+/**
+ * @brief the last block handed to the driver, as interleaved stereo frames. valid until the
+ *        next block ends
+ */
+const int16_t *pGetSndBlock(size_t *);
+
+#endif //!_SND_H_
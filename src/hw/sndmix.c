@@ -0,0 +1,399 @@
+/**
+ * @file sndmix.c
+ * @author Toesoe
+ * @brief seaboy APU output stage: per-channel mixing, high-pass and resampling
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "sndmix.h"
+
+#define PI 3.14159265358979323846
+
+#define CHANNELS 4
+
+#define HPF_CUTOFF_HZ  20.0 // the DMG's output capacitor, roughly
+#define SINC_CUTOFF    0.45 // passband edge, of the output rate
+#define SINC_STOPBAND  80.0 // dB
+#define KAISER_BETA    (0.1102 * (SINC_STOPBAND - 8.7))
+#define PHASE_BITS     7    // log2(SNDMIX_PHASES)
+#define PHASE_FRAC_BITS 16  // position between two phases, for coefficient interpolation
+
+#define INPUT_SIZE (SNDMIX_MAX_TAPS + SNDMIX_BLOCK_SAMPLES + 8)
+
+typedef struct
+{
+    uint32_t start;   // first intermediate sample
+    float    gains[2][CHANNELS];
+} SSegment_t;
+
+// level deltas, four channel lanes per intermediate sample; a step is spread over two samples
+static _Alignas(16) float g_delta[SNDMIX_BLOCK_SAMPLES + 2][CHANNELS];
+static _Alignas(16) float g_level[CHANNELS]; // channel levels at the end of the last block
+
+static SSegment_t g_segments[SNDMIX_MAX_SEGMENTS];
+static int        g_segmentCount = 1;
+
+// resampler input per side: what the last block left over, then this block
+static _Alignas(16) float g_input[2][INPUT_SIZE];
+static size_t   g_inputLen = 0;
+static uint64_t g_pos = 0;    // 32.32 start of the next output's tap window in g_input
+static float    g_hpfIn[2];   // last input and output of the DC blocker
+static float    g_hpfOut[2];
+static float    g_hpfPole = 0.0f;
+
+static _Alignas(16) float g_kernel[SNDMIX_PHASES + 1][SNDMIX_MAX_TAPS];
+static int      g_taps = 4;
+static uint32_t g_rate = SND_DEFAULT_RATE;
+
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum  += term;
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Kaiser-windowed sinc, SNDMIX_PHASES + 1 rows so every phase has a right neighbour.
+ *        the tap count follows the transition band the output rate leaves
+ */
+static void buildKernel(void)
+{
+    double cutoff = SINC_CUTOFF * g_rate / SNDMIX_RATE; // cycles per intermediate sample
+    double transition = 2.0 * PI * (1.0 - (2.0 * SINC_CUTOFF)) * g_rate / SNDMIX_RATE;
+    int    taps = (int)ceil((SINC_STOPBAND - 8.0) / (2.285 * transition));
+
+    taps   = (taps + 3) & ~3;
+    g_taps = (taps > SNDMIX_MAX_TAPS) ? SNDMIX_MAX_TAPS : taps;
+
+    double half = g_taps / 2;
+
+    memset(g_kernel, 0, sizeof(g_kernel));
+
+    for (int phase = 0; phase <= SNDMIX_PHASES; phase++)
+    {
+        double sum = 0.0;
+        double row[SNDMIX_MAX_TAPS];
+
+        for (int j = 0; j < g_taps; j++)
+        {
+            double d = (double)j - (half - 1.0) - ((double)phase / SNDMIX_PHASES);
+            double x = d / half;
+            double w = (fabs(x) <= 1.0) ? besselI0(KAISER_BETA * sqrt(1.0 - (x * x))) / besselI0(KAISER_BETA) : 0.0;
+            double s = (d == 0.0) ? 1.0 : sin(2.0 * PI * cutoff * d) / (2.0 * PI * cutoff * d);
+
+            row[j] = w * s;
+            sum   += row[j];
+        }
+
+        // unity gain at DC in every phase
+        for (int j = 0; j < g_taps; j++)
+        {
+            g_kernel[phase][j] = (float)(row[j] / sum);
+        }
+    }
+}
+
+void sndmixInit(uint32_t sampleRate)
+{
+    g_rate = sampleRate;
+    buildKernel();
+
+    memset(g_delta, 0, sizeof(g_delta));
+    memset(g_level, 0, sizeof(g_level));
+    memset(g_segments, 0, sizeof(g_segments));
+    memset(g_input, 0, sizeof(g_input));
+    memset(g_hpfIn, 0, sizeof(g_hpfIn));
+    memset(g_hpfOut, 0, sizeof(g_hpfOut));
+
+    g_segmentCount = 1;
+    g_inputLen     = 0;
+    g_pos          = 0;
+    g_hpfPole      = (float)exp(-2.0 * PI * HPF_CUTOFF_HZ / SNDMIX_RATE);
+}
+
+void sndmixReset(const uint8_t *pLevels)
+{
+    memset(g_delta, 0, sizeof(g_delta));
+
+    for (int ch = 0; ch < CHANNELS; ch++)
+    {
+        g_level[ch] = pLevels[ch];
+    }
+}
+
+void sndmixLevel(int ch, uint32_t time, int delta)
+{
+    uint32_t idx = time / SNDMIX_DIV;
+    float    late = (float)(time % SNDMIX_DIV) / SNDMIX_DIV;
+
+    // sample idx averages the step over the part of its span after the step
+    g_delta[idx][ch]     += (float)delta * (1.0f - late);
+    g_delta[idx + 1][ch] += (float)delta * late;
+}
+
+void sndmixGains(uint32_t time, const float (*pGains)[4])
+{
+    uint32_t    start = time / SNDMIX_DIV;
+    SSegment_t *pLast = &g_segments[g_segmentCount - 1];
+
+    if ((start > pLast->start) && (g_segmentCount < SNDMIX_MAX_SEGMENTS))
+    {
+        pLast = &g_segments[g_segmentCount++];
+        pLast->start = start;
+    }
+
+    memcpy(pLast->gains, pGains, sizeof(pLast->gains));
+}
+
+/**
+ * @brief turn the deltas into levels in place. one add per sample covers all four channels
+ */
+static void integrate(void)
+{
+#ifdef __SSE2__
+    __m128 acc = _mm_load_ps(g_level);
+
+    for (size_t i = 0; i < SNDMIX_BLOCK_SAMPLES; i++)
+    {
+        acc = _mm_add_ps(acc, _mm_load_ps(g_delta[i]));
+        _mm_store_ps(g_delta[i], acc);
+    }
+
+    _mm_store_ps(g_level, acc);
+#else
+    for (size_t i = 0; i < SNDMIX_BLOCK_SAMPLES; i++)
+    {
+        for (int ch = 0; ch < CHANNELS; ch++)
+        {
+            g_level[ch]     += g_delta[i][ch];
+            g_delta[i][ch]   = g_level[ch];
+        }
+    }
+#endif
+}
+
+/**
+ * @brief mix levels [begin, end) with one segment's gains into the left and right inputs
+ */
+static void mixSegment(const SSegment_t *pSeg, size_t begin, size_t end, float *pLeft, float *pRight)
+{
+    size_t i = begin;
+
+#ifdef __SSE2__
+    __m128 gl[CHANNELS];
+    __m128 gr[CHANNELS];
+
+    for (int ch = 0; ch < CHANNELS; ch++)
+    {
+        gl[ch] = _mm_set1_ps(pSeg->gains[0][ch]);
+        gr[ch] = _mm_set1_ps(pSeg->gains[1][ch]);
+    }
+
+    // four samples at a time: transpose to one vector per channel, then weight and sum
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 c0 = _mm_load_ps(g_delta[i]);
+        __m128 c1 = _mm_load_ps(g_delta[i + 1]);
+        __m128 c2 = _mm_load_ps(g_delta[i + 2]);
+        __m128 c3 = _mm_load_ps(g_delta[i + 3]);
+
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+        __m128 left = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, gl[0]), _mm_mul_ps(c1, gl[1])),
+                                 _mm_add_ps(_mm_mul_ps(c2, gl[2]), _mm_mul_ps(c3, gl[3])));
+        __m128 right = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, gr[0]), _mm_mul_ps(c1, gr[1])),
+                                  _mm_add_ps(_mm_mul_ps(c2, gr[2]), _mm_mul_ps(c3, gr[3])));
+
+        _mm_storeu_ps(&pLeft[i], left);
+        _mm_storeu_ps(&pRight[i], right);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        float left = 0.0f;
+        float right = 0.0f;
+
+        for (int ch = 0; ch < CHANNELS; ch++)
+        {
+            left  += g_delta[i][ch] * pSeg->gains[0][ch];
+            right += g_delta[i][ch] * pSeg->gains[1][ch];
+        }
+
+        pLeft[i]  = left;
+        pRight[i] = right;
+    }
+}
+
+/**
+ * @brief first-order DC blocker, y = x - x' + p * y'. recursive, so one sample at a time
+ */
+static void highPass(float *pSamples, size_t count, int side)
+{
+    float in = g_hpfIn[side];
+    float out = g_hpfOut[side];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float x = pSamples[i];
+
+        out         = x - in + (g_hpfPole * out);
+        in          = x;
+        pSamples[i] = out;
+    }
+
+    g_hpfIn[side]  = in;
+    g_hpfOut[side] = out;
+}
+
+static inline int16_t toSample(float val)
+{
+    long s = lrintf(val);
+
+    return (int16_t)((s > INT16_MAX) ? INT16_MAX : ((s < INT16_MIN) ? INT16_MIN : s));
+}
+
+static void sincFrame(size_t idx, uint32_t frac, int16_t *pOut)
+{
+    const float *pK0 = g_kernel[frac >> (32 - PHASE_BITS)];
+    const float *pK1 = pK0 + SNDMIX_MAX_TAPS;
+    const float  mu = (float)((frac >> (32 - PHASE_BITS - PHASE_FRAC_BITS)) & ((1u << PHASE_FRAC_BITS) - 1)) /
+                      (float)(1u << PHASE_FRAC_BITS);
+    const float *pL = &g_input[0][idx];
+    const float *pR = &g_input[1][idx];
+    float        left;
+    float        right;
+
+#ifdef __SSE2__
+    __m128 vmu = _mm_set1_ps(mu);
+    __m128 accL = _mm_setzero_ps();
+    __m128 accR = _mm_setzero_ps();
+
+    for (int j = 0; j < g_taps; j += 4)
+    {
+        __m128 k0 = _mm_load_ps(&pK0[j]);
+        __m128 k = _mm_add_ps(k0, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&pK1[j]), k0), vmu));
+
+        accL = _mm_add_ps(accL, _mm_mul_ps(k, _mm_loadu_ps(&pL[j])));
+        accR = _mm_add_ps(accR, _mm_mul_ps(k, _mm_loadu_ps(&pR[j])));
+    }
+
+    // horizontal sums of both accumulators at once
+    __m128 lo = _mm_unpacklo_ps(accL, accR);
+    __m128 hi = _mm_unpackhi_ps(accL, accR);
+    __m128 sum = _mm_add_ps(lo, hi);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+
+    float pair[4];
+    _mm_storeu_ps(pair, sum);
+    left  = pair[0];
+    right = pair[1];
+#else
+    left  = 0.0f;
+    right = 0.0f;
+
+    for (int j = 0; j < g_taps; j++)
+    {
+        float k = pK0[j] + ((pK1[j] - pK0[j]) * mu);
+
+        left  += k * pL[j];
+        right += k * pR[j];
+    }
+#endif
+
+    pOut[0] = toSample(left);
+    pOut[1] = toSample(right);
+}
+
+static void linearFrame(size_t idx, uint32_t frac, int16_t *pOut)
+{
+    float mu = (float)frac / 4294967296.0f;
+
+    for (int side = 0; side < 2; side++)
+    {
+        const float *pIn = &g_input[side][idx];
+
+        pOut[side] = toSample(pIn[0] + ((pIn[1] - pIn[0]) * mu));
+    }
+}
+
+size_t sndmixRender(int16_t *pOut, ESndOutput_t mode, double ratio)
+{
+    float *pLeft = &g_input[0][g_inputLen];
+    float *pRight = &g_input[1][g_inputLen];
+
+    integrate();
+
+    for (int seg = 0; seg < g_segmentCount; seg++)
+    {
+        size_t end = (seg + 1 < g_segmentCount) ? g_segments[seg + 1].start : SNDMIX_BLOCK_SAMPLES;
+
+        mixSegment(&g_segments[seg], g_segments[seg].start, end, pLeft, pRight);
+    }
+
+    highPass(pLeft, SNDMIX_BLOCK_SAMPLES, 0);
+    highPass(pRight, SNDMIX_BLOCK_SAMPLES, 1);
+    g_inputLen += SNDMIX_BLOCK_SAMPLES;
+
+    // the gains in force at the end carry over; so do the box filter's spill-over samples
+    g_segments[0]       = g_segments[g_segmentCount - 1];
+    g_segments[0].start = 0;
+    g_segmentCount      = 1;
+    memcpy(g_delta[0], g_delta[SNDMIX_BLOCK_SAMPLES], 2 * sizeof(g_delta[0]));
+    memset(g_delta[2], 0, SNDMIX_BLOCK_SAMPLES * sizeof(g_delta[0]));
+
+    size_t   window = (mode == SND_OUTPUT_SINC) ? (size_t)g_taps : 2;
+    uint64_t step = (uint64_t)(((double)SNDMIX_RATE / ((double)g_rate * ratio)) * 4294967296.0);
+    size_t   frames = 0;
+
+    while ((((g_pos >> 32) + window) <= g_inputLen) && (frames < SND_MAX_FRAME_SAMPLES))
+    {
+        if (mode == SND_OUTPUT_SINC)
+        {
+            sincFrame((size_t)(g_pos >> 32), (uint32_t)g_pos, &pOut[frames * 2]);
+        }
+        else
+        {
+            linearFrame((size_t)(g_pos >> 32), (uint32_t)g_pos, &pOut[frames * 2]);
+        }
+
+        g_pos += step;
+        frames++;
+    }
+
+    // keep what the next outputs still need
+    size_t used = (size_t)(g_pos >> 32);
+
+    if (used > g_inputLen)
+    {
+        used = g_inputLen;
+    }
+
+    for (int side = 0; side < 2; side++)
+    {
+        memmove(g_input[side], &g_input[side][used], (g_inputLen - used) * sizeof(float));
+    }
+
+    g_inputLen -= used;
+    g_pos      -= (uint64_t)used << 32;
+
+    return frames;
+}
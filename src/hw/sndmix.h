@@ -0,0 +1,56 @@
+/**
+ * @file sndmix.h
+ * @author Toesoe
+ * @brief seaboy APU output stage: per-channel mixing, high-pass and resampling
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the alternative to the blip buffer in snd.c. channel level changes are box-filtered to an
+ * intermediate rate (exact area averages over SNDMIX_DIV cycles), then once per block the four
+ * channels are mixed with the NR50/NR51 gains, DC-blocked and resampled to the output rate,
+ * either with a windowed-sinc polyphase FIR or with linear interpolation.
+ */
+
+#ifndef _SNDMIX_H_
+#define _SNDMIX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "snd.h"
+
+#define SNDMIX_DIV           16                                // T-cycles per intermediate sample
+#define SNDMIX_RATE          (SND_CLOCK_HZ / SNDMIX_DIV)       // 262144 Hz
+#define SNDMIX_BLOCK_SAMPLES (SND_FRAME_CYCLES / SNDMIX_DIV)   // 4389, exactly
+#define SNDMIX_MAX_TAPS      384
+#define SNDMIX_PHASES        128 // sinc phases; coefficients are interpolated between neighbours
+#define SNDMIX_MAX_SEGMENTS  32  // NR50/NR51 changes per block
+
+void sndmixInit(uint32_t);
+
+/**
+ * @brief start from the given channel levels, dropping anything recorded in this block
+ */
+void sndmixReset(const uint8_t *);
+
+/**
+ * @brief a channel's level moved by delta at a block time
+ */
+void sndmixLevel(int, uint32_t, int);
+
+/**
+ * @brief new per-channel gains from a block time on: [side][channel], left first
+ */
+void sndmixGains(uint32_t, const float (*)[4]);
+
+/**
+ * @brief finish the block: mix, high-pass and resample into interleaved stereo with the sinc or
+ *        linear resampler. ratio speeds the output up or down as audioGetRateRatio() asks
+ * @return sample frames written
+ */
+size_t sndmixRender(int16_t *, ESndOutput_t, double);
+
+#endif //!_SNDMIX_H_
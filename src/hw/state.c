@@ -0,0 +1,76 @@
+/**
+ * @file state.c
+ * @author Toesoe
+ * @brief seaboy save states
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "state.h"
+#include "mem.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "snd.h"
+#include "joypad.h"
+
+#define STATE_HEADER_BYTES 12
+
+size_t stateSize(void)
+{
+    return STATE_HEADER_BYTES + sizeof(bus_t) + cpuStateSize() + ppuStateSize() + sndStateSize() + joypadStateSize();
+}
+
+bool stateCanSave(bool eiPending)
+{
+    return !eiPending && (pGetBusPtr()->map.ioregs.lcd.stat.ppuMode != MODE_3);
+}
+
+void stateSave(uint8_t *pState)
+{
+    memcpy(pState, STATE_MAGIC, 4);
+    statePutU16(&pState[4], STATE_VERSION);
+    statePutU16(&pState[6], 0);
+    statePutU32(&pState[8], (uint32_t)stateSize());
+    pState += STATE_HEADER_BYTES;
+
+    // the APU syncs itself first; it only reads its registers from the bus
+    sndSaveState(&pState[sizeof(bus_t) + cpuStateSize() + ppuStateSize()]);
+
+    memcpy(pState, pGetBusPtr(), sizeof(bus_t));
+    pState += sizeof(bus_t);
+    cpuSaveState(pState);
+    pState += cpuStateSize();
+    ppuSaveState(pState);
+    pState += ppuStateSize() + sndStateSize();
+    joypadSaveState(pState);
+}
+
+bool stateLoad(const uint8_t *pState, size_t size)
+{
+    if ((size != stateSize()) || (memcmp(pState, STATE_MAGIC, 4) != 0) || (stateGetU16(&pState[4]) != STATE_VERSION) ||
+        (stateGetU32(&pState[8]) != size))
+    {
+        fprintf(stderr, "save state does not match this build\n");
+        return false;
+    }
+
+    pState += STATE_HEADER_BYTES;
+
+    memcpy(pGetBusPtr(), pState, sizeof(bus_t));
+    pState += sizeof(bus_t);
+    cpuLoadState(pState);
+    pState += cpuStateSize();
+    ppuLoadState(pState);
+    pState += ppuStateSize();
+    sndLoadState(pState);
+    pState += sndStateSize();
+    joypadLoadState(pState);
+
+    return true;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file state.h
+ * @author Toesoe
+ * @brief seaboy save states
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * a save state is the whole machine at an instruction boundary:
+ *   header: "SBST", u16 version, u16 0, u32 total bytes
+ *   then the bus (64 KiB), and the CPU, PPU, APU and joypad blobs back to back.
+ * every blob has a fixed little-endian layout with no host pointers or padding, so the same
+ * machine gives the same bytes on any host and in any run. the version and total size are the
+ * only checks that a state fits this build.
+ */
+
+#ifndef _STATE_H_
+#define _STATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STATE_MAGIC   "SBST"
+#define STATE_VERSION 3
+
+// little-endian fields for the device blobs
+
+static inline void statePutU16(uint8_t *pDst, uint16_t val)
+{
+    pDst[0] = (uint8_t)val;
+    pDst[1] = (uint8_t)(val >> 8);
+}
+
+static inline void statePutU32(uint8_t *pDst, uint32_t val)
+{
+    statePutU16(pDst, (uint16_t)val);
+    statePutU16(&pDst[2], (uint16_t)(val >> 16));
+}
+
+static inline void statePutU64(uint8_t *pDst, uint64_t val)
+{
+    statePutU32(pDst, (uint32_t)val);
+    statePutU32(&pDst[4], (uint32_t)(val >> 32));
+}
+
+static inline uint16_t stateGetU16(const uint8_t *pSrc)
+{
+    return (uint16_t)(pSrc[0] | (pSrc[1] << 8));
+}
+
+static inline uint32_t stateGetU32(const uint8_t *pSrc)
+{
+    return stateGetU16(pSrc) | ((uint32_t)stateGetU16(&pSrc[2]) << 16);
+}
+
+static inline uint64_t stateGetU64(const uint8_t *pSrc)
+{
+    return stateGetU32(pSrc) | ((uint64_t)stateGetU32(&pSrc[4]) << 32);
+}
+
+/**
+ * @brief bytes in a save state
+ */
+size_t stateSize(void);
+
+/**
+ * @brief whether a state can be taken at this instruction boundary: the PPU is outside mode 3
+ *        and no EI is waiting to take effect. the main loop knows the latter: pass it in
+ */
+bool stateCanSave(bool);
+
+/**
+ * @brief write stateSize() bytes
+ */
+void stateSave(uint8_t *);
+
+/**
+ * @brief pick the machine up from a state
+ * @return false, with nothing changed, if the state is not one of this build's
+ */
+bool stateLoad(const uint8_t *, size_t);
+
+#endif //!_STATE_H_
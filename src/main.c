@@ -12,13 +12,30 @@
 #include "hw/mem.h"
 #include "hw/cpu.h"
 #include "hw/ppu.h"
+#include "hw/snd.h"
+#include "hw/joypad.h"
+#include "hw/debug.h"
 #include "drv/render.h"
+#include "drv/audio.h"
+#include "drv/input.h"
+#include "drv/movie.h"
+#include "drv/pace.h"
+#include "drv/driver.h"
+#include "drv/framehash.h"
+#include "drv/shmfb.h"
+#include "drv/record.h"
+#include "drv/trace.h"
+#include "drv/cputrace.h"
 #include "hw/cart.h"
 
 #include "cputest.h"
+#include "bench.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
 
 const uint8_t bootrom_bin[] = {
   /* 0x00 */ 0x31, 0xfe, 0xff, 0xaf, 0x21, 0xff, 0x9f, 0x32, 0xcb, 0x7c, 0x20, 0xfb, 0x21, 0x26, 0xff, 0x0e,
@@ -41,70 +58,761 @@ const uint8_t bootrom_bin[] = {
 
 size_t bootrom_bin_len = 0xFF;
 
-int main()
+typedef struct
 {
+    const char     *pRomPath;
+    bool            headless;
+    bool            skipBootrom;
+    bool            bench;
+    uint64_t        frames;        // 0: until the window closes
+    int             threads;       // 0: the build's default
+    int             pace;          // -1: the build's default
+    int             frameSkip;     // 0, N, or PPU_FRAMESKIP_AUTO
+    int             engine;        // EPPUEngine_t
+    int             shades;        // -1: the renderer's own
+    bool            filter;
+    SFilterConfig_t filterConfig;
+    int             filterThreads; // 0: one per core but this one
+    const char     *pHashPath;
+    const char     *pShmName;
+    const char     *pRecordPath;
+    int             recordFormat;  // -1: from the file name
+    uint32_t        recordEvery;
+    const char     *pMovieRecordPath;
+    const char     *pMoviePlayPath;
+    bool            seek;
+    uint64_t        seekFrame;
+    const char     *pTracePath;
+    uint32_t        traceMask;
+    const char     *pCpuTracePath;
+    bool            doctor;
+} SOptions_t;
+
+static const char *g_paceNames[PACE_MODE_COUNT] = { "realtime", "vsync", "audio", "turbo" };
+static const char *g_engineNames[PPU_ENGINE_COUNT] = { "scanline", "capture", "fifo" };
+static const char *g_recordFormatNames[] = { "raw", "y4m", "delta" };
+
+// RGBA8888, shade 0 (lightest) to shade 3 (darkest)
+static const char     *g_shadeNames[] = { "green", "gray" };
+static const uint32_t  g_shadeSets[][4] = {
+    { 0x9bbc0fFF, 0x8bac0fFF, 0x306230FF, 0x0f380fFF },
+    { 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, 0x000000FF },
+};
+
+static bool     previousInstructionSetIME = false;
+static uint64_t g_instructions = 0;
+
+/**
+ * @brief one instruction, or one step of HALT, then the devices for the cycles it took
+ * @return true while an EI is waiting to take effect
+ */
+static bool runInstruction(void)
+{
+    bus_t *pBus = pGetBusPtr();
+    const cpu_t *pCpu = getCpuObject();
+
+    int mCycles = 0;
+
+    benchEnter(BENCH_CPU);
+
+    if (!previousInstructionSetIME)
+    {
+        mCycles += handleInterrupts();
+    }
+
+    previousInstructionSetIME = false;
+
+    // this is done to delay executing interrupts by one cycle
+    if (pBus->bus[pCpu->reg16.pc] == 0xFB)
+    {
+        previousInstructionSetIME = true;
+    }
+
+    if (!checkHalted())
+    {
+        debugStep(pCpu->reg16.pc);
+        //memcpy(&prevState, pCpu, sizeof(cpu_t));
+        //memcpy(&prevBus, pBus, sizeof(bus_t));
+        TRACE(TRACE_CPU_EXEC, joypadGetCycle(), pCpu->reg16.pc, pBus->bus[pCpu->reg16.pc]);
+        cputraceStep(joypadGetCycle(), pCpu, pBus->bus);
+        mCycles += executeInstruction(pBus->bus[pCpu->reg16.pc]);
+        g_instructions++;
+    }
+
+    handleTimers(mCycles);
+
+    benchEnter(BENCH_PPU);
+    ppuLoop(mCycles * 4); // 1 CPU cycle = 4 PPU cycles
+    benchEnter(BENCH_APU);
+    sndLoop(mCycles * 4);
+    benchEnter(BENCH_OTHER);
+    joypadLoop(mCycles * 4);
+
+    if (pBus->map.ioregs.disableBootrom == 1)
+    {
+        unmapBootrom();
+    }
+
+    return previousInstructionSetIME;
+}
+
+static void usage(const char *pName)
+{
+    fprintf(stderr,
+            "usage: %s [options] rom.gb\n"
+            "  --headless        no window and no sound device; frames still reach hashes and exports\n"
+            "  --frames N        stop after N frames\n"
+            "  --skip-bootrom    start at 0x0100 with the registers the bootrom leaves\n"
+            "  --bench           headless, turbo, %d frames unless --frames says otherwise, then a report\n"
+            "  --threads N       1: all on this thread, 2: sound synthesis on a worker, 3: rasterizing too\n"
+            "  --pace MODE       realtime, vsync, audio or turbo\n"
+            "  --frameskip N     draw one frame, then skip N; auto follows the host's speed\n"
+            "  --ppu ENGINE      scanline (the default), capture or fifo, the most accurate\n"
+            "  --shades NAME     green (the default) or gray\n"
+            "  --filter NAME     upscale the window: none, nearest, scale2x, scale3x, scale4x, xbr2x\n"
+            "                    or lcd; nearestxN and lcdxN pick the scale, 2 to 4\n"
+            "  --ghosting        blend each frame with the one before, like a DMG screen\n"
+            "  --filter-threads N  split filtering into N bands of rows, one per thread\n"
+            "  --hash FILE       log a hash of every frame and audio block\n"
+            "  --shm NAME        export every frame to the shared-memory ring NAME, e.g. /seaboy-0\n"
+            "  --record FILE     write the frames to FILE, see build/recconv\n"
+            "  --record-format F raw, y4m or delta; by default y4m for .y4m, delta for .sbrv, else raw\n"
+            "  --record-every N  only write every Nth frame\n"
+            "  --record-movie F  record the input from the start to the movie F\n"
+            "  --play-movie F    replay the movie F, then go on with live input\n"
+            "  --seek-frame N    with --play-movie, start at frame N from the keyframe before it\n"
+            "  --trace FILE      write binary trace records, see build/tracedump\n"
+            "  --trace-mask LIST cpu,irq,mem,mbc,ppu,input or all (the default)\n"
+            "  --cpu-trace FILE  write every instruction's registers, see build/tracediff\n"
+            "  --doctor          skip the bootrom and read LY as 0x90, to match Gameboy Doctor logs\n"
+            "  --break SPEC      [bank:]addr[,condition], e.g. 1:4A07,A==0x3F; repeatable\n"
+            "  --watch SPEC      addr[-addr][:r|w|rw][,condition], e.g. FF40:w,V<0x80; repeatable\n",
+            pName, BENCH_DEFAULT_FRAMES);
+}
+
+static bool parseCount(const char *pArg, uint64_t min, uint64_t max, uint64_t *pValue)
+{
+    char *pEnd = NULL;
+    unsigned long long value = pArg ? strtoull(pArg, &pEnd, 10) : 0;
+
+    if (!pArg || (*pArg == '\0') || (*pArg == '-') || (*pEnd != '\0') || (value < min) || (value > max))
+    {
+        return false;
+    }
+
+    *pValue = value;
+    return true;
+}
+
+static bool parseOptions(int argc, char **argv, SOptions_t *pOptions)
+{
+    memset(pOptions, 0, sizeof(SOptions_t));
+    pOptions->pace = -1;
+    pOptions->shades = -1;
+    pOptions->recordFormat = -1;
+    pOptions->traceMask = TRACE_ALL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *pArg = argv[i];
+        const char *pValue = (i + 1 < argc) ? argv[i + 1] : NULL;
+        uint64_t    count = 0;
+
+        if (strcmp(pArg, "--headless") == 0)
+        {
+            pOptions->headless = true;
+        }
+        else if (strcmp(pArg, "--skip-bootrom") == 0)
+        {
+            pOptions->skipBootrom = true;
+        }
+        else if (strcmp(pArg, "--bench") == 0)
+        {
+            pOptions->bench = true;
+        }
+        else if (strcmp(pArg, "--frames") == 0)
+        {
+            if (!parseCount(pValue, 1, UINT64_MAX / PACE_FRAME_CYCLES, &count))
+            {
+                fprintf(stderr, "--frames wants a frame count\n");
+                return false;
+            }
+
+            pOptions->frames = count;
+            i++;
+        }
+        else if (strcmp(pArg, "--threads") == 0)
+        {
+            if (!parseCount(pValue, 1, 3, &count))
+            {
+                fprintf(stderr, "--threads wants 1, 2 or 3\n");
+                return false;
+            }
+
+            pOptions->threads = (int)count;
+            i++;
+        }
+        else if (strcmp(pArg, "--pace") == 0)
+        {
+            for (int mode = 0; pValue && (mode < PACE_MODE_COUNT); mode++)
+            {
+                if (strcmp(pValue, g_paceNames[mode]) == 0)
+                {
+                    pOptions->pace = mode;
+                }
+            }
+
+            if (pOptions->pace < 0)
+            {
+                fprintf(stderr, "--pace wants realtime, vsync, audio or turbo\n");
+                return false;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--frameskip") == 0)
+        {
+            if (pValue && (strcmp(pValue, "auto") == 0))
+            {
+                pOptions->frameSkip = PPU_FRAMESKIP_AUTO;
+            }
+            else if (parseCount(pValue, 0, 60, &count))
+            {
+                pOptions->frameSkip = (int)count;
+            }
+            else
+            {
+                fprintf(stderr, "--frameskip wants 0-60 or auto\n");
+                return false;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--ppu") == 0)
+        {
+            pOptions->engine = -1;
+
+            for (int engine = 0; pValue && (engine < PPU_ENGINE_COUNT); engine++)
+            {
+                if (strcmp(pValue, g_engineNames[engine]) == 0)
+                {
+                    pOptions->engine = engine;
+                }
+            }
+
+            if (pOptions->engine < 0)
+            {
+                fprintf(stderr, "--ppu wants scanline, capture or fifo\n");
+                return false;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--shades") == 0)
+        {
+            pOptions->shades = -1;
+
+            for (int set = 0; pValue && (set < (int)(sizeof(g_shadeNames) / sizeof(g_shadeNames[0]))); set++)
+            {
+                if (strcmp(pValue, g_shadeNames[set]) == 0)
+                {
+                    pOptions->shades = set;
+                }
+            }
+
+            if (pOptions->shades < 0)
+            {
+                fprintf(stderr, "--shades wants green or gray\n");
+                return false;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--filter") == 0)
+        {
+            bool ghosting = pOptions->filterConfig.ghosting;
+
+            if (!pValue || !filterParse(pValue, &pOptions->filterConfig))
+            {
+                fprintf(stderr, "--filter wants none, nearest[xN], scale2x, scale3x, scale4x, xbr2x or lcd[xN]\n");
+                return false;
+            }
+
+            pOptions->filterConfig.ghosting = ghosting;
+            pOptions->filter = true;
+            i++;
+        }
+        else if (strcmp(pArg, "--ghosting") == 0)
+        {
+            pOptions->filterConfig.ghosting = true;
+            pOptions->filter = true;
+        }
+        else if (strcmp(pArg, "--filter-threads") == 0)
+        {
+            if (!parseCount(pValue, 1, FILTER_MAX_THREADS, &count))
+            {
+                fprintf(stderr, "--filter-threads wants 1-%d\n", FILTER_MAX_THREADS);
+                return false;
+            }
+
+            pOptions->filterThreads = (int)count;
+            i++;
+        }
+        else if (strcmp(pArg, "--hash") == 0)
+        {
+            if (!pValue)
+            {
+                fprintf(stderr, "--hash wants a file\n");
+                return false;
+            }
+
+            pOptions->pHashPath = pValue;
+            i++;
+        }
+        else if (strcmp(pArg, "--shm") == 0)
+        {
+            if (!pValue || (pValue[0] != '/'))
+            {
+                fprintf(stderr, "--shm wants a name starting with /\n");
+                return false;
+            }
+
+            pOptions->pShmName = pValue;
+            i++;
+        }
+        else if (strcmp(pArg, "--record") == 0)
+        {
+            if (!pValue)
+            {
+                fprintf(stderr, "--record wants a file\n");
+                return false;
+            }
+
+            pOptions->pRecordPath = pValue;
+            i++;
+        }
+        else if (strcmp(pArg, "--record-format") == 0)
+        {
+            pOptions->recordFormat = -1;
+
+            for (int format = RECORD_RAW; pValue && (format <= RECORD_DELTA); format++)
+            {
+                if (strcmp(pValue, g_recordFormatNames[format]) == 0)
+                {
+                    pOptions->recordFormat = format;
+                }
+            }
+
+            if (pOptions->recordFormat < 0)
+            {
+                fprintf(stderr, "--record-format wants raw, y4m or delta\n");
+                return false;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--record-every") == 0)
+        {
+            if (!parseCount(pValue, 1, UINT32_MAX, &count))
+            {
+                fprintf(stderr, "--record-every wants a frame count\n");
+                return false;
+            }
+
+            pOptions->recordEvery = (uint32_t)count;
+            i++;
+        }
+        else if ((strcmp(pArg, "--record-movie") == 0) || (strcmp(pArg, "--play-movie") == 0))
+        {
+            if (!pValue)
+            {
+                fprintf(stderr, "%s wants a file\n", pArg);
+                return false;
+            }
+
+            if (pArg[2] == 'r')
+            {
+                pOptions->pMovieRecordPath = pValue;
+            }
+            else
+            {
+                pOptions->pMoviePlayPath = pValue;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--seek-frame") == 0)
+        {
+            if (!parseCount(pValue, 0, UINT64_MAX / PACE_FRAME_CYCLES, &count))
+            {
+                fprintf(stderr, "--seek-frame wants a frame number\n");
+                return false;
+            }
+
+            pOptions->seek = true;
+            pOptions->seekFrame = count;
+            i++;
+        }
+        else if (strcmp(pArg, "--trace") == 0)
+        {
+            if (!pValue)
+            {
+                fprintf(stderr, "--trace wants a file\n");
+                return false;
+            }
+
+            pOptions->pTracePath = pValue;
+            i++;
+        }
+        else if (strcmp(pArg, "--cpu-trace") == 0)
+        {
+            if (!pValue)
+            {
+                fprintf(stderr, "--cpu-trace wants a file\n");
+                return false;
+            }
+
+            pOptions->pCpuTracePath = pValue;
+            i++;
+        }
+        else if ((strcmp(pArg, "--break") == 0) || (strcmp(pArg, "--watch") == 0))
+        {
+            if (!pValue || (((pArg[2] == 'b') ? debugParseBreakpoint(pValue) : debugParseWatchpoint(pValue)) < 0))
+            {
+                fprintf(stderr, "%s wants a spec\n", pArg);
+                return false;
+            }
+
+            i++;
+        }
+        else if (strcmp(pArg, "--doctor") == 0)
+        {
+            pOptions->doctor = true;
+            pOptions->skipBootrom = true;
+        }
+        else if (strcmp(pArg, "--trace-mask") == 0)
+        {
+            if (!pValue || !traceParseMask(pValue, &pOptions->traceMask))
+            {
+                fprintf(stderr, "--trace-mask wants a list of cpu, irq, mem, mbc, ppu, input or all\n");
+                return false;
+            }
+
+            i++;
+        }
+        else if ((pArg[0] == '-') && (pArg[1] != '\0'))
+        {
+            fprintf(stderr, "unknown option %s\n", pArg);
+            return false;
+        }
+        else if (pOptions->pRomPath)
+        {
+            fprintf(stderr, "one rom at a time\n");
+            return false;
+        }
+        else
+        {
+            pOptions->pRomPath = pArg;
+        }
+    }
+
+    if (!pOptions->pRomPath)
+    {
+        return false;
+    }
+
+    if (pOptions->pMovieRecordPath && pOptions->pMoviePlayPath)
+    {
+        fprintf(stderr, "record a movie or play one, not both\n");
+        return false;
+    }
+
+    if (pOptions->seek && !pOptions->pMoviePlayPath)
+    {
+        fprintf(stderr, "--seek-frame needs --play-movie\n");
+        return false;
+    }
+
+#ifdef SEABOY_HEADLESS
+    pOptions->headless = true;
+#endif
+
+    if (pOptions->bench)
+    {
+        // the number should not depend on the display or the sound card
+        pOptions->headless = true;
+        pOptions->pace = PACE_TURBO;
+        pOptions->frames = pOptions->frames ? pOptions->frames : BENCH_DEFAULT_FRAMES;
+    }
+
+    if (pOptions->threads == 0)
+    {
+        pOptions->threads = pOptions->headless ? 1 : 2;
+    }
+
+    if (pOptions->pace < 0)
+    {
+        pOptions->pace = pOptions->headless ? PACE_TURBO : PACE_REALTIME;
+    }
+
+    if (pOptions->pRecordPath && (pOptions->recordFormat < 0))
+    {
+        const char *pExt = strrchr(pOptions->pRecordPath, '.');
+
+        pOptions->recordFormat = RECORD_RAW;
+
+        if (pExt && (strcmp(pExt, ".y4m") == 0))
+        {
+            pOptions->recordFormat = RECORD_Y4M;
+        }
+        else if (pExt && (strcmp(pExt, ".sbrv") == 0))
+        {
+            pOptions->recordFormat = RECORD_DELTA;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    SOptions_t options;
+
+    if (!parseOptions(argc, argv, &options))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
     //runTests();
     resetBus();
     bus_t *pBus = pGetBusPtr();
-    const cpu_t *pCpu = getCpuObject();
 
-    bool skipBootrom = false;
-    bool previousInstructionSetIME = false;
     // cpu_t prevState;
     // bus_t prevBus;
 
     resetCpu();
-    ppuInit(skipBootrom);
-    initRenderWindow();
+    ppuInit(options.skipBootrom);
+    ppuSetFrameSkip(options.frameSkip);
+    ppuSetEngine((EPPUEngine_t)options.engine);
+
+    if (options.shades >= 0)
+    {
+        renderSetShades(g_shadeSets[options.shades]);
+    }
+
+    sndInit(SND_DEFAULT_RATE);
+    joypadInit();
+
+    if (options.headless)
+    {
+        renderSetDriver(pGetNullRenderDriver());
+        audioSetDriver(pGetNullAudioDriver());
+    }
+
+    // nobody listens and nothing is hashed: keep the registers, skip the samples
+    sndSetSynthesis(!options.headless || options.pHashPath);
+    sndSetDeferred(options.threads >= 2); // synthesize on another core, a block behind the CPU
+
+    if (options.threads >= 3)
+    {
+        ppuSetRenderMode(PPU_RENDER_DEFERRED_WORKER);
+    }
+
+    paceSetMode((EPaceMode_t)options.pace);
+
+    busSetLyStub(options.doctor);
 
-    loadRom("Tetris.gb");
+    if (!loadRom(options.pRomPath))
+    {
+        return EXIT_FAILURE;
+    }
 
-    if (!skipBootrom)
+    if (!options.skipBootrom)
     {
         // overlay with bootrom
         memcpy(&pBus->bus[0], &bootrom_bin[0], bootrom_bin_len + 1);
     }
     else { cpuSkipBootrom(); }
-    
 
-    while (true)
+    // the recording's starting state is taken before the first instruction
+    if (options.pMovieRecordPath && !movieRecordStart(options.pMovieRecordPath, MOVIE_DEFAULT_INTERVAL))
     {
-        int mCycles = 0;
-        uint8_t opcode = pBus->bus[pCpu->reg16.pc];
+        return EXIT_FAILURE;
+    }
 
-        printf("executing 0x%02x at pc 0x%02x\n", opcode, pCpu->reg16.pc);
+    if (options.pMoviePlayPath && !moviePlayStart(options.pMoviePlayPath))
+    {
+        return EXIT_FAILURE;
+    }
 
-        if (!previousInstructionSetIME)
-        {
-            mCycles += handleInterrupts();
-        }
+    if (options.seek)
+    {
+        // nothing is open yet to see the frames re-emulated on the way, so none are drawn
+        SMovieStats_t movie;
 
-        previousInstructionSetIME = false;
+        ppuSetFrameSkip(INT_MAX);
 
-        // this is done to delay executing interrupts by one cycle
-        if (pBus->bus[pCpu->reg16.pc] == 0xFB)
+        if (!movieSeek(options.seekFrame, runInstruction))
         {
-            previousInstructionSetIME = true;
+            fprintf(stderr, "movie: ends before frame %llu\n", (unsigned long long)options.seekFrame);
         }
 
-        if (!checkHalted())
+        ppuSetFrameSkip(options.frameSkip);
+        movieGetStats(&movie);
+        fprintf(stderr, "movie: at frame %llu, %llu frames re-emulated\n", (unsigned long long)movieGetFrame(),
+                (unsigned long long)movie.seekFrames);
+    }
+
+    if (options.pHashPath && !framehashOpen(options.pHashPath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.pShmName && !shmfbOpen(options.pShmName, SHMFB_SLOTS_DEFAULT))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.pRecordPath)
+    {
+        // turbo outruns the disk; a paced run would rather drop a frame than stutter
+        SRecordConfig_t record = { (ERecordFormat_t)options.recordFormat, options.recordEvery,
+                                   options.pace == PACE_TURBO };
+
+        if (!recordStart(options.pRecordPath, &record))
         {
-            if (pCpu->reg16.pc == 0x69a4)
-            {
-                __asm("nop");
-            }
-            //memcpy(&prevState, pCpu, sizeof(cpu_t));
-            //memcpy(&prevBus, pBus, sizeof(bus_t));
-            mCycles += executeInstruction(pBus->bus[pCpu->reg16.pc]);
+            return EXIT_FAILURE;
         }
+    }
 
-        handleTimers(mCycles);
+    if (options.pTracePath && !traceOpen(options.pTracePath, options.traceMask))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.pCpuTracePath && !cputraceOpen(options.pCpuTracePath, options.doctor ? CPUTRACE_FLAG_LY_STUB : 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.filter && !options.headless)
+    {
+        // the present thread takes a band of rows itself
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+        filterInit(options.filterThreads ? (unsigned int)options.filterThreads : (unsigned int)((cores > 1) ? cores - 1 : 1));
+        renderSetFilter(&options.filterConfig);
+    }
+
+    initRenderWindow();
+    audioStart(SND_DEFAULT_RATE, 2);
+    inputStart();
+
+    if (options.bench && !benchStart())
+    {
+        options.bench = false;
+    }
 
-        ppuLoop(mCycles * 4); // 1 CPU cycle = 4 PPU cycles
+    uint64_t endCycle = options.frames * PACE_FRAME_CYCLES;
+    uint64_t pollCycle = joypadGetCycle();
 
-        if (pBus->map.ioregs.disableBootrom == 1)
+    while (!renderQuitRequested() && (!endCycle || (joypadGetCycle() < endCycle)))
+    {
+        if (joypadGetCycle() >= pollCycle)
         {
-            unmapBootrom();
+            inputPoll();
+            pollCycle = ((joypadGetCycle() / PACE_FRAME_CYCLES) + 1) * PACE_FRAME_CYCLES;
         }
+
+        movieTick(runInstruction());
+        paceSync(joypadGetCycle());
+    }
+
+    // nothing below may go away while the render worker still has a frame
+    ppuFlush();
+
+    SPaceStats_t pace;
+
+    paceGetStats(&pace);
+
+    if (pace.frames > 1)
+    {
+        fprintf(stderr, "pace: %s, speed %.1f %%, %.2f ms per frame, jitter %.3f ms, longest %.2f ms, %llu resyncs, "
+                "overslept %.2f ms\n", g_paceNames[pace.mode], pace.speedPercent, (double)pace.frameNs / 1e6,
+                (double)pace.jitterNs / 1e6, (double)pace.maxFrameNs / 1e6, (unsigned long long)pace.resyncs,
+                (double)pace.oversleepNs / 1e6);
     }
-}
\ No newline at end of file
+
+    if (movieIsRecording())
+    {
+        SMovieStats_t movie;
+
+        movieGetStats(&movie);
+        fprintf(stderr, "movie: %llu button changes, %llu keyframes\n", (unsigned long long)movie.events,
+                (unsigned long long)movie.keyframes);
+    }
+
+    movieStop();
+    sndFlush();
+
+    uint32_t audioFill = 0;
+    uint32_t audioRate = 0;
+
+    if (audioGetRingLevel(&audioFill, &audioRate))
+    {
+        SAudioStats_t audio;
+
+        audioGetStats(&audio);
+        fprintf(stderr, "audio: %llu underruns (%llu frames), %llu overruns (%llu frames), %u frames queued, rate x%.4f\n",
+                (unsigned long long)audio.underruns, (unsigned long long)audio.underrunFrames,
+                (unsigned long long)audio.overruns, (unsigned long long)audio.overrunFrames, audio.fill, audio.rateRatio);
+    }
+
+    if (options.bench)
+    {
+        benchReport(options.pRomPath, joypadGetCycle(), g_instructions);
+    }
+
+    audioStop();
+    inputStop();
+
+    SInputStats_t input;
+
+    inputGetStats(&input);
+
+    if (input.pushed > 0)
+    {
+        fprintf(stderr, "input: %llu events applied, %llu dropped, %llu late; latency %.2f ms average, %.2f ms max over %llu key presses\n",
+                (unsigned long long)input.applied, (unsigned long long)input.dropped, (unsigned long long)input.late,
+                input.nowEvents ? ((double)input.totalLatencyNs / (double)input.nowEvents) / 1e6 : 0.0,
+                (double)input.maxLatencyNs / 1e6, (unsigned long long)input.nowEvents);
+    }
+
+    closeRenderWindow();
+    shmfbClose();
+    framehashClose();
+    cputraceClose();
+
+    if (options.pRecordPath)
+    {
+        SRecordStats_t record;
+
+        recordStop();
+        recordGetStats(&record);
+        fprintf(stderr, "record: %llu frames written, %llu dropped\n", (unsigned long long)record.framesWritten,
+                (unsigned long long)record.framesDropped);
+    }
+
+    if (options.pTracePath)
+    {
+        STraceStats_t trace;
+
+        traceClose();
+        traceGetStats(&trace);
+        fprintf(stderr, "trace: %llu records from %u threads, %llu dropped\n",
+                (unsigned long long)trace.records, trace.threads, (unsigned long long)trace.dropped);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file filterbench.c
+ * @author Toesoe
+ * @brief time the upscaling filters
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * every filter runs on the same noisy 4-shade frame, once on the calling thread alone and once
+ * split into bands over a pool; pass the pool size as the argument, 4 by default. the cost is
+ * wall time per frame, since the pool's threads work for the caller.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../drv/filter.h"
+#include "../drv/render.h"
+
+#define WARMUP_FRAMES 10
+#define TIMED_FRAMES  300
+#define DEFAULT_POOL  4
+
+static uint32_t g_in[DISP_WIDTH * DISP_HEIGHT];
+static uint32_t g_out[DISP_WIDTH * FILTER_MAX_SCALE * DISP_HEIGHT * FILTER_MAX_SCALE];
+
+static const struct
+{
+    const char     *pName;
+    SFilterConfig_t config;
+} g_cases[] = {
+    { "none", { FILTER_NONE, 1, false } },       { "nearest 2x", { FILTER_NEAREST, 2, false } },
+    { "nearest 3x", { FILTER_NEAREST, 3, false } }, { "nearest 4x", { FILTER_NEAREST, 4, false } },
+    { "scale2x", { FILTER_SCALE2X, 2, false } }, { "scale3x", { FILTER_SCALE3X, 3, false } },
+    { "scale4x", { FILTER_SCALE4X, 4, false } }, { "xbr2x", { FILTER_XBR2X, 2, false } },
+    { "lcd 4x", { FILTER_LCD, 4, false } },      { "lcd 4x ghosting", { FILTER_LCD, 4, true } },
+};
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+static double frameCostUs(const SFilterConfig_t *pConfig, unsigned int threads)
+{
+    filterInit(threads);
+    filterConfigure(pConfig);
+
+    for (int f = 0; f < WARMUP_FRAMES; f++)
+    {
+        filterApply(g_in, g_out);
+    }
+
+    double start = nowNs();
+
+    for (int f = 0; f < TIMED_FRAMES; f++)
+    {
+        filterApply(g_in, g_out);
+    }
+
+    return (nowNs() - start) / TIMED_FRAMES / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t shades[4] = { 0x9bbc0fFF, 0x8bac0fFF, 0x306230FF, 0x0f380fFF };
+    unsigned int          pool = (argc > 1) ? (unsigned int)atoi(argv[1]) : DEFAULT_POOL;
+    uint32_t              seed = 1;
+
+    // mostly flat runs, like tiles, with some noise so the edge rules have work to do
+    for (size_t i = 0; i < DISP_WIDTH * DISP_HEIGHT; i++)
+    {
+        seed = (seed * 1103515245u) + 12345u;
+        g_in[i] = ((seed >> 16) & 0x7) ? shades[(i / 8) & 3] : shades[(seed >> 20) & 3];
+    }
+
+    printf("%-16s %12s %12s\n", "filter", "us/frame", "pool");
+
+    for (size_t c = 0; c < sizeof(g_cases) / sizeof(g_cases[0]); c++)
+    {
+        double single = frameCostUs(&g_cases[c].config, 1);
+
+        printf("%-16s %12.1f %12.1f\n", g_cases[c].pName, single, frameCostUs(&g_cases[c].config, pool));
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file ppubench.c
+ * @author Toesoe
+ * @brief compare the PPU engines: cost per frame, drawn and skipped
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the PPU runs alone, no CPU, stepped with ppuLoop(4) like the main loop does, on one busy
+ * scene: noisy tiles, all 40 objects on screen in rows of 10, the window on and SCX=13. the
+ * cost is the thread's CPU time; the worker's share of the deferred modes is not in it.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../hw/mem.h"
+#include "../hw/ppu.h"
+#include "../drv/render.h"
+
+#define WARMUP_FRAMES 2
+#define TIMED_FRAMES  600
+
+static uint32_t g_frame[DISP_WIDTH * DISP_HEIGHT];
+
+static const char *g_engineNames[PPU_ENGINE_COUNT] = { "scanline", "capture", "fifo" };
+
+static void setupScene(EPPUEngine_t engine, int frameSkip, EPPURenderMode_t mode)
+{
+    resetBus();
+    ppuInit(false);
+
+    for (uint16_t i = 0; i < 0x1800; i++)
+    {
+        write8((uint8_t)((i * 37) + (i / 16)), (uint16_t)(0x8000 + i));
+    }
+
+    for (uint16_t i = 0; i < 0x800; i++)
+    {
+        write8((uint8_t)(i * 7), (uint16_t)(0x9800 + i));
+    }
+
+    for (uint16_t i = 0; i < 40; i++)
+    {
+        uint16_t oam = (uint16_t)(0xFE00 + (i * 4));
+
+        write8((uint8_t)(16 + ((i / 10) * 36)), oam);
+        write8((uint8_t)(8 + ((i % 10) * 15)), (uint16_t)(oam + 1));
+        write8((uint8_t)i, (uint16_t)(oam + 2));
+        write8((uint8_t)(((i & 3) << 4) | ((i & 8) ? 0x80 : 0) | ((i & 16) ? 0x20 : 0)), (uint16_t)(oam + 3));
+    }
+
+    write8(0xE4, 0xFF47); // BGP
+    write8(0xD2, 0xFF48); // OBP0
+    write8(0x1B, 0xFF49); // OBP1
+    write8(5, 0xFF42);    // SCY
+    write8(13, 0xFF43);   // SCX
+    write8(100, 0xFF4A);  // WY
+    write8(3, 0xFF4B);    // WX
+    write8(0xB3, 0xFF40); // LCD, window at 9800, BG, objects
+
+    renderSetTarget(g_frame, DISP_WIDTH);
+    ppuSetEngine(engine);
+    ppuSetFrameSkip(frameSkip);
+    ppuSetRenderMode(mode);
+}
+
+static double frameCostUs(EPPUEngine_t engine, int frameSkip, EPPURenderMode_t mode)
+{
+    setupScene(engine, frameSkip, mode);
+
+    for (int f = 0; f < WARMUP_FRAMES; f++)
+    {
+        while (!ppuLoop(4));
+    }
+
+    struct timespec start;
+    struct timespec end;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+    for (int f = 0; f < TIMED_FRAMES; f++)
+    {
+        while (!ppuLoop(4));
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    ppuSetRenderMode(PPU_RENDER_IMMEDIATE); // waits for the worker
+
+    double ns = ((double)(end.tv_sec - start.tv_sec) * 1e9) + (double)(end.tv_nsec - start.tv_nsec);
+
+    return ns / TIMED_FRAMES / 1000.0;
+}
+
+int main(void)
+{
+    printf("%-10s %12s %12s\n", "engine", "us/frame", "skipped");
+
+    for (EPPUEngine_t engine = PPU_ENGINE_SCANLINE; engine < PPU_ENGINE_COUNT; engine++)
+    {
+        printf("%-10s %12.1f %12.1f\n", g_engineNames[engine], frameCostUs(engine, 0, PPU_RENDER_IMMEDIATE),
+               frameCostUs(engine, 1000000, PPU_RENDER_IMMEDIATE));
+    }
+
+    printf("%-10s %12.1f\n", "deferred", frameCostUs(PPU_ENGINE_SCANLINE, 0, PPU_RENDER_DEFERRED));
+    printf("%-10s %12.1f\n", "worker", frameCostUs(PPU_ENGINE_SCANLINE, 0, PPU_RENDER_DEFERRED_WORKER));
+
+    return 0;
+}
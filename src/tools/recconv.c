@@ -0,0 +1,96 @@
+/**
+ * @file recconv.c
+ * @author Toesoe
+ * @brief convert seaboy delta recordings to raw RGBA8888 or Y4M
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../drv/record.h"
+#include "../drv/render.h"
+
+static uint32_t g_frame[DISP_WIDTH * DISP_HEIGHT];
+
+static bool hasSuffix(const char *pStr, const char *pSuffix)
+{
+    size_t len = strlen(pStr);
+    size_t suffixLen = strlen(pSuffix);
+
+    return (len >= suffixLen) && (strcmp(&pStr[len - suffixLen], pSuffix) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <in.sbrv> <out.raw|out.y4m>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *pIn = fopen(argv[1], "rb");
+
+    if (!pIn)
+    {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    uint32_t interval = 0;
+
+    if (!recordReadDeltaHeader(pIn, &interval))
+    {
+        fprintf(stderr, "%s is not a seaboy delta recording\n", argv[1]);
+        fclose(pIn);
+        return 1;
+    }
+
+    FILE *pOut = fopen(argv[2], "wb");
+
+    if (!pOut)
+    {
+        fprintf(stderr, "cannot open %s\n", argv[2]);
+        fclose(pIn);
+        return 1;
+    }
+
+    bool     y4m = hasSuffix(argv[2], ".y4m");
+    bool     ok = !y4m || (recordWriteY4mHeader(pOut, interval) != 0);
+    uint64_t frames = 0;
+
+    while (ok && recordReadDeltaFrame(pIn, g_frame))
+    {
+        if (y4m)
+        {
+            ok = (recordWriteY4mFrame(pOut, g_frame) != 0);
+        }
+        else
+        {
+            ok = (fwrite(g_frame, sizeof(g_frame), 1, pOut) == 1);
+        }
+
+        frames++;
+    }
+
+    if (ok && !feof(pIn))
+    {
+        fprintf(stderr, "%s: corrupt frame after %llu frames\n", argv[1], (unsigned long long)frames);
+        ok = false;
+    }
+
+    fclose(pIn);
+
+    if (fclose(pOut) != 0)
+    {
+        ok = false;
+    }
+
+    printf("%llu frames written to %s\n", (unsigned long long)frames, argv[2]);
+
+    return ok ? 0 : 1;
+}
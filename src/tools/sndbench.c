@@ -0,0 +1,261 @@
+/**
+ * @file sndbench.c
+ * @author Toesoe
+ * @brief compare the APU output stages: cost per block and alias floor
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * every stage plays the same 50% square on channel 2. the alias floor is everything in the
+ * 20 Hz -> 20 kHz band that is not a harmonic of the tone, relative to the harmonics, from a
+ * Blackman-Harris windowed FFT. the cost is the emulation thread's CPU time with all four
+ * channels busy, with the APU synthesizing in line and with synthesis deferred to a worker.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../hw/snd.h"
+#include "../hw/mem.h"
+#include "../drv/audio.h"
+
+#define PI 3.14159265358979323846
+
+#define FFT_BITS     16
+#define FFT_SIZE     (1 << FFT_BITS)
+#define WARMUP_BLOCKS 60 // let the DC blockers settle
+#define TIMED_BLOCKS 600
+#define HARMONIC_BINS 8  // either side of a harmonic, for the window's main lobe
+#define BAND_LOW_HZ  20.0
+#define BAND_HIGH_HZ 20000.0
+
+static bus_t   g_bus;
+static double  g_re[FFT_SIZE];
+static double  g_im[FFT_SIZE];
+static size_t  g_captured = 0;
+static bool    g_capturing = false;
+
+static const char *g_outputNames[SND_OUTPUT_COUNT] = { "blip", "sinc", "linear" };
+
+// the bench stands in for the bus and the audio driver, and keeps the left channel
+bus_t *pGetBusPtr(void)
+{
+    return &g_bus;
+}
+
+void audioQueue(const int16_t *pSamples, size_t frames)
+{
+    for (size_t i = 0; g_capturing && (i < frames) && (g_captured < FFT_SIZE); i++)
+    {
+        g_re[g_captured++] = pSamples[i * 2];
+    }
+}
+
+double audioGetRateRatio(void)
+{
+    return 1.0;
+}
+
+static void fft(void)
+{
+    for (size_t i = 1, j = 0; i < FFT_SIZE; i++)
+    {
+        size_t bit = FFT_SIZE >> 1;
+
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j)
+        {
+            double t = g_re[i];
+            g_re[i] = g_re[j];
+            g_re[j] = t;
+            t       = g_im[i];
+            g_im[i] = g_im[j];
+            g_im[j] = t;
+        }
+    }
+
+    for (size_t len = 2; len <= FFT_SIZE; len <<= 1)
+    {
+        double angle = -2.0 * PI / (double)len;
+
+        for (size_t i = 0; i < FFT_SIZE; i += len)
+        {
+            for (size_t k = 0; k < len / 2; k++)
+            {
+                double wr = cos(angle * (double)k);
+                double wi = sin(angle * (double)k);
+                size_t a = i + k;
+                size_t b = a + (len / 2);
+                double tr = (g_re[b] * wr) - (g_im[b] * wi);
+                double ti = (g_re[b] * wi) + (g_im[b] * wr);
+
+                g_re[b] = g_re[a] - tr;
+                g_im[b] = g_im[a] - ti;
+                g_re[a] += tr;
+                g_im[a] += ti;
+            }
+        }
+    }
+}
+
+static void startApu(ESndOutput_t output, uint32_t rate, bool deferred)
+{
+    memset(&g_bus, 0, sizeof(g_bus));
+    sndSetOutput(output);
+    sndSetDeferred(deferred);
+    sndInit(rate);
+
+    sndBusWrite(0x80, 0xFF26); // NR52: power
+    sndBusWrite(0x77, 0xFF24); // NR50: full volume both sides
+    sndBusWrite(0xFF, 0xFF25); // NR51: everything everywhere
+}
+
+static void runBlocks(int blocks)
+{
+    for (int i = 0; i < blocks; i++)
+    {
+        for (int cycles = 0; cycles < SND_FRAME_CYCLES; cycles += 16)
+        {
+            sndLoop(16);
+        }
+    }
+}
+
+/**
+ * @brief alias and noise power against harmonic power, in dB, for a 50% square at toneHz
+ */
+static double aliasFloor(ESndOutput_t output, uint32_t rate, double toneHz)
+{
+    uint16_t freq = (uint16_t)lround(2048.0 - (131072.0 / toneHz));
+
+    toneHz = 131072.0 / (2048.0 - freq);
+
+    startApu(output, rate, false);
+    sndBusWrite(0x80, 0xFF16); // NR21: 50% duty
+    sndBusWrite(0xF0, 0xFF17); // NR22: volume 15, no envelope
+    sndBusWrite((uint8_t)freq, 0xFF18);
+    sndBusWrite((uint8_t)(0x80 | (freq >> 8)), 0xFF19);
+
+    runBlocks(WARMUP_BLOCKS);
+
+    g_captured  = 0;
+    g_capturing = true;
+
+    while (g_captured < FFT_SIZE)
+    {
+        runBlocks(1);
+    }
+
+    g_capturing = false;
+
+    // 4-term Blackman-Harris: sidelobes below -92 dB
+    for (size_t i = 0; i < FFT_SIZE; i++)
+    {
+        double x = 2.0 * PI * (double)i / (FFT_SIZE - 1);
+        g_re[i] *= 0.35875 - (0.48829 * cos(x)) + (0.14128 * cos(2.0 * x)) - (0.01168 * cos(3.0 * x));
+        g_im[i]  = 0.0;
+    }
+
+    fft();
+
+    double binHz = (double)rate / FFT_SIZE;
+    double harmonic = 0.0;
+    double rest = 0.0;
+
+    for (size_t bin = (size_t)(BAND_LOW_HZ / binHz); bin <= (size_t)(BAND_HIGH_HZ / binHz); bin++)
+    {
+        double power = (g_re[bin] * g_re[bin]) + (g_im[bin] * g_im[bin]);
+        double hz = (double)bin * binHz;
+        double nearest = round(hz / toneHz) * toneHz;
+
+        if ((nearest > 0.0) && (fabs(hz - nearest) <= (HARMONIC_BINS * binHz)))
+        {
+            harmonic += power;
+        }
+        else
+        {
+            rest += power;
+        }
+    }
+
+    return 10.0 * log10(rest / harmonic);
+}
+
+static double blockCostUs(ESndOutput_t output, uint32_t rate, bool deferred)
+{
+    startApu(output, rate, deferred);
+
+    // all four channels busy, noise at a high clock
+    sndBusWrite(0x80, 0xFF11);
+    sndBusWrite(0xF0, 0xFF12);
+    sndBusWrite(0x87, 0xFF14);
+    sndBusWrite(0x40, 0xFF16);
+    sndBusWrite(0xA0, 0xFF17);
+    sndBusWrite(0x86, 0xFF19);
+
+    for (int i = 0; i < 16; i++)
+    {
+        sndBusWrite((uint8_t)(i * 17), (uint16_t)(0xFF30 + i));
+    }
+
+    sndBusWrite(0x80, 0xFF1A);
+    sndBusWrite(0x20, 0xFF1C);
+    sndBusWrite(0x87, 0xFF1E);
+    sndBusWrite(0xF0, 0xFF21);
+    sndBusWrite(0x10, 0xFF22);
+    sndBusWrite(0x80, 0xFF23);
+
+    struct timespec start;
+    struct timespec end;
+
+    // thread time: waiting for the worker costs the emulation thread nothing
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    runBlocks(TIMED_BLOCKS);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+    double ns = ((double)(end.tv_sec - start.tv_sec) * 1e9) + (double)(end.tv_nsec - start.tv_nsec);
+
+    return ns / TIMED_BLOCKS / 1000.0;
+}
+
+int main(void)
+{
+    static const uint32_t rates[] = { 44100, 48000 };
+    static const double   tones[] = { 440.0, 2000.0, 6000.0 };
+
+    printf("%-6s %6s %12s %12s", "stage", "rate", "us/block", "deferred");
+
+    for (size_t t = 0; t < sizeof(tones) / sizeof(tones[0]); t++)
+    {
+        printf("   alias@%-5.0f", tones[t]);
+    }
+
+    printf("\n");
+
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        for (int output = 0; output < SND_OUTPUT_COUNT; output++)
+        {
+            printf("%-6s %6u %12.1f %12.1f", g_outputNames[output], rates[r], blockCostUs(output, rates[r], false),
+                   blockCostUs(output, rates[r], true));
+
+            for (size_t t = 0; t < sizeof(tones) / sizeof(tones[0]); t++)
+            {
+                printf("   %8.1f dB", aliasFloor(output, rates[r], tones[t]));
+            }
+
+            printf("\n");
+        }
+    }
+
+    return 0;
+}
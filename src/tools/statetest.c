@@ -0,0 +1,317 @@
+/**
+ * @file statetest.c
+ * @author Toesoe
+ * @brief check save states and movies against a rom
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * usage: statetest rom.gb [scratch.movie]
+ *
+ * the machine starts past the bootrom and presses START now and then, so the game gets somewhere.
+ * - save, load, save: the two states are the same bytes, and the palette tables follow the
+ *   loaded registers, not the ones before the load
+ * - save, run, save; load the first, run as far, save: the same bytes again
+ * - record a movie with the same presses, play it back from power-on: every frame hashes the same
+ *
+ * exits non-zero on the first check that fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../hw/cpu.h"
+#include "../hw/mem.h"
+#include "../hw/ppu.h"
+#include "../hw/snd.h"
+#include "../hw/cart.h"
+#include "../hw/joypad.h"
+#include "../hw/state.h"
+#include "../drv/render.h"
+#include "../drv/input.h"
+#include "../drv/movie.h"
+#include "../drv/framehash.h"
+
+#define WARMUP_FRAMES   300
+#define RUN_FRAMES      120
+#define MOVIE_FRAMES    900
+#define MOVIE_INTERVAL  120 // keyframes, so playback runs through a few of them
+#define PRESS_EVERY     150
+#define PRESS_FRAMES    5
+
+static const char *g_pRomPath = NULL;
+
+static uint32_t g_frame[DISP_WIDTH * DISP_HEIGHT];
+static uint64_t g_hashes[MOVIE_FRAMES];
+static uint64_t g_recorded[MOVIE_FRAMES];
+
+static bool g_eiDelay = false;
+
+/**
+ * @brief the main loop's instruction step, without the debugger and traces
+ */
+static bool step(void)
+{
+    bus_t *pBus = pGetBusPtr();
+    const cpu_t *pCpu = getCpuObject();
+
+    int mCycles = 0;
+
+    if (!g_eiDelay)
+    {
+        mCycles += handleInterrupts();
+    }
+
+    g_eiDelay = (pBus->bus[pCpu->reg16.pc] == 0xFB);
+
+    if (!checkHalted())
+    {
+        mCycles += executeInstruction(pBus->bus[pCpu->reg16.pc]);
+    }
+
+    handleTimers(mCycles);
+    ppuLoop(mCycles * 4);
+    sndLoop(mCycles * 4);
+    joypadLoop(mCycles * 4);
+
+    if (pBus->map.ioregs.disableBootrom == 1)
+    {
+        unmapBootrom();
+    }
+
+    return g_eiDelay;
+}
+
+static bool boot(void)
+{
+    resetBus();
+    resetCpu();
+    ppuInit(true);
+    sndSetSynthesis(false);
+    sndInit(SND_DEFAULT_RATE);
+    joypadInit();
+    renderSetTarget(g_frame, DISP_WIDTH);
+    g_eiDelay = false;
+
+    if (!loadRom(g_pRomPath))
+    {
+        return false;
+    }
+
+    cpuSkipBootrom();
+    return true;
+}
+
+/**
+ * @brief queue START presses for frames [first, last)
+ */
+static void pressStart(uint64_t first, uint64_t last)
+{
+    for (uint64_t frame = first - (first % PRESS_EVERY) + PRESS_EVERY; frame < last; frame += PRESS_EVERY)
+    {
+        inputPushAtFrame(frame, INPUT_START, INPUT_START);
+        inputPushAtFrame(frame + PRESS_FRAMES, INPUT_START, 0);
+    }
+}
+
+static void runFrames(uint64_t frames)
+{
+    uint64_t end = joypadGetCycle() + (frames * INPUT_FRAME_CYCLES);
+
+    while (joypadGetCycle() < end)
+    {
+        step();
+    }
+}
+
+/**
+ * @brief run to the next instruction boundary a state may be taken at, and take it
+ */
+static void saveAtBoundary(uint8_t *pState)
+{
+    while (!stateCanSave(g_eiDelay))
+    {
+        step();
+    }
+
+    stateSave(pState);
+}
+
+static bool fail(const char *pWhat)
+{
+    fprintf(stderr, "FAIL: %s\n", pWhat);
+    return false;
+}
+
+static bool testRoundTrip(void)
+{
+    size_t size = stateSize();
+    uint8_t *pFirst = malloc(size);
+    uint8_t *pSecond = malloc(size);
+    bool ok = false;
+
+    if (!pFirst || !pSecond || !boot())
+    {
+        goto out;
+    }
+
+    // no presses left for the runs below: a load drops the queued ones
+    pressStart(0, WARMUP_FRAMES - PRESS_EVERY);
+    runFrames(WARMUP_FRAMES);
+    saveAtBoundary(pFirst);
+
+    // clobber the live palettes so a load that forgets the tables shows up
+    uint8_t bgp = pGetBusPtr()->bus[0xFF47];
+
+    write8((uint8_t)~bgp, 0xFF47);
+
+    if (!stateLoad(pFirst, size))
+    {
+        ok = fail("state did not load");
+        goto out;
+    }
+
+    stateSave(pSecond);
+
+    if (memcmp(pFirst, pSecond, size) != 0)
+    {
+        ok = fail("save, load, save gave different states");
+        goto out;
+    }
+
+    uint32_t lut[4];
+
+    renderBuildLut(bgp, lut);
+
+    if (memcmp(pGetPaletteLut(PALETTE_BGP), lut, sizeof(lut)) != 0)
+    {
+        ok = fail("BGP table not rebuilt on load");
+        goto out;
+    }
+
+    printf("round trip: %zu bytes equal\n", size);
+
+    runFrames(RUN_FRAMES);
+    saveAtBoundary(pSecond);
+
+    if (!stateLoad(pFirst, size))
+    {
+        ok = fail("state did not load");
+        goto out;
+    }
+
+    runFrames(RUN_FRAMES);
+    saveAtBoundary(pFirst);
+
+    if (memcmp(pFirst, pSecond, size) != 0)
+    {
+        ok = fail("running on from a loaded state diverged");
+        goto out;
+    }
+
+    printf("resume: %d frames on, states equal\n", RUN_FRAMES);
+    ok = true;
+
+out:
+    free(pFirst);
+    free(pSecond);
+    return ok;
+}
+
+/**
+ * @brief run until the movie is done or MOVIE_FRAMES are out, keeping each frame's hash
+ * @return frames hashed
+ */
+static uint32_t runMovie(void)
+{
+    uint32_t base = framehashGetCount(HASH_VIDEO);
+    uint32_t count = 0;
+    uint64_t end = (uint64_t)MOVIE_FRAMES * INPUT_FRAME_CYCLES;
+
+    while ((movieIsRecording() || movieIsPlaying()) && (joypadGetCycle() < end))
+    {
+        movieTick(step());
+
+        if ((framehashGetCount(HASH_VIDEO) - base) > count)
+        {
+            g_hashes[count++] = framehashGetLast(HASH_VIDEO);
+        }
+    }
+
+    return count;
+}
+
+static bool testMovie(const char *pPath)
+{
+    if (!boot() || !movieRecordStart(pPath, MOVIE_INTERVAL))
+    {
+        return false;
+    }
+
+    framehashEnable(true);
+    pressStart(0, MOVIE_FRAMES);
+
+    uint32_t frames = runMovie();
+
+    memcpy(g_recorded, g_hashes, frames * sizeof(uint64_t));
+
+    SMovieStats_t stats;
+
+    movieGetStats(&stats);
+    movieStop();
+
+    if (stats.events == 0)
+    {
+        return fail("no button changes recorded");
+    }
+
+    // the live run left nothing queued for the replay to pick up
+    if (!boot() || !moviePlayStart(pPath))
+    {
+        return false;
+    }
+
+    uint32_t replayed = runMovie();
+
+    movieStop();
+    framehashEnable(false);
+
+    if (replayed < frames)
+    {
+        fprintf(stderr, "FAIL: replay ended after %u of %u frames\n", replayed, frames);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        if (g_hashes[i] != g_recorded[i])
+        {
+            fprintf(stderr, "FAIL: frame %u hashes %016llx on replay, %016llx recorded\n", i,
+                    (unsigned long long)g_hashes[i], (unsigned long long)g_recorded[i]);
+            return false;
+        }
+    }
+
+    printf("movie: %u frames, %llu button changes, %llu keyframes, replay hashes equal\n", frames,
+           (unsigned long long)stats.events, (unsigned long long)stats.keyframes);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if ((argc < 2) || (argc > 3))
+    {
+        fprintf(stderr, "usage: %s rom.gb [scratch.movie]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    g_pRomPath = argv[1];
+
+    const char *pMoviePath = (argc == 3) ? argv[2] : "statetest.movie";
+    bool ok = testRoundTrip() && testMovie(pMoviePath);
+
+    remove(pMoviePath);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,306 @@
+/**
+ * @file tracediff.c
+ * @author Toesoe
+ * @brief compare a seaboy cpu trace with a reference log, or print it as one
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * the reference is a Gameboy Doctor log (one "A:01 F:B0 ... PC:0100 PCMEM:00,C3,13,02" line per
+ * instruction) or another cpu trace. both are streamed: memory use does not grow with their length.
+ * our trace is skipped ahead to the reference's first PC, so one taken from power-on lines up with
+ * a log that starts after the bootrom.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../drv/cputrace.h"
+
+#define LINE_MAX        128
+#define DEFAULT_CONTEXT 10
+
+typedef struct
+{
+    SCpuTraceReader_t *pReader; // another trace, or
+    FILE              *pText;   // a Doctor log
+    uint64_t           line;
+} SReference_t;
+
+static const char *g_regNames[8] = { "A", "F", "B", "C", "D", "E", "H", "L" };
+
+/**
+ * @return CPUTRACE_ENTRY and whether PCMEM and the cycle can be compared
+ */
+static ECpuTraceRead_t readReference(SReference_t *pRef, SCpuTraceEntry_t *pEntry, bool *pHasMem, bool *pHasCycle)
+{
+    if (pRef->pReader)
+    {
+        *pHasMem = true;
+        *pHasCycle = true;
+        pRef->line++;
+        return cputraceRead(pRef->pReader, pEntry);
+    }
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), pRef->pText))
+    {
+        unsigned int v[14];
+
+        pRef->line++;
+
+        if (line[strspn(line, " \t\r\n")] == '\0')
+        {
+            continue;
+        }
+
+        int fields = sscanf(line, "A:%x F:%x B:%x C:%x D:%x E:%x H:%x L:%x SP:%x PC:%x PCMEM:%x,%x,%x,%x",
+                            &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9], &v[10],
+                            &v[11], &v[12], &v[13]);
+
+        if ((fields != 10) && (fields != 14))
+        {
+            fprintf(stderr, "reference line %llu is not a Gameboy Doctor line\n", (unsigned long long)pRef->line);
+            return CPUTRACE_ERROR;
+        }
+
+        memset(pEntry, 0, sizeof(SCpuTraceEntry_t));
+
+        for (int i = 0; i < 8; i++)
+        {
+            pEntry->regs[i] = (uint8_t)v[i];
+        }
+
+        pEntry->sp = (uint16_t)v[8];
+        pEntry->pc = (uint16_t)v[9];
+
+        for (int i = 0; (fields == 14) && (i < 4); i++)
+        {
+            pEntry->mem[i] = (uint8_t)v[10 + i];
+        }
+
+        *pHasMem = (fields == 14);
+        *pHasCycle = false;
+        return CPUTRACE_ENTRY;
+    }
+
+    return CPUTRACE_END;
+}
+
+/**
+ * @brief list what differs into pDst; empty if nothing does
+ */
+static void describeDifference(const SCpuTraceEntry_t *pOurs, const SCpuTraceEntry_t *pRef, bool hasMem, bool hasCycle,
+                               char *pDst, size_t len)
+{
+    size_t used = 0;
+
+    pDst[0] = '\0';
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (pOurs->regs[i] != pRef->regs[i])
+        {
+            used += (size_t)snprintf(&pDst[used], len - used, " %s", g_regNames[i]);
+        }
+    }
+
+    if (pOurs->sp != pRef->sp)
+    {
+        used += (size_t)snprintf(&pDst[used], len - used, " SP");
+    }
+
+    if (pOurs->pc != pRef->pc)
+    {
+        used += (size_t)snprintf(&pDst[used], len - used, " PC");
+    }
+
+    if (hasMem && (memcmp(pOurs->mem, pRef->mem, sizeof(pOurs->mem)) != 0))
+    {
+        used += (size_t)snprintf(&pDst[used], len - used, " PCMEM");
+    }
+
+    if (hasCycle && (pOurs->cycle != pRef->cycle))
+    {
+        snprintf(&pDst[used], len - used, " cycle (%llu, expected %llu)", (unsigned long long)pOurs->cycle,
+                 (unsigned long long)pRef->cycle);
+    }
+}
+
+static int printTrace(SCpuTraceReader_t *pOurs)
+{
+    SCpuTraceEntry_t entry;
+    ECpuTraceRead_t  result;
+    char             line[LINE_MAX];
+
+    while ((result = cputraceRead(pOurs, &entry)) == CPUTRACE_ENTRY)
+    {
+        cputraceFormat(&entry, line, sizeof(line));
+        puts(line);
+    }
+
+    if (result == CPUTRACE_ERROR)
+    {
+        fprintf(stderr, "trace is corrupt after entry %llu\n", (unsigned long long)pOurs->entries);
+        return 2;
+    }
+
+    return 0;
+}
+
+static int compare(SCpuTraceReader_t *pOurs, SReference_t *pRef, int context)
+{
+    char (*pContext)[LINE_MAX] = calloc((size_t)context + 1, LINE_MAX);
+    uint64_t         matched = 0;
+    uint64_t         skipped = 0;
+    SCpuTraceEntry_t ours;
+    SCpuTraceEntry_t ref;
+    bool             hasMem = false;
+    bool             hasCycle = false;
+    int              status = 0;
+
+    if (!pContext)
+    {
+        return 2;
+    }
+
+    for (;;)
+    {
+        ECpuTraceRead_t refResult = readReference(pRef, &ref, &hasMem, &hasCycle);
+        ECpuTraceRead_t ourResult = cputraceRead(pOurs, &ours);
+
+        // line the traces up on the reference's first PC
+        while ((matched == 0) && (refResult == CPUTRACE_ENTRY) && (ourResult == CPUTRACE_ENTRY) && (ours.pc != ref.pc))
+        {
+            skipped++;
+            ourResult = cputraceRead(pOurs, &ours);
+        }
+
+        if ((matched == 0) && (skipped > 0))
+        {
+            fprintf(stderr, "skipped %llu of our entries to reach PC %04X\n", (unsigned long long)skipped, ref.pc);
+            skipped = 0;
+        }
+
+        if ((refResult == CPUTRACE_ERROR) || (ourResult == CPUTRACE_ERROR))
+        {
+            fprintf(stderr, "%s is unreadable after %llu matching entries\n",
+                    (ourResult == CPUTRACE_ERROR) ? "our trace" : "the reference", (unsigned long long)matched);
+            status = 2;
+            break;
+        }
+
+        if ((refResult == CPUTRACE_END) || (ourResult == CPUTRACE_END))
+        {
+            if (refResult != ourResult)
+            {
+                printf("%s ends first, after %llu matching entries\n",
+                       (ourResult == CPUTRACE_END) ? "our trace" : "the reference", (unsigned long long)matched);
+                status = 1;
+            }
+            else
+            {
+                printf("%llu entries match\n", (unsigned long long)matched);
+            }
+
+            break;
+        }
+
+        char difference[128];
+
+        describeDifference(&ours, &ref, hasMem, hasCycle, difference, sizeof(difference));
+
+        if (difference[0] != '\0')
+        {
+            char line[LINE_MAX];
+            int  shown = (matched < (uint64_t)context) ? (int)matched : context;
+
+            printf("diverged at reference line %llu, entry %llu, cycle %llu\n", (unsigned long long)pRef->line,
+                   (unsigned long long)matched, (unsigned long long)ours.cycle);
+
+            for (int i = shown; i > 0; i--)
+            {
+                printf("          %s\n", pContext[(matched - (uint64_t)i) % (uint64_t)(context + 1)]);
+            }
+
+            cputraceFormat(&ref, line, sizeof(line));
+            printf("expected: %s\n", line);
+            cputraceFormat(&ours, line, sizeof(line));
+            printf("got:      %s\n", line);
+            printf("differs: %s\n", difference);
+            status = 1;
+            break;
+        }
+
+        cputraceFormat(&ours, pContext[matched % (uint64_t)(context + 1)], LINE_MAX);
+        matched++;
+    }
+
+    free(pContext);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    if ((argc < 2) || (argc > 4))
+    {
+        fprintf(stderr, "usage: %s <ours.sbct>                              print as Gameboy Doctor lines\n"
+                        "       %s <ours.sbct> <reference> [context lines]  stop at the first difference\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+
+    SCpuTraceReader_t *pOurs = malloc(sizeof(SCpuTraceReader_t));
+    SCpuTraceReader_t *pTheirs = malloc(sizeof(SCpuTraceReader_t));
+    SReference_t       ref = { 0 };
+    int                context = (argc == 4) ? atoi(argv[3]) : DEFAULT_CONTEXT;
+    int                status = 2;
+
+    if (!pOurs || !pTheirs || !cputraceReaderOpen(pOurs, argv[1]))
+    {
+        free(pOurs);
+        free(pTheirs);
+        return 2;
+    }
+
+    if (argc == 2)
+    {
+        status = printTrace(pOurs);
+    }
+    else
+    {
+        FILE *pFile = fopen(argv[2], "rb");
+        char  magic[4] = { 0 };
+
+        if (!pFile)
+        {
+            fprintf(stderr, "cannot open %s\n", argv[2]);
+        }
+        else if ((fread(magic, 1, 4, pFile) == 4) && (memcmp(magic, CPUTRACE_MAGIC, 4) == 0))
+        {
+            fclose(pFile);
+
+            if (cputraceReaderOpen(pTheirs, argv[2]))
+            {
+                ref.pReader = pTheirs;
+                status = compare(pOurs, &ref, (context > 0) ? context : 0);
+                cputraceReaderClose(pTheirs);
+            }
+        }
+        else
+        {
+            rewind(pFile);
+            ref.pText = pFile;
+            status = compare(pOurs, &ref, (context > 0) ? context : 0);
+            fclose(pFile);
+        }
+    }
+
+    cputraceReaderClose(pOurs);
+    free(pOurs);
+    free(pTheirs);
+    return status;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file tracedump.c
+ * @author Toesoe
+ * @brief print seaboy trace files as text
+ * @version 0.1
+ * @date 2024-03-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../drv/trace.h"
+
+static inline uint16_t getU16(const uint8_t *pSrc)
+{
+    return (uint16_t)(pSrc[0] | (pSrc[1] << 8));
+}
+
+static inline uint32_t getU32(const uint8_t *pSrc)
+{
+    return (uint32_t)getU16(pSrc) | ((uint32_t)getU16(pSrc + 2) << 16);
+}
+
+static inline uint64_t getU64(const uint8_t *pSrc)
+{
+    return (uint64_t)getU32(pSrc) | ((uint64_t)getU32(pSrc + 4) << 32);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t mask = TRACE_ALL;
+
+    if ((argc < 2) || (argc > 3) || ((argc == 3) && !traceParseMask(argv[2], &mask)))
+    {
+        fprintf(stderr, "usage: %s <in.sbtr> [cpu,irq,mem,mbc,ppu,input|all]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *pIn = fopen(argv[1], "rb");
+
+    if (!pIn)
+    {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    uint8_t header[16];
+
+    if ((fread(header, sizeof(header), 1, pIn) != 1) || (memcmp(header, TRACE_MAGIC, 4) != 0) ||
+        (getU16(&header[4]) != TRACE_VERSION) || (getU16(&header[6]) != TRACE_RECORD_BYTES))
+    {
+        fprintf(stderr, "%s is not a version %d trace\n", argv[1], TRACE_VERSION);
+        fclose(pIn);
+        return 1;
+    }
+
+    printf("# categories 0x%02x\n", getU32(&header[8]));
+
+    uint8_t record[TRACE_RECORD_BYTES];
+
+    while (fread(record, sizeof(record), 1, pIn) == 1)
+    {
+        uint8_t event = record[14];
+
+        if (!(mask & TRACE_BIT(TRACE_CATEGORY(event))))
+        {
+            continue;
+        }
+
+        printf("%2u %14llu %-5s %-10s %04x %x\n", record[15], (unsigned long long)getU64(record),
+               pTraceCategoryName(TRACE_CATEGORY(event)), pTraceEventName(event), getU16(&record[12]),
+               getU32(&record[8]));
+    }
+
+    fclose(pIn);
+    return 0;
+}